@@ -0,0 +1,105 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+#include "priority_buffer.h"
+
+/**
+   Starvation benchmark.
+
+   The buffer is kept saturated: each step an element is retrieved and the free cell refilled,
+   with a priority 0 element every LOW_EVERY steps and otherwise one of random higher priority.
+   Without aging a priority 0 element is only retrieved once the buffer holds nothing else, so its
+   wait grows with the buffer size. With PBUF_setAging() its run climbs a priority each time it
+   goes unserved for the threshold, so its wait is bounded by about the threshold times the number
+   of priorities. Waits are counted in retrievals. The cost per step shows the aging overhead. */
+
+#define STEPS 2000000u
+#define LOW_EVERY 16u
+
+static pbuf_t buffer;
+static uint32_t seed = 0x2545F491u;
+
+static priority_t randomPriority(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return (priority_t) (1u + (seed % (PRIORITY_SIZE - 1u)));
+}
+
+static double elapsedNs(struct timespec * start, struct timespec * stop)
+{
+  return ((double) (stop->tv_sec - start->tv_sec) * 1e9) +
+    (double) (stop->tv_nsec - start->tv_nsec);
+}
+
+static void run(uint32_t threshold)
+{
+  struct timespec start;
+  struct timespec stop;
+  element_t element;
+  uint64_t lowWait = 0;
+  uint64_t highWait = 0;
+  uint32_t lowRetrieved = 0;
+  uint32_t wait;
+  uint32_t maxLowWait = 0;
+  uint32_t maxHighWait = 0;
+  uint32_t step;
+
+  PBUF_init(&buffer);
+  PBUF_setAging(&buffer, threshold);
+
+  // each element holds the step it was inserted at, and whether it is priority 0 in bit 0
+  while( ! PBUF_full(&buffer))
+    {
+      PBUF_insert(&buffer, 0u, randomPriority());
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(step = 0; step < STEPS; step++)
+    {
+      if(step % LOW_EVERY)
+        {
+          PBUF_insert(&buffer, (element_t) (step << 1), randomPriority());
+        }
+      else
+        {
+          PBUF_insert(&buffer, (element_t) ((step << 1) | 1u), 0u);
+        }
+
+      PBUF_retrieve(&buffer, &element);
+      wait = step - (uint32_t) (element >> 1);
+      if(element & 1u)
+        {
+          lowRetrieved++;
+          lowWait += wait;
+          maxLowWait = (wait > maxLowWait) ? wait : maxLowWait;
+        }
+      else
+        {
+          highWait += wait;
+          maxHighWait = (wait > maxHighWait) ? wait : maxHighWait;
+        }
+    }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  printf("BUFFER_SIZE %4lu  PRIORITY_SIZE %2u  threshold %5u  priority 0 wait mean %7.1f max %6u  "
+         "others mean %6.1f max %6u  %5.1f ns per step\n",
+         (unsigned long) BUFFER_SIZE, (unsigned) PRIORITY_SIZE, (unsigned) threshold,
+         lowRetrieved ? (double) lowWait / lowRetrieved : 0.0, (unsigned) maxLowWait,
+         (double) highWait / (STEPS - lowRetrieved), (unsigned) maxHighWait,
+         elapsedNs(&start, &stop) / STEPS);
+}
+
+int main(void)
+{
+  run(0u);
+  run(1024u);
+  run(256u);
+  run(64u);
+
+  return 0;
+}
@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+#include "priority_buffer.h"
+
+/**
+   Priority lookup benchmark.
+
+   Measures the average cost of lowestPriority(), highestPriority(), nextHighestPriority()
+   and activePriorityCount() over random activity flags at the configured PRIORITY_SIZE.
+   Built with UNIT_TESTS so the internal routines are visible, once with the compiler
+   builtins and once with PBUF_NO_BUILTINS (see `make bench_bits`). */
+
+#define PATTERNS 1024u
+#define ROUNDS 4096u
+
+static pbuf_t buffer;
+static activity_t patterns[PATTERNS];
+static priority_t starts[PATTERNS];
+static uint32_t seed = 0x2545F491u;
+static volatile uint32_t sink;
+
+static uint32_t randomWord(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return seed;
+}
+
+static double elapsedNs(struct timespec * start, struct timespec * stop)
+{
+  return ((double) (stop->tv_sec - start->tv_sec) * 1e9) +
+    (double) (stop->tv_nsec - start->tv_nsec);
+}
+
+int main(void)
+{
+  struct timespec start;
+  struct timespec stop;
+  priority_t priority;
+  uint32_t total = 0;
+  uint32_t pattern;
+  uint32_t round;
+
+  PBUF_init(&buffer);
+
+  /* random non-empty activity flags, with a random starting priority for the next highest search */
+  for(pattern = 0; pattern < PATTERNS; pattern++)
+    {
+      patterns[pattern] = (activity_t) ((((uint64_t) randomWord() << 32) | randomWord()) &
+                                        (UINT64_MAX >> (64u - PRIORITY_SIZE)));
+      if( ! patterns[pattern])
+        {
+          patterns[pattern] = 1u;
+        }
+      starts[pattern] = (priority_t) (randomWord() % PRIORITY_SIZE);
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for(round = 0; round < ROUNDS; round++)
+    {
+      for(pattern = 0; pattern < PATTERNS; pattern++)
+        {
+          buffer.activity = patterns[pattern];
+          lowestPriority(&buffer, &priority);
+          total += priority;
+          highestPriority(&buffer, &priority);
+          total += priority;
+          if(nextHighestPriority(&buffer, &priority, starts[pattern]) == VALID_PRIORITY)
+            {
+              total += priority;
+            }
+          total += activePriorityCount(&buffer);
+        }
+    }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  sink = total;
+
+  printf("PRIORITY_SIZE %3u  %-9s  lookup %5.2f ns\n",
+         (unsigned) PRIORITY_SIZE,
+#ifdef PBUF_BUILTINS
+         "builtin",
+#else
+         "portable",
+#endif
+         elapsedNs(&start, &stop) / ((double) PATTERNS * ROUNDS * 4u));
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+#include "priority_buffer.h"
+
+/**
+   Cell layout benchmark.
+
+   Fills a large buffer of 64-bit elements at random priorities and overwrites it until the
+   links are scattered through memory, then measures the average cost of following a link
+   with nextIndex() around the whole buffer, of an overwriting insert and of a retrieve.
+   Built with UNIT_TESTS so nextIndex() is visible, once with cell_t and once with
+   PBUF_SOA_LAYOUT (see `make bench_layout`). Once the buffer no longer fits in cache the
+   cost of a link hop follows the number of bytes each hop pulls in. */
+
+#define ROUNDS 4u
+
+static pbuf_t buffer;
+static uint32_t seed = 0x2545F491u;
+static volatile uint32_t sink;
+
+static priority_t randomPriority(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return (priority_t) (seed % PRIORITY_SIZE);
+}
+
+static double elapsedNs(struct timespec * start, struct timespec * stop)
+{
+  return ((double) (stop->tv_sec - start->tv_sec) * 1e9) +
+    (double) (stop->tv_nsec - start->tv_nsec);
+}
+
+int main(void)
+{
+  struct timespec start;
+  struct timespec stop;
+  double walkNs = 0.0;
+  double overwriteNs = 0.0;
+  double retrieveNs = 0.0;
+  element_t element;
+  index_t index;
+  uint32_t total = 0;
+  uint32_t count;
+  uint32_t round;
+
+  PBUF_init(&buffer);
+
+  for(round = 0; round < ROUNDS; round++)
+    {
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          PBUF_insert(&buffer, (element_t) count, randomPriority());
+        }
+
+      /* insert into the full buffer, scattering the links */
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          PBUF_insert(&buffer, (element_t) count, randomPriority());
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      overwriteNs += elapsedNs(&start, &stop);
+
+      /* follow the links once around the buffer */
+      index = tailIndex(&buffer);
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          nextIndex(&buffer, &index, index);
+          total += index;
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      walkNs += elapsedNs(&start, &stop);
+
+      /* drain the buffer */
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          PBUF_retrieve(&buffer, &element);
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      retrieveNs += elapsedNs(&start, &stop);
+    }
+  sink = total;
+
+  printf("BUFFER_SIZE %10lu  %-4s  bytes per link %2u  "
+         "link %6.1f ns  overwrite %6.1f ns  retrieve %6.1f ns\n",
+         (unsigned long) BUFFER_SIZE,
+#ifdef PBUF_SOA_LAYOUT
+         "soa",
+         (unsigned) sizeof(index_t),
+#else
+         "cell",
+         (unsigned) sizeof(cell_t),
+#endif
+         walkNs / ((double) BUFFER_SIZE * ROUNDS),
+         overwriteNs / ((double) BUFFER_SIZE * ROUNDS),
+         retrieveNs / ((double) BUFFER_SIZE * ROUNDS));
+
+  return 0;
+}
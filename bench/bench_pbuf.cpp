@@ -0,0 +1,88 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include "pbuf.hpp"
+
+/**
+   C++ insert / retrieve benchmark.
+
+   The same measurements as bench_priority_buffer.c, for pbuf::PBuf at the BUFFER_SIZE and
+   PRIORITY_SIZE given on the command line, so that the two can be compared at the same
+   sizes (see `make bench_cpp`). */
+
+#ifndef BUFFER_SIZE
+#  define BUFFER_SIZE 4
+#endif
+
+#ifndef PRIORITY_SIZE
+#  define PRIORITY_SIZE 3
+#endif
+
+#define ROUNDS 4u
+
+using Clock = std::chrono::steady_clock;
+
+static pbuf::PBuf<std::uint8_t, BUFFER_SIZE, PRIORITY_SIZE> buffer;
+static std::uint32_t seed = 0x2545F491u;
+
+static std::uint8_t randomPriority()
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return static_cast<std::uint8_t>(seed % PRIORITY_SIZE);
+}
+
+static double elapsedNs(Clock::time_point start, Clock::time_point stop)
+{
+  return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+int main()
+{
+  Clock::time_point start;
+  double insertNs = 0.0;
+  double retrieveNs = 0.0;
+  double overwriteNs = 0.0;
+  std::uint8_t element;
+  std::uint32_t count;
+  std::uint32_t round;
+
+  for(round = 0; round < ROUNDS; round++)
+    {
+      // fill an empty buffer
+      start = Clock::now();
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          buffer.insert(static_cast<std::uint8_t>(count), randomPriority());
+        }
+      insertNs += elapsedNs(start, Clock::now());
+
+      // insert into a full buffer, overwriting where the priority allows
+      start = Clock::now();
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          buffer.insert(static_cast<std::uint8_t>(count), randomPriority());
+        }
+      overwriteNs += elapsedNs(start, Clock::now());
+
+      // drain the buffer
+      start = Clock::now();
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          buffer.retrieve(element);
+        }
+      retrieveNs += elapsedNs(start, Clock::now());
+    }
+
+  std::printf("BUFFER_SIZE %10lu  PRIORITY_SIZE %3u  %-7s  sizeof(index) %u  "
+              "insert %6.1f ns  overwrite %6.1f ns  retrieve %6.1f ns\n",
+              static_cast<unsigned long>(BUFFER_SIZE), static_cast<unsigned>(PRIORITY_SIZE), "c++",
+              static_cast<unsigned>(sizeof(decltype(buffer)::index_type)),
+              insertNs / (static_cast<double>(BUFFER_SIZE) * ROUNDS),
+              overwriteNs / (static_cast<double>(BUFFER_SIZE) * ROUNDS),
+              retrieveNs / (static_cast<double>(BUFFER_SIZE) * ROUNDS));
+
+  return 0;
+}
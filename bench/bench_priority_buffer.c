@@ -0,0 +1,146 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <inttypes.h>
+#include "priority_buffer.h"
+
+/**
+   Insert / retrieve benchmark.
+
+   Measures the average cost of PBUF_insert() and PBUF_retrieve() at the configured
+   BUFFER_SIZE. Build once per size (see `make bench`); if the operations are O(1)
+   the cost per operation stays flat as BUFFER_SIZE grows. Built with PBUF_RUNTIME_SIZE
+   the same buffer is created at run time with PBUF_create() for comparison. The batch
+   and drain figures are the cost per element of filling the buffer with PBUF_insertBatch()
+   and emptying it with PBUF_retrieveBatch(), BATCH elements at a time. */
+
+#define ROUNDS 4u
+#define BATCH 32u
+
+#ifndef PBUF_RUNTIME_SIZE
+
+static pbuf_t buffer;
+
+#endif  /* ! PBUF_RUNTIME_SIZE */
+static uint32_t seed = 0x2545F491u;
+
+static priority_t randomPriority(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return (priority_t) (seed % PRIORITY_SIZE);
+}
+
+static double elapsedNs(struct timespec * start, struct timespec * stop)
+{
+  return ((double) (stop->tv_sec - start->tv_sec) * 1e9) +
+    (double) (stop->tv_nsec - start->tv_nsec);
+}
+
+int main(void)
+{
+  struct timespec start;
+  struct timespec stop;
+  double insertNs = 0.0;
+  double retrieveNs = 0.0;
+  double overwriteNs = 0.0;
+  double batchNs = 0.0;
+  double drainNs = 0.0;
+  element_t batch[BATCH];
+  element_t element;
+  uint32_t count;
+  uint32_t round;
+  pbuf_t * bf;
+
+#ifdef PBUF_RUNTIME_SIZE
+  size_t bytes = PBUF_requiredBytes(BUFFER_SIZE, sizeof(element_t));
+
+  bf = PBUF_create(malloc(bytes), bytes, BUFFER_SIZE, PRIORITY_SIZE, sizeof(element_t));
+  if(bf == NULL)
+    {
+      return 1;
+    }
+#else
+  bf = &buffer;
+  PBUF_init(bf);
+#endif  /* PBUF_RUNTIME_SIZE */
+
+  for(count = 0; count < BATCH; count++)
+    {
+      batch[count] = (element_t) count;
+    }
+
+  for(round = 0; round < ROUNDS; round++)
+    {
+      /* fill an empty buffer */
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          PBUF_insert(bf, (element_t) count, randomPriority());
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      insertNs += elapsedNs(&start, &stop);
+
+      /* insert into a full buffer, overwriting where the priority allows */
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          PBUF_insert(bf, (element_t) count, randomPriority());
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      overwriteNs += elapsedNs(&start, &stop);
+
+      /* drain the buffer */
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(count = 0; count < BUFFER_SIZE; count++)
+        {
+          PBUF_retrieve(bf, &element);
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      retrieveNs += elapsedNs(&start, &stop);
+
+      /* fill the empty buffer again in batches */
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(count = 0; count < BUFFER_SIZE; count += BATCH)
+        {
+          PBUF_insertBatch(bf, batch, ((BUFFER_SIZE - count) < BATCH) ? (BUFFER_SIZE - count) : BATCH,
+                           randomPriority(), NULL, NULL);
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      batchNs += elapsedNs(&start, &stop);
+
+      /* and drain it in batches */
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      while(PBUF_retrieveBatch(bf, batch, BATCH, NULL) == BATCH)
+        {
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      drainNs += elapsedNs(&start, &stop);
+
+      for(count = 0; count < BATCH; count++)
+        {
+          batch[count] = (element_t) count;
+        }
+    }
+
+  printf("BUFFER_SIZE %10lu  PRIORITY_SIZE %3u  %-7s  sizeof(cell_t) %2u  "
+         "insert %6.1f ns  overwrite %6.1f ns  retrieve %6.1f ns  batch %6.1f ns  drain %6.1f ns\n",
+         (unsigned long) BUFFER_SIZE, (unsigned) PRIORITY_SIZE,
+#ifdef PBUF_RUNTIME_SIZE
+         "runtime",
+#else
+         "fixed",
+#endif
+         (unsigned) sizeof(cell_t),
+         insertNs / ((double) BUFFER_SIZE * ROUNDS),
+         overwriteNs / ((double) BUFFER_SIZE * ROUNDS),
+         retrieveNs / ((double) BUFFER_SIZE * ROUNDS),
+         batchNs / ((double) BUFFER_SIZE * ROUNDS),
+         drainNs / ((double) BUFFER_SIZE * ROUNDS));
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include "priority_buffer.h"
+
+/**
+   Thread scaling benchmark.
+
+   From 1 to MAX_THREADS threads each insert ROUNDS elements of random priority and retrieve as
+   many, one of each in turn. Built with PBUF_SHARDS each thread inserts into a shard of its own
+   and retrieves from its own shard or steals from another; otherwise the threads share a single
+   buffer behind a mutex (see `make bench_shards`). The figure is the throughput of all threads
+   together, so it rises with the thread count as far as the machine has cores to run them. The
+   sharded build yields the processor while it waits for a shard's spinlock, so the figures stay
+   comparable on a machine with fewer cores than threads. */
+
+#define ROUNDS 200000u
+#define MAX_THREADS 32u
+
+#ifdef PBUF_SHARDS
+
+static pbuf_sharded_t sharded;
+
+#else
+
+static pbuf_t buffer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+#endif  /* PBUF_SHARDS */
+
+static double elapsedNs(struct timespec * start, struct timespec * stop)
+{
+  return ((double) (stop->tv_sec - start->tv_sec) * 1e9) +
+    (double) (stop->tv_nsec - start->tv_nsec);
+}
+
+static int insert(unsigned thread, element_t element, priority_t priority)
+{
+#ifdef PBUF_SHARDS
+  return PBUF_shardedInsert(&sharded, thread % PBUF_SHARDS, element, priority);
+#else
+  int returnVal;
+
+  (void) thread;
+  pthread_mutex_lock(&lock);
+  returnVal = PBUF_insert(&buffer, element, priority);
+  pthread_mutex_unlock(&lock);
+
+  return returnVal;
+#endif  /* PBUF_SHARDS */
+}
+
+static int retrieve(unsigned thread, element_t * element)
+{
+#ifdef PBUF_SHARDS
+  return PBUF_shardedRetrieve(&sharded, thread % PBUF_SHARDS, element, NULL);
+#else
+  int returnVal;
+
+  (void) thread;
+  pthread_mutex_lock(&lock);
+  returnVal = PBUF_retrieve(&buffer, element);
+  pthread_mutex_unlock(&lock);
+
+  return returnVal;
+#endif  /* PBUF_SHARDS */
+}
+
+static void * worker(void * arg)
+{
+  unsigned thread = (unsigned) (uintptr_t) arg;
+  uint32_t seed = 0x2545F491u + thread;
+  element_t element;
+  uint32_t count;
+
+  for(count = 0; count < ROUNDS; count++)
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      insert(thread, (element_t) count, (priority_t) (seed % PRIORITY_SIZE));
+      retrieve(thread, &element);
+    }
+
+  return NULL;
+}
+
+int main(void)
+{
+  struct timespec start;
+  struct timespec stop;
+  pthread_t threads[MAX_THREADS];
+  unsigned count;
+  unsigned threadCount;
+
+  for(threadCount = 1; threadCount <= MAX_THREADS; threadCount *= 2u)
+    {
+#ifdef PBUF_SHARDS
+      PBUF_shardedInit(&sharded);
+#else
+      PBUF_init(&buffer);
+#endif  /* PBUF_SHARDS */
+
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for(count = 0; count < threadCount; count++)
+        {
+          pthread_create(&threads[count], NULL, worker, (void *) (uintptr_t) count);
+        }
+      for(count = 0; count < threadCount; count++)
+        {
+          pthread_join(threads[count], NULL);
+        }
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+
+      printf("BUFFER_SIZE %6lu  PRIORITY_SIZE %3u  %-9s  threads %2u  %7.2f M insert+retrieve per s\n",
+             (unsigned long) BUFFER_SIZE, (unsigned) PRIORITY_SIZE,
+#ifdef PBUF_SHARDS
+             "sharded",
+#else
+             "mutex",
+#endif  /* PBUF_SHARDS */
+             threadCount,
+             ((double) threadCount * ROUNDS * 1e3) / elapsedNs(&start, &stop));
+    }
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "priority_buffer.h"
+
+/**
+   Producer / consumer throughput benchmark.
+
+   One thread inserts ELEMENTS elements of random priority while another retrieves them.
+   Built with PBUF_SPSC or PBUF_MPSC the two threads share the buffer without locks; otherwise
+   every call is wrapped in a mutex, as callers had to before (see `make bench_spsc`). Either
+   thread yields when it can make no progress, so the figures are comparable on a machine
+   with fewer cores than threads. */
+
+#define ELEMENTS 4000000u
+
+static pbuf_t buffer;
+static atomic_int producing;
+static uint32_t seed = 0x2545F491u;
+
+#ifndef PBUF_STAGED
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+#endif  /* ! PBUF_STAGED */
+
+static priority_t randomPriority(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return (priority_t) (seed % PRIORITY_SIZE);
+}
+
+static double elapsedNs(struct timespec * start, struct timespec * stop)
+{
+  return ((double) (stop->tv_sec - start->tv_sec) * 1e9) +
+    (double) (stop->tv_nsec - start->tv_nsec);
+}
+
+static int insert(element_t element, priority_t priority)
+{
+#ifdef PBUF_STAGED
+  return PBUF_insert(&buffer, element, priority);
+#else
+  int returnVal;
+
+  pthread_mutex_lock(&lock);
+  returnVal = PBUF_insert(&buffer, element, priority);
+  pthread_mutex_unlock(&lock);
+
+  return returnVal;
+#endif  /* PBUF_STAGED */
+}
+
+static int retrieve(element_t * element)
+{
+#ifdef PBUF_STAGED
+  return PBUF_retrieve(&buffer, element);
+#else
+  int returnVal;
+
+  pthread_mutex_lock(&lock);
+  returnVal = PBUF_retrieve(&buffer, element);
+  pthread_mutex_unlock(&lock);
+
+  return returnVal;
+#endif  /* PBUF_STAGED */
+}
+
+static void * producer(void * arg)
+{
+  uint32_t count;
+
+  (void) arg;
+  for(count = 0; count < ELEMENTS; count++)
+    {
+      while(insert((element_t) count, randomPriority()))
+        {
+          sched_yield();
+        }
+    }
+  atomic_store(&producing, 0);
+
+  return NULL;
+}
+
+int main(void)
+{
+  struct timespec start;
+  struct timespec stop;
+  pthread_t thread;
+  element_t element;
+  uint32_t retrieved = 0;
+
+  PBUF_init(&buffer);
+  atomic_store(&producing, 1);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pthread_create(&thread, NULL, producer, NULL);
+  while(atomic_load(&producing))
+    {
+      if( ! retrieve(&element))
+        {
+          retrieved++;
+        }
+      else
+        {
+          sched_yield();
+        }
+    }
+  while( ! retrieve(&element))
+    {
+      retrieved++;
+    }
+  pthread_join(thread, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  printf("BUFFER_SIZE %6lu  PRIORITY_SIZE %3u  %-7s  %6.1f ns per element  %5.1f%% retrieved\n",
+         (unsigned long) BUFFER_SIZE, (unsigned) PRIORITY_SIZE,
+#if defined(PBUF_SPSC)
+         "spsc",
+#elif defined(PBUF_MPSC)
+         "mpsc",
+#else
+         "mutex",
+#endif
+         elapsedNs(&start, &stop) / (double) ELEMENTS,
+         (100.0 * retrieved) / ELEMENTS);
+
+  return 0;
+}
@@ -36,6 +36,7 @@ static stateMachine_t stateMachine[] =
 
 /* static local state */
 
+static pbuf_t buffer;
 static state_t state;
 static uint8_t priority;
 static int inputValue;
@@ -65,7 +66,7 @@ static void stateInit(void)
 {
   priority = LOW_PRIORITY;
   state = STATE_ENTER_ACTION;
-  PBUF_reset();
+  PBUF_init(&buffer);
   clearTerminal();
   printBuffer();
 }
@@ -157,7 +158,7 @@ static void stateRetrieveValue(void)
   clearTerminal();
   for(;;)
     {
-      if(PBUF_retrieve(&value) == 0u)
+      if(PBUF_retrieve(&buffer, &value) == 0u)
         {
           printf("Value %d retrieved from buffer\n...\n", value);
         }
@@ -173,7 +174,7 @@ static void stateRetrieveValue(void)
 
 static void stateReset(void)
 {
-  PBUF_reset();
+  PBUF_reset(&buffer);
   clearTerminal();
   printf("Buffer Reset!\n...\n");
   printBuffer();
@@ -202,7 +203,7 @@ static void printPriority(void)
 static void printBuffer(void)
 {
   printPriority();
-  PBUF_print();
+  PBUF_print(&buffer);
   printMenu();
 }
 
@@ -237,7 +238,7 @@ static void insertValue(int value)
     {
       state = STATE_ENTER_ACTION;
       clearTerminal();
-      if(!PBUF_insert((uint8_t) inputValue, priority))
+      if(!PBUF_insert(&buffer, (uint8_t) inputValue, priority))
         {
           printf("Inserted %u, ", inputValue);
         }
@@ -1,113 +1,131 @@
 #ifndef DEFS_H
 #define DEFS_H
 
-#if BUFFER_SIZE < 3 || BUFFER_SIZE > 256
-
-# error ERROR: BUFFER_SIZE should be a value from 3 to 256
+/**
+   The check_t type holds the result of a check. */
 
-#endif  /* BUFFER_SIZE */
+typedef uint8_t check_t;
 
 /**
-   The highest priority in the system. */
+   The activity_word_t type is a single word of activity flags as scanned by the bit search
+   routines - the whole activity_t, or one leaf of it when the flags are held in leaves. */
 
-#define HIGH_PRI PRIORITY_SIZE - 1u
+#ifdef ACTIVITY_LEAVES
 
-/**
-   The lowest priority in the system. */
+typedef uint64_t activity_word_t;
 
-#define LOW_PRI 0u
+#else
 
-/**
-   The index_t type holds an index value. */
+typedef activity_t activity_word_t;
 
-typedef uint8_t index_t;
+#endif  /* ACTIVITY_LEAVES */
 
 /**
-   The check_t type holds the result of a check. */
+   The bit search routines use the compiler's count trailing / leading zero and population
+   count builtins where available. Define PBUF_NO_BUILTINS to use the portable versions. */
 
-typedef uint8_t check_t;
+#if defined(__GNUC__) && ! defined(PBUF_NO_BUILTINS)
+#  define PBUF_BUILTINS
+#endif
 
 /**
-   The activity_t type holds 8 bits of data known as activity flags - one bit per priority, to a maximum of
-   8 levels of priority. If the buffer currently holds data of a given priority, the appropriate bit is set to
-   ACTIVE. Once all elements of a particular quality of data are retrieved from the buffer, the relevant flag
-   is set to INACTIVE. The respective head only holds relevant data when the flag is ACTIVE. */
+   The number of cells and priorities of the buffer passed in - fixed at compile time
+   unless PBUF_RUNTIME_SIZE is defined. */
+
+#ifdef PBUF_RUNTIME_SIZE
+
+#  define CAPACITY(bf) ((bf)->capacity)
+#  define PRIORITIES(bf) ((bf)->priorities)
+
+#else
+
+#  define CAPACITY(bf) BUFFER_SIZE
+#  define PRIORITIES(bf) PRIORITY_SIZE
+
+#endif  /* PBUF_RUNTIME_SIZE */
 
-typedef uint8_t activity_t;
 /**
-   The cell_t structure is the buffers composite element. It holds an element and a next variable per slot in
-   the buffer. This linkage around the circular buffer enables the buffer to be re-routed or remapped easily,
-   allowing for prioritised data to be organised in order of preference. In other words, it can be quickly
-   re-arranged to allow higher orders of priority to be retrieved from the buffer quicker than lower orders
-   of priority. */
+   The link, data and payload fields of a cell, interleaved in cell_t or held in separate
+   arrays with PBUF_SOA_LAYOUT. */
+
+#ifdef PBUF_SOA_LAYOUT
+
+#  define LINK(bf, idx) ((bf)->next[idx])
+#  define DATA(bf, idx) ((bf)->data[idx])
+#  define CHUNK(bf, idx) ((bf)->chunk[idx])
+#  define LENGTH(bf, idx) ((bf)->length[idx])
 
-typedef struct CELL_T
-{
+#else
 
-  /**
-     data holds the data of the element. */
+#  define LINK(bf, idx) ((bf)->element[idx].next)
+#  define DATA(bf, idx) ((bf)->element[idx].data)
+#  define CHUNK(bf, idx) ((bf)->element[idx].chunk)
+#  define LENGTH(bf, idx) ((bf)->element[idx].length)
 
-#ifndef EXTERNAL_DATA_BUFFER
+#endif  /* PBUF_SOA_LAYOUT */
 
-  element_t data;
+/**
+   The end of a payload chunk chain. */
+
+#ifdef PAYLOAD_BUFFER
 
-#endif  /* ! EXTERNAL_DATA_BUFFER */
+#  define CHUNK_NONE ((chunk_t) ~(chunk_t) 0u)
 
-  /**
-     next is a link pointing to the next element in the buffer. */
+#endif  /* PAYLOAD_BUFFER */
 
-  index_t next;
+/**
+   The detach state of a cell, as held in the buffer's detach map. */
 
-} cell_t;
+#define CELL_ATTACHED 0u
+#define CELL_RESERVED 1u
+#define CELL_ACQUIRED 2u
 
 /**
-   The ptr_t structure holds the tail and array of heads pointers' which point into the buffer.
-   these are used to ensure buffer access is very fast. The head array size is
-   configured by the library user. */
+   Each API call brackets its critical region with ENTER_REGION() and EXIT_REGION(). These call the
+   user's PBUF_ENTER_CRITICAL() and PBUF_EXIT_CRITICAL() hooks, and with PBUF_EVENTFD they note the
+   buffer's readiness on entry and write its eventfds on exit for each transition made in between.
+   Each then expands to a single statement, so it is safe as the body of an unbraced if or else;
+   hooks that declare a variable for the other to use, as the PRIMASK example does, cannot be
+   combined with PBUF_EVENTFD. */
+
+#ifdef PBUF_EVENTFD
 
-typedef struct PTR_T
-{
-  /**
-     tail is a pointer to the buffer element to be read next.
-     This is the element having the highest priority in the buffer. */
+#  define ENTER_REGION(bf) do { PBUF_ENTER_CRITICAL(bf); markReadiness(bf); } while(0)
+#  define EXIT_REGION(bf) do { signalReadiness(bf); PBUF_EXIT_CRITICAL(bf); } while(0)
 
-  index_t tail;
+#  define READY_NOT_EMPTY 1u
+#  define READY_NOT_FULL 2u
 
-  /**
-     head is an array of pointers to the respective heads of the priorities on the buffer.
-     These are required to know where to insert future prioritised data. */
+#else
 
-  index_t head[PRIORITY_SIZE];
+#  define ENTER_REGION(bf) PBUF_ENTER_CRITICAL(bf)
+#  define EXIT_REGION(bf) PBUF_EXIT_CRITICAL(bf)
 
-} ptr_t;
+#endif  /* PBUF_EVENTFD */
 
 /**
-   The pbuf_t structure holds the relevant data required for operating a single buffer.
-   Its size is determined at compile time and depends upon the configuration applied.
-   There is a single 8-bit tail, an 8-bit head for each priority, and an 8-bit activity
-   byte for storing an activity flag per priority. In addition there is the buffer itself,
-   each cell containing an element of data storage and an 8-bit pointer to the following
-   cell. */
+   With PBUF_STATISTICS, STAT() counts an event in the statistics of the buffer passed in.
+   Otherwise it compiles to nothing. */
 
-typedef struct PBUF_T {
+#ifdef PBUF_STATISTICS
 
-  /**
-     Tail and Head pointers */
+#  define STAT(bf, counter, priority) ((bf)->stats.counter[priority]++)
 
-  ptr_t ptr;
+#else
 
-  /**
-     Array of buffer composite elements */
+#  define STAT(bf, counter, priority) ((void) 0)
 
-  cell_t element[BUFFER_SIZE];
+#endif  /* PBUF_STATISTICS */
 
-  /**
-     Storage for activity statuses of priorities in use.
-     Activity status may be ACTIVE or INACTIVE. */
+/**
+   The highest priority in the system. */
 
-  activity_t activity;
+#define HIGH_PRI PRIORITY_SIZE - 1u
 
-} pbuf_t;
+/**
+   The lowest priority in the system. */
+
+#define LOW_PRI 0u
 
 enum {
   INVALID_INDEX,
@@ -138,6 +156,8 @@ enum {
   VALID_REMAP,
   INVALID_DATA,
   VALID_DATA,
+  DROP_INSERT,
+  REJECT_INSERT,
 };
 
 #define VALID_RETRIEVE 0u
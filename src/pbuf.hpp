@@ -0,0 +1,496 @@
+#ifndef PBUF_HPP
+#define PBUF_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+/**
+   Header-only C++17 version of the *PBuf* engine.
+
+   pbuf::PBuf<T, Capacity, Priorities> holds Capacity elements of any copyable or movable type T,
+   prioritised into Priorities levels, with the same behaviour as the C build: elements are
+   retrieved highest priority first and oldest first within a priority, and when the buffer is
+   full the oldest element of the lowest priority is overwritten unless that priority is higher
+   than the new element's.
+
+   The configuration is a set of template arguments rather than macros, so the link, count and
+   activity types are chosen at compile time for each instance type and the whole insert and
+   retrieve path can be inlined and constant folded. */
+
+namespace pbuf
+{
+  namespace detail
+  {
+    /**
+       Smallest unsigned type holding the values 0 to N - 1. */
+
+    template <std::uint64_t N>
+    using index_for = std::conditional_t<(N <= 256u), std::uint8_t,
+                                         std::conditional_t<(N <= 65536u), std::uint16_t, std::uint32_t>>;
+
+    /**
+       Smallest unsigned type holding the values 0 to N. */
+
+    template <std::uint64_t N>
+    using count_for = index_for<N + 1u>;
+
+    /**
+       Smallest unsigned word holding N activity flags, up to 64. */
+
+    template <std::size_t N>
+    using word_for = std::conditional_t<(N <= 8u), std::uint8_t,
+                                        std::conditional_t<(N <= 16u), std::uint16_t,
+                                                           std::conditional_t<(N <= 32u), std::uint32_t, std::uint64_t>>>;
+
+    /**
+       Return the position of the lowest set bit of the word passed in, which must not be zero.
+       \return bit position */
+
+    template <typename W>
+    constexpr unsigned lowestBit(W word)
+    {
+#if defined(__GNUC__) && ! defined(PBUF_NO_BUILTINS)
+      if constexpr (sizeof(W) <= sizeof(unsigned))
+        {
+          return static_cast<unsigned>(__builtin_ctz(word));
+        }
+      else
+        {
+          return static_cast<unsigned>(__builtin_ctzll(word));
+        }
+#else
+      unsigned bit = 0;
+
+      while( ! (word & 1u))
+        {
+          word = static_cast<W>(word >> 1);
+          bit++;
+        }
+
+      return bit;
+#endif
+    }
+
+    /**
+       Return the position of the highest set bit of the word passed in, which must not be zero.
+       \return bit position */
+
+    template <typename W>
+    constexpr unsigned highestBit(W word)
+    {
+#if defined(__GNUC__) && ! defined(PBUF_NO_BUILTINS)
+      if constexpr (sizeof(W) <= sizeof(unsigned))
+        {
+          return static_cast<unsigned>((sizeof(unsigned) * 8u) - 1u - __builtin_clz(word));
+        }
+      else
+        {
+          return static_cast<unsigned>(63 - __builtin_clzll(word));
+        }
+#else
+      unsigned bit = 0;
+
+      while(word >>= 1)
+        {
+          bit++;
+        }
+
+      return bit;
+#endif
+    }
+  }
+
+  template <typename T, std::size_t Capacity, std::size_t Priorities>
+  class PBuf
+  {
+    static_assert((Capacity >= 3u) && (Capacity <= 4294967295u), "Capacity should be a value from 3 to 4294967295");
+    static_assert((Priorities >= 2u) && (Priorities <= 256u), "Priorities should be a value from 2 to 256");
+
+    /**
+       Up to 64 priorities the activity flags fit a single word of 8, 16, 32 or 64 bits. Beyond
+       that they are held in 64-bit leaves with a summary word holding one bit per non-empty leaf. */
+
+    static constexpr std::size_t activityBits = (Priorities <= 64u) ? Priorities : 64u;
+    static constexpr std::size_t activityLeaves = (Priorities + 63u) / 64u;
+
+  public:
+
+    using element_type = T;
+    using index_type = detail::index_for<Capacity>;
+    using count_type = detail::count_for<Capacity>;
+    using priority_type = std::uint8_t;
+    using activity_type = detail::word_for<activityBits>;
+
+    /**
+       Construct an empty buffer. */
+
+    PBuf()
+    {
+      reset();
+    }
+
+    /**
+       Empty the buffer. */
+
+    void reset()
+    {
+      std::size_t count;
+
+      for(count = 0; count < Capacity; count++)
+        {
+          element[count].next = static_cast<index_type>((count + 1u) % Capacity);
+        }
+
+      tail = static_cast<index_type>(Capacity - 1u);
+      head.fill(tail);
+      activity.fill(0u);
+      summary = 0u;
+      elementCount = 0u;
+      priorityCount.fill(0u);
+    }
+
+    /**
+       \return true if the buffer is empty */
+
+    bool empty() const
+    {
+      if constexpr (activityLeaves == 1u)
+        {
+          return ! activity[0];
+        }
+      else
+        {
+          return ! summary;
+        }
+    }
+
+    /**
+       \return true if the buffer is full */
+
+    bool full() const
+    {
+      return elementCount == Capacity;
+    }
+
+    /**
+       \return number of cells in the buffer */
+
+    static constexpr std::size_t capacity()
+    {
+      return Capacity;
+    }
+
+    /**
+       \return number of priorities */
+
+    static constexpr std::size_t priorities()
+    {
+      return Priorities;
+    }
+
+    /**
+       \return number of elements held in the buffer */
+
+    std::size_t count() const
+    {
+      return elementCount;
+    }
+
+    /**
+       \return number of elements held at the priority passed in, or zero for an invalid priority */
+
+    std::size_t count(priority_type priority) const
+    {
+      return (priority < Priorities) ? priorityCount[priority] : 0u;
+    }
+
+    /**
+       Insert an element of the priority passed in. If the buffer is full, the oldest element
+       of the lowest priority is overwritten, as long as its priority is no higher.
+       \return true for a valid insert */
+
+    bool insert(T value, priority_type priority)
+    {
+      bool returnVal = false;
+      priority_type lowestPri;
+      index_type index;
+      index_type insertPt;
+      index_type bridgePt;
+
+      if((priority < Priorities) &&
+         ( ! full() || ((lowestPriority() <= priority) && removeOldest(lowestPriority()))))
+        {
+          if(empty())
+            {
+              index = element[tail].next;
+              head[priority] = index;
+            }
+          else
+            {
+              lowestPri = lowestPriority();
+              bridgePt = head[lowestPri];
+              index = element[bridgePt].next;
+
+              if(priority > lowestPri)
+                {
+                  // link the first free cell in after the newest element of the same or next highest priority
+                  insertPt = insertPoint(priority);
+                  head[priority] = index;
+                  remap(insertPt, bridgePt, index);
+                  if(tail == index)
+                    {
+                      tail = bridgePt;
+                    }
+                }
+              else
+                {
+                  head[priority] = index;
+                }
+            }
+
+          setActive(priority);
+          element[index].data = std::move(value);
+          elementCount++;
+          priorityCount[priority]++;
+          returnVal = true;
+        }
+
+      return returnVal;
+    }
+
+    /**
+       Retrieve the oldest element of the highest priority.
+       \return true on successful retrieve */
+
+    bool retrieve(T & value)
+    {
+      bool returnVal = false;
+      priority_type priority;
+      index_type index;
+
+      if( ! empty())
+        {
+          priority = highestPriority();
+          index = element[tail].next;
+          if(head[priority] == index)
+            {
+              setInactive(priority);
+            }
+
+          tail = index;
+          value = std::move(element[index].data);
+          elementCount--;
+          priorityCount[priority]--;
+          returnVal = true;
+        }
+
+      return returnVal;
+    }
+
+  private:
+
+    /**
+       A buffer cell - an element and a link to the next cell. */
+
+    struct Cell
+    {
+      T data;
+      index_type next;
+    };
+
+    /**
+       \return the lowest active priority, the buffer must not be empty */
+
+    priority_type lowestPriority() const
+    {
+      if constexpr (activityLeaves == 1u)
+        {
+          return static_cast<priority_type>(detail::lowestBit(activity[0]));
+        }
+      else
+        {
+          unsigned leaf = detail::lowestBit(summary);
+
+          return static_cast<priority_type>((leaf * 64u) + detail::lowestBit(activity[leaf]));
+        }
+    }
+
+    /**
+       \return the highest active priority, the buffer must not be empty */
+
+    priority_type highestPriority() const
+    {
+      if constexpr (activityLeaves == 1u)
+        {
+          return static_cast<priority_type>(detail::highestBit(activity[0]));
+        }
+      else
+        {
+          unsigned leaf = detail::highestBit(summary);
+
+          return static_cast<priority_type>((leaf * 64u) + detail::highestBit(activity[leaf]));
+        }
+    }
+
+    /**
+       Find the lowest active priority above the priority passed in.
+       \return true if there is one */
+
+    bool nextHighestPriority(priority_type & nextPriority, priority_type priority) const
+    {
+      bool returnVal = false;
+      std::size_t above = static_cast<std::size_t>(priority) + 1u;
+      std::size_t leaf = above / 64u;
+      activity_type word;
+      std::uint8_t higherLeaves;
+
+      if(above < Priorities)
+        {
+          word = static_cast<activity_type>(activity[leaf] >> (above % 64u));
+          if(word)
+            {
+              nextPriority = static_cast<priority_type>(above + detail::lowestBit(word));
+              returnVal = true;
+            }
+          else if constexpr (activityLeaves > 1u)
+            {
+              higherLeaves = static_cast<std::uint8_t>(summary >> (leaf + 1u));
+              if(higherLeaves)
+                {
+                  leaf += 1u + detail::lowestBit(higherLeaves);
+                  nextPriority = static_cast<priority_type>((leaf * 64u) + detail::lowestBit(activity[leaf]));
+                  returnVal = true;
+                }
+            }
+        }
+
+      return returnVal;
+    }
+
+    bool activeStatus(priority_type priority) const
+    {
+      return (activity[priority / 64u] >> (priority % 64u)) & 1u;
+    }
+
+    void setActive(priority_type priority)
+    {
+      activity[priority / 64u] = static_cast<activity_type>(activity[priority / 64u] | (activity_type{1} << (priority % 64u)));
+      if constexpr (activityLeaves > 1u)
+        {
+          summary = static_cast<std::uint8_t>(summary | (1u << (priority / 64u)));
+        }
+    }
+
+    void setInactive(priority_type priority)
+    {
+      activity[priority / 64u] = static_cast<activity_type>(activity[priority / 64u] & ~(activity_type{1} << (priority % 64u)));
+      if constexpr (activityLeaves > 1u)
+        {
+          if( ! activity[priority / 64u])
+            {
+              summary = static_cast<std::uint8_t>(summary & ~(1u << (priority / 64u)));
+            }
+        }
+    }
+
+    /**
+       A new element follows the newest element of its own priority, or of the next highest
+       active priority, or the tail when no equal or higher priority is active.
+       \return insert point index */
+
+    index_type insertPoint(priority_type priority) const
+    {
+      index_type returnVal = tail;
+      priority_type nextPri;
+
+      if(activeStatus(priority))
+        {
+          returnVal = head[priority];
+        }
+      else if(nextHighestPriority(nextPri, priority))
+        {
+          returnVal = head[nextPri];
+        }
+
+      return returnVal;
+    }
+
+    /**
+       Move cell b from after a2 to after a1. */
+
+    void remap(index_type a1, index_type a2, index_type b)
+    {
+      index_type a1ptr = element[a1].next;
+
+      if(a1ptr != b)
+        {
+          element[a1].next = b;
+          element[a2].next = element[b].next;
+          element[b].next = a1ptr;
+        }
+    }
+
+    /**
+       Remove the oldest element of the priority passed in, wherever it lies in the buffer. The
+       oldest of the highest priority is read as normal; any other element is remapped to the
+       first free cell after the lowest priority head, and becomes the tail if the buffer was full.
+       \return true if an element was removed */
+
+    bool removeOldest(priority_type priority)
+    {
+      bool returnVal = false;
+      bool wasFull = full();
+      index_type before = tail;
+      index_type index;
+      priority_type lowestPri;
+      priority_type nextPri;
+
+      if(activeStatus(priority))
+        {
+          lowestPri = lowestPriority();
+          if(nextHighestPriority(nextPri, priority))
+            {
+              before = head[nextPri];
+            }
+
+          index = element[before].next;
+          if(head[priority] == index)
+            {
+              setInactive(priority);
+            }
+
+          if(before == tail)
+            {
+              tail = index;
+            }
+          else if((priority != lowestPri) || activeStatus(priority))
+            {
+              remap(head[lowestPri], before, index);
+              if(wasFull)
+                {
+                  tail = index;
+                }
+            }
+
+          elementCount--;
+          priorityCount[priority]--;
+          returnVal = true;
+        }
+
+      return returnVal;
+    }
+
+    std::array<Cell, Capacity> element;
+    index_type tail;
+    std::array<index_type, Priorities> head;
+    std::array<activity_type, activityLeaves> activity;
+    std::uint8_t summary;
+    count_type elementCount;
+    std::array<count_type, Priorities> priorityCount;
+  };
+}
+
+#endif  /* PBUF_HPP */
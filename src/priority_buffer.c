@@ -1,61 +1,215 @@
+#if (defined(PBUF_WAIT) || defined(PBUF_EVENTFD)) && ! defined(_POSIX_C_SOURCE)
+#  define _POSIX_C_SOURCE 200112L
+#endif  /* (PBUF_WAIT || PBUF_EVENTFD) && ! _POSIX_C_SOURCE */
+
 #include <inttypes.h>
+#include <string.h>
 #include "priority_buffer.h"
 #include "defs.h"
 
 //////////////////////////////// index ////////////////////////////////
 
-STATIC check_t checkIndex(index_t index);
-STATIC check_t nextIndex(index_t * nextIdx, index_t currentIdx);
-STATIC check_t writeNextIndex(index_t currentIdx, index_t nextIdx);
-STATIC check_t firstFreeElementIndex(index_t * index);
-STATIC index_t headIndex(priority_t priority);
-STATIC index_t nextHeadIndex(priority_t priority);
-STATIC check_t writeHead(index_t index, priority_t priority);
-STATIC index_t tailIndex(void);
-STATIC check_t nextTailIndex(index_t * index);
-STATIC check_t incTail(void);
-STATIC index_t writeTail(index_t index);
-STATIC index_t lowestPriorityTail(void);
-STATIC check_t remap(index_t a1, index_t a2, index_t b);
-STATIC check_t remapNotFull(index_t newIndex, priority_t priority);
-STATIC index_t insertPointFull(priority_t priority);
-STATIC index_t insertPointNotFull(priority_t priority);
-STATIC index_t bridgePointFull(void);
-STATIC index_t bridgePointNotFull(void);
-STATIC check_t writeElementIndex(index_t * index, priority_t priority);
-STATIC check_t overwriteElementIndex(index_t * index, priority_t priority);
-STATIC check_t insertIndex(index_t * index, priority_t priority);
-STATIC check_t insertEmptyIndex(index_t * index, priority_t priority);
-STATIC check_t insertNotFullIndex(index_t * index, priority_t priority);
-STATIC check_t insertFullIndex(index_t * index, priority_t priority);
+STATIC check_t checkIndex(pbuf_t * bf, index_t index);
+STATIC check_t nextIndex(pbuf_t * bf, index_t * nextIdx, index_t currentIdx);
+STATIC check_t writeNextIndex(pbuf_t * bf, index_t currentIdx, index_t nextIdx);
+STATIC check_t firstFreeElementIndex(pbuf_t * bf, index_t * index);
+STATIC index_t headIndex(pbuf_t * bf, priority_t priority);
+STATIC index_t nextHeadIndex(pbuf_t * bf, priority_t priority);
+STATIC check_t writeHead(pbuf_t * bf, index_t index, priority_t priority);
+STATIC index_t tailIndex(pbuf_t * bf);
+STATIC check_t nextTailIndex(pbuf_t * bf, index_t * index);
+STATIC check_t incTail(pbuf_t * bf);
+STATIC index_t writeTail(pbuf_t * bf, index_t index);
+STATIC index_t lowestPriorityTail(pbuf_t * bf);
+STATIC check_t remap(pbuf_t * bf, index_t a1, index_t a2, index_t b);
+STATIC check_t remapNotFull(pbuf_t * bf, index_t newIndex, priority_t priority);
+STATIC index_t insertPointFull(pbuf_t * bf, priority_t priority);
+STATIC index_t insertPointNotFull(pbuf_t * bf, priority_t priority);
+STATIC index_t bridgePointFull(pbuf_t * bf);
+STATIC index_t bridgePointNotFull(pbuf_t * bf);
+STATIC check_t writeElementIndex(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t overwriteElementIndex(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t insertIndex(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t insertEmptyIndex(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t insertNotFullIndex(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t insertFullIndex(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t unlinkOldestIndex(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t removeOldestIndex(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC index_t runBefore(pbuf_t * bf, priority_t priority);
+
+//////////////////////////////// overflow ////////////////////////////////
+
+STATIC check_t overflowOverwrite(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t overflowDrop(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t overflowReject(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t overflowEvict(pbuf_t * bf, index_t * index, priority_t priority);
+STATIC check_t overflowLimit(pbuf_t * bf, priority_t priority, priority_t * limit);
+STATIC int insertStatus(check_t result);
 
 //////////////////////////////// priority ////////////////////////////////
 
-STATIC check_t validatePriority(priority_t priority);
-STATIC check_t lowestPriority(priority_t * priority);
-STATIC check_t highestPriority(priority_t * priority);
-STATIC check_t nextHighestPriority(priority_t * nextPriority, priority_t priority);
-STATIC check_t activeStatus(priority_t priority);
-STATIC check_t setActive(priority_t priority);
-STATIC check_t setInactive(priority_t priority);
-STATIC check_t adjustPriority(void);
-STATIC uint8_t activePriorityCount(void);
+STATIC check_t validatePriority(pbuf_t * bf, priority_t priority);
+STATIC check_t lowestPriority(pbuf_t * bf, priority_t * priority);
+STATIC check_t highestPriority(pbuf_t * bf, priority_t * priority);
+STATIC check_t nextHighestPriority(pbuf_t * bf, priority_t * nextPriority, priority_t priority);
+
+#if ! defined(EXTERNAL_DATA_BUFFER) || defined(PBUF_AGING) || defined(PBUF_SCHEDULER)
+
+STATIC check_t nextLowerPriority(pbuf_t * bf, priority_t * nextPriority, priority_t priority);
+
+#endif  /* ! EXTERNAL_DATA_BUFFER || PBUF_AGING || PBUF_SCHEDULER */
+
+STATIC check_t activeStatus(pbuf_t * bf, priority_t priority);
+STATIC check_t setActive(pbuf_t * bf, priority_t priority);
+STATIC check_t setInactive(pbuf_t * bf, priority_t priority);
+STATIC check_t adjustPriority(pbuf_t * bf, priority_t * priority);
+STATIC uint8_t activePriorityCount(pbuf_t * bf);
+STATIC priority_t lowestBit(activity_word_t word);
+STATIC priority_t highestBit(activity_word_t word);
+STATIC uint8_t bitCount(activity_word_t word);
 
 //////////////////////////////// element ////////////////////////////////
 
-STATIC check_t readData(element_t * element, index_t index);
-STATIC check_t writeData(element_t element, index_t index);
-STATIC check_t insert(element_t element, priority_t priority);
+STATIC check_t readData(pbuf_t * bf, element_t * element, index_t index);
+STATIC check_t writeData(pbuf_t * bf, element_t element, index_t index);
+STATIC check_t insert(pbuf_t * bf, element_t element, priority_t priority);
+
+#ifndef EXTERNAL_DATA_BUFFER
 
-STATIC check_t resetBufferPointers(void);
-STATIC check_t resetBuffer(void);
-STATIC check_t bufferFull(void);
-STATIC check_t bufferEmpty(void);
+STATIC check_t insertRun(pbuf_t * bf, const element_t * elements, count_t cells, priority_t priority);
+STATIC size_t readRuns(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max);
+STATIC size_t peekRuns(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max);
+STATIC void * slotData(pbuf_t * bf, index_t index);
+STATIC check_t slotIndex(pbuf_t * bf, const void * slot, index_t * index);
+STATIC check_t detachFree(pbuf_t * bf, index_t * index);
+STATIC check_t detachFirst(pbuf_t * bf, index_t * index, priority_t * priority);
+STATIC void attachFree(pbuf_t * bf, index_t index);
+STATIC uint8_t detachState(pbuf_t * bf, index_t index);
+STATIC void writeDetachState(pbuf_t * bf, index_t index, uint8_t state);
 
-/**
-   Array of buffer composite elements */
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+
+STATIC check_t resetBufferPointers(pbuf_t * bf);
+STATIC check_t resetBuffer(pbuf_t * bf);
+STATIC void countInsert(pbuf_t * bf, priority_t priority);
+STATIC void countRemove(pbuf_t * bf, priority_t priority);
+STATIC check_t bufferFull(pbuf_t * bf);
+STATIC check_t bufferEmpty(pbuf_t * bf);
+
+#ifdef PBUF_RUNTIME_SIZE
+
+STATIC size_t alignedBytes(size_t bytes);
+STATIC int validConfiguration(size_t capacity, size_t priorities, size_t element_size);
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
+//////////////////////////////// payload ////////////////////////////////
+
+#ifdef PAYLOAD_BUFFER
+
+STATIC void resetPayload(pbuf_t * bf);
+STATIC uint32_t payloadChunks(size_t length);
+STATIC check_t payloadRoom(pbuf_t * bf, uint32_t chunks, priority_t priority);
+STATIC check_t writePayload(pbuf_t * bf, index_t index, const uint8_t * payload, payload_size_t length, priority_t priority);
+STATIC void readPayload(pbuf_t * bf, index_t index, uint8_t * payload);
+STATIC void releasePayload(pbuf_t * bf, index_t index, priority_t priority);
+
+#endif  /* PAYLOAD_BUFFER */
+
+//////////////////////////////// staging ////////////////////////////////
+
+#ifdef PBUF_STAGED
+
+STATIC void resetStage(pbuf_t * bf);
+STATIC check_t stageInsert(pbuf_t * bf, element_t element, priority_t priority);
+STATIC void drainStage(pbuf_t * bf);
+
+#endif  /* PBUF_STAGED */
+
+#ifdef PBUF_MPSC
+
+STATIC void drainLane(pbuf_t * bf, priority_t priority);
+
+#endif  /* PBUF_MPSC */
+
+//////////////////////////////// waiting ////////////////////////////////
+
+#ifdef PBUF_WAIT
+
+#include <time.h>
+
+STATIC check_t resetWait(pbuf_t * bf);
+STATIC void wakeWaiters(pbuf_t * bf, priority_t priority);
+STATIC check_t readyFor(pbuf_t * bf, priority_t priority);
+STATIC void waitDeadline(struct timespec * deadline, uint64_t timeout_ns);
+
+#endif  /* PBUF_WAIT */
+
+//////////////////////////////// aging ////////////////////////////////
+
+#ifdef PBUF_AGING
+
+STATIC void ageRuns(pbuf_t * bf);
+STATIC void promoteRun(pbuf_t * bf, priority_t priority);
+STATIC void served(pbuf_t * bf, priority_t priority);
 
-STATIC pbuf_t bf;
+#endif  /* PBUF_AGING */
+
+//////////////////////////////// scheduling ////////////////////////////////
+
+#if defined(PBUF_SCHEDULER) || defined(PBUF_WAIT) || defined(PAYLOAD_BUFFER)
+
+STATIC check_t servedPriority(pbuf_t * bf, priority_t * priority);
+
+#endif  /* PBUF_SCHEDULER || PBUF_WAIT || PAYLOAD_BUFFER */
+
+#if (defined(PBUF_SCHEDULER) && ! defined(EXTERNAL_DATA_BUFFER)) || defined(PAYLOAD_BUFFER)
+
+STATIC check_t firstIndex(pbuf_t * bf, index_t * index, priority_t * priority);
+
+#endif  /* (PBUF_SCHEDULER && ! EXTERNAL_DATA_BUFFER) || PAYLOAD_BUFFER */
+
+#ifdef PBUF_SCHEDULER
+
+STATIC check_t readServedIndex(pbuf_t * bf, index_t * index, priority_t * priority);
+STATIC priority_t followingTurn(pbuf_t * bf, priority_t priority);
+STATIC priority_t nextTurn(pbuf_t * bf, priority_t priority);
+STATIC void charge(pbuf_t * bf, priority_t priority, index_t index);
+
+#ifndef EXTERNAL_DATA_BUFFER
+
+STATIC size_t readServed(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max);
+STATIC size_t peekServed(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max);
+STATIC check_t detachServed(pbuf_t * bf, index_t * index, priority_t * priority);
+
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+
+#endif  /* PBUF_SCHEDULER */
+
+//////////////////////////////// events ////////////////////////////////
+
+#ifdef PBUF_EVENTFD
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+STATIC check_t openFds(pbuf_t * bf);
+STATIC uint8_t readiness(pbuf_t * bf);
+STATIC void markReadiness(pbuf_t * bf);
+STATIC void signalReadiness(pbuf_t * bf);
+
+#endif  /* PBUF_EVENTFD */
+
+//////////////////////////////// shards ////////////////////////////////
+
+#ifdef PBUF_SHARDS
+
+STATIC void lockShard(pbuf_shard_t * shard);
+STATIC void unlockShard(pbuf_shard_t * shard);
+STATIC void publishShard(pbuf_sharded_t * sb, uint32_t shard);
+STATIC uint32_t chooseShard(pbuf_sharded_t * sb, uint32_t shard);
+
+#endif  /* PBUF_SHARDS */
 
 //////////////////////////////// index ////////////////////////////////
 
@@ -68,11 +222,12 @@ STATIC pbuf_t bf;
    Check the index is a valid Index
    \return VALID_INDEX or INVALID_INDEX */
 
-STATIC check_t checkIndex(index_t index)
+STATIC check_t checkIndex(pbuf_t * bf, index_t index)
 {
   check_t returnVal = INVALID_INDEX;
 
-  if(index < BUFFER_SIZE)
+  (void) bf;
+  if(index < CAPACITY(bf))
     {
       returnVal = VALID_INDEX;
     }
@@ -84,13 +239,13 @@ STATIC check_t checkIndex(index_t index)
    Advance the tail to its next position in the buffer
    \return VALID_INDEX or INVALID_INDEX */
 
-STATIC check_t incTail(void)
+STATIC check_t incTail(pbuf_t * bf)
 {
   check_t returnVal = INVALID_INDEX;
   index_t index;
 
-  if((nextTailIndex(&index) == VALID_INDEX) &&
-     (writeTail(index) == VALID_INDEX))
+  if((nextTailIndex(bf, &index) == VALID_INDEX) &&
+     (writeTail(bf, index) == VALID_INDEX))
     {
       returnVal = VALID_INDEX;
     }
@@ -102,9 +257,9 @@ STATIC check_t incTail(void)
    Returns the index value referenced by the tail
    \return tail index */
 
-STATIC index_t tailIndex(void)
+STATIC index_t tailIndex(pbuf_t * bf)
 {
-  return bf.ptr.tail;
+  return bf->ptr.tail;
 }
 
 /**
@@ -112,13 +267,13 @@ STATIC index_t tailIndex(void)
    \return VALID_INDEX or INVALID_INDEX */
 
 
-STATIC index_t writeTail(index_t index)
+STATIC index_t writeTail(pbuf_t * bf, index_t index)
 {
   check_t returnVal = INVALID_INDEX;
 
-  if(checkIndex(index) == VALID_INDEX)
+  if(checkIndex(bf, index) == VALID_INDEX)
     {
-      bf.ptr.tail = index;
+      bf->ptr.tail = index;
       returnVal = VALID_INDEX;
     }
 
@@ -131,13 +286,13 @@ STATIC index_t writeTail(index_t index)
    validity.
    \return VALID_INDEX or INVALID_INDEX */
 
-STATIC check_t nextTailIndex(index_t * index)
+STATIC check_t nextTailIndex(pbuf_t * bf, index_t * index)
 {
   check_t returnVal = INVALID_INDEX;
 
     {
-      *index = bf.element[tailIndex()].next;
-      if(checkIndex(*index) == VALID_INDEX)
+      *index = LINK(bf, tailIndex(bf));
+      if(checkIndex(bf, *index) == VALID_INDEX)
         {
           returnVal = VALID_INDEX;
         }
@@ -151,13 +306,13 @@ STATIC check_t nextTailIndex(index_t * index)
    from the current index passed in. Returns index validity.
    \return VALID_INDEX or INVALID_INDEX */
 
-STATIC check_t nextIndex(index_t * nextIdx, index_t currentIdx)
+STATIC check_t nextIndex(pbuf_t * bf, index_t * nextIdx, index_t currentIdx)
 {
   check_t returnVal = INVALID_INDEX;
 
-  if(checkIndex(currentIdx) == VALID_INDEX)
+  if(checkIndex(bf, currentIdx) == VALID_INDEX)
     {
-      *nextIdx = bf.element[currentIdx].next;
+      *nextIdx = LINK(bf, currentIdx);
       returnVal = VALID_INDEX;
     }
 
@@ -169,14 +324,14 @@ STATIC check_t nextIndex(index_t * nextIdx, index_t currentIdx)
    the current index passed in.
    \return VALID_INDEX or INVALID_INDEX */
 
-STATIC check_t writeNextIndex(index_t currentIdx, index_t nextIdx)
+STATIC check_t writeNextIndex(pbuf_t * bf, index_t currentIdx, index_t nextIdx)
 {
   check_t returnVal = INVALID_INDEX;
 
-  if((checkIndex(currentIdx) == VALID_INDEX) &&
-     (checkIndex(nextIdx) == VALID_INDEX))
+  if((checkIndex(bf, currentIdx) == VALID_INDEX) &&
+     (checkIndex(bf, nextIdx) == VALID_INDEX))
     {
-      bf.element[currentIdx].next = nextIdx;
+      LINK(bf, currentIdx) = nextIdx;
       returnVal = VALID_INDEX;
     }
 
@@ -189,22 +344,22 @@ STATIC check_t writeNextIndex(index_t currentIdx, index_t nextIdx)
    Check for buffer empty case first since this is a very fast test.
    \return VALID_INDEX or INVALID_INDEX */
 
-STATIC check_t firstFreeElementIndex(index_t * index)
+STATIC check_t firstFreeElementIndex(pbuf_t * bf, index_t * index)
 {
   check_t returnVal = INVALID_INDEX;
   priority_t priority;
 
-  if((bufferEmpty() == BUFFER_EMPTY) &&
-     (nextTailIndex(index) == VALID_INDEX))
+  if((bufferEmpty(bf) == BUFFER_EMPTY) &&
+     (nextTailIndex(bf, index) == VALID_INDEX))
     {
       returnVal = VALID_INDEX;
     }
-  else if(bufferFull() == BUFFER_NOT_FULL)
+  else if(bufferFull(bf) == BUFFER_NOT_FULL)
     // buffer not empty - look for lowest active priority pointer
     {
-      if(lowestPriority(&priority) == VALID_PRIORITY)
+      if(lowestPriority(bf, &priority) == VALID_PRIORITY)
         {
-          *index = nextHeadIndex(priority);
+          *index = nextHeadIndex(bf, priority);
           returnVal = VALID_INDEX;
         }
     }
@@ -218,9 +373,9 @@ STATIC check_t firstFreeElementIndex(index_t * index)
    Return the index pointed to by the head related with the priority passed in.
    \return the index referenced by the relevant priority head */
 
-STATIC index_t headIndex(priority_t priority)
+STATIC index_t headIndex(pbuf_t * bf, priority_t priority)
 {
-  return bf.ptr.head[priority];
+  return bf->ptr.head[priority];
 }
 
 /**
@@ -228,9 +383,9 @@ STATIC index_t headIndex(priority_t priority)
    after following the head link.
    \return the index linked to by the relevant priority head */
 
-STATIC index_t nextHeadIndex(priority_t priority)
+STATIC index_t nextHeadIndex(pbuf_t * bf, priority_t priority)
 {
-  return (bf.element[headIndex(priority)].next);
+  return (LINK(bf, headIndex(bf, priority)));
 }
 
 /**
@@ -238,14 +393,14 @@ STATIC index_t nextHeadIndex(priority_t priority)
    in with the index passed in.
    \return VALID_WRITE or INVALID_WRITE */
 
-STATIC check_t writeHead(index_t index, priority_t priority)
+STATIC check_t writeHead(pbuf_t * bf, index_t index, priority_t priority)
 {
   check_t returnVal = INVALID_WRITE;
 
-  if((validatePriority(priority) == VALID_PRIORITY) &&
-     (checkIndex(index) == VALID_INDEX))
+  if((validatePriority(bf, priority) == VALID_PRIORITY) &&
+     (checkIndex(bf, index) == VALID_INDEX))
     {
-      bf.ptr.head[priority] = index;
+      bf->ptr.head[priority] = index;
       returnVal = VALID_WRITE;
     }
 
@@ -256,26 +411,31 @@ STATIC check_t writeHead(index_t index, priority_t priority)
    Determine the lowest priority in the buffer.
    \return VALID_PRIORITY or INVALID_PRIORITY */
 
-STATIC check_t lowestPriority(priority_t * priority)
+STATIC check_t lowestPriority(pbuf_t * bf, priority_t * priority)
 {
   check_t returnVal = INVALID_PRIORITY;
-  priority_t priCount = 0;
-  uint8_t mask = 0x01;
 
-  if(bufferEmpty() == BUFFER_NOT_EMPTY)
+#ifdef ACTIVITY_LEAVES
+
+  priority_t leaf;
+
+  if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
     {
-      for(priCount = LOW_PRI ;priCount < PRIORITY_SIZE ;priCount++)
-        {
-          if(bf.activity & mask)
-            {
-              *priority = priCount;
-              returnVal = VALID_PRIORITY;
-              break;
-            }
-          mask *= 2u;
-        }
+      leaf = lowestBit(bf->activity.summary);
+      *priority = (priority_t) ((leaf * ACTIVITY_BITS) + lowestBit(bf->activity.leaf[leaf]));
+      returnVal = VALID_PRIORITY;
+    }
+
+#else
+
+  if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
+    {
+      *priority = lowestBit(bf->activity);
+      returnVal = VALID_PRIORITY;
     }
 
+#endif  /* ACTIVITY_LEAVES */
+
   return returnVal;
 }
 
@@ -283,11 +443,12 @@ STATIC check_t lowestPriority(priority_t * priority)
    Check the priority is a valid one.
    \return VALID_PRIORITY or INVALID_PRIORITY */
 
-STATIC check_t validatePriority(priority_t priority)
+STATIC check_t validatePriority(pbuf_t * bf, priority_t priority)
 {
   check_t returnVal = INVALID_PRIORITY;
 
-  if(priority < PRIORITY_SIZE)
+  (void) bf;
+  if(priority < PRIORITIES(bf))
     {
       returnVal = VALID_PRIORITY;
     }
@@ -300,13 +461,18 @@ STATIC check_t validatePriority(priority_t priority)
    If the priority is active ACTIVE is returned.
    \return ACTIVE or INACTIVE */
 
-STATIC check_t activeStatus(priority_t priority)
+STATIC check_t activeStatus(pbuf_t * bf, priority_t priority)
 {
   check_t returnVal = INACTIVE;
 
-  if(validatePriority(priority) == VALID_PRIORITY)
+  if(validatePriority(bf, priority) == VALID_PRIORITY)
     {
-      if((bf.activity) & (1 << priority))
+#ifdef ACTIVITY_LEAVES
+      if(bf->activity.leaf[priority / ACTIVITY_BITS] &
+         ((activity_word_t) 1u << (priority % ACTIVITY_BITS)))
+#else
+      if(bf->activity & ((activity_word_t) 1u << priority))
+#endif  /* ACTIVITY_LEAVES */
         {
           returnVal = ACTIVE;
         }
@@ -320,13 +486,19 @@ STATIC check_t activeStatus(priority_t priority)
    \param[in] priority to set
    \return VALID_ACTIVE or INVALID_ACTIVE */
 
-STATIC check_t setActive(priority_t priority)
+STATIC check_t setActive(pbuf_t * bf, priority_t priority)
 {
   check_t returnVal = INVALID_ACTIVE;
 
-  if(validatePriority(priority) == VALID_PRIORITY)
+  if(validatePriority(bf, priority) == VALID_PRIORITY)
     {
-      bf.activity |= (1 << priority);
+#ifdef ACTIVITY_LEAVES
+      bf->activity.leaf[priority / ACTIVITY_BITS] |=
+        ((activity_word_t) 1u << (priority % ACTIVITY_BITS));
+      bf->activity.summary |= (uint8_t) (1u << (priority / ACTIVITY_BITS));
+#else
+      bf->activity |= ((activity_word_t) 1u << priority);
+#endif  /* ACTIVITY_LEAVES */
 
       return VALID_ACTIVE;
     }
@@ -339,13 +511,22 @@ STATIC check_t setActive(priority_t priority)
    \param[in] priority to reset
    \return VALID_ACTIVE or INVALID_ACTIVE */
 
-STATIC check_t setInactive(priority_t priority)
+STATIC check_t setInactive(pbuf_t * bf, priority_t priority)
 {
   check_t returnVal = INVALID_ACTIVE;
 
-  if(validatePriority(priority) == VALID_PRIORITY)
+  if(validatePriority(bf, priority) == VALID_PRIORITY)
     {
-      bf.activity &= (0xFFu ^ (1 << priority));
+#ifdef ACTIVITY_LEAVES
+      bf->activity.leaf[priority / ACTIVITY_BITS] &=
+        ~((activity_word_t) 1u << (priority % ACTIVITY_BITS));
+      if( ! bf->activity.leaf[priority / ACTIVITY_BITS])
+        {
+          bf->activity.summary &= (uint8_t) ~(1u << (priority / ACTIVITY_BITS));
+        }
+#else
+      bf->activity &= (activity_word_t) ~((activity_word_t) 1u << priority);
+#endif  /* ACTIVITY_LEAVES */
 
       return VALID_ACTIVE;
     }
@@ -358,42 +539,217 @@ STATIC check_t setInactive(priority_t priority)
    pointer passed in.
    \return VALID_PRIORITY or INVALID_PRIORITY */
 
-STATIC check_t highestPriority(priority_t * priority)
+STATIC check_t highestPriority(pbuf_t * bf, priority_t * priority)
 {
   check_t returnVal = INVALID_PRIORITY;
-  priority_t priCount;
-  uint8_t mask = 1 << (PRIORITY_SIZE - 1);
 
-  for(priCount = PRIORITY_SIZE ; priCount > 0; priCount--)
+#ifdef ACTIVITY_LEAVES
+
+  priority_t leaf;
+
+  if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
     {
-      if(bf.activity & mask)
-        {
-          *priority = priCount - 1;
-          returnVal = VALID_PRIORITY;
-          break;
-        }
+      leaf = highestBit(bf->activity.summary);
+      *priority = (priority_t) ((leaf * ACTIVITY_BITS) + highestBit(bf->activity.leaf[leaf]));
+      returnVal = VALID_PRIORITY;
+    }
+
+#else
+
+  if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
+    {
+      *priority = highestBit(bf->activity);
+      returnVal = VALID_PRIORITY;
+    }
+
+#endif  /* ACTIVITY_LEAVES */
+
+  return returnVal;
+}
+
+/**
+   Return the position of the lowest set bit of the word passed in, which must not be zero.
+   This is a single count trailing zeros instruction where the compiler provides one; otherwise
+   the word is halved a fixed number of times, so the cost does not depend on which bit is set.
+   \return bit position */
+
+STATIC priority_t lowestBit(activity_word_t word)
+{
+#ifdef PBUF_BUILTINS
+
+#  if ACTIVITY_BITS > 32
+  return (priority_t) __builtin_ctzll(word);
+#  else
+  return (priority_t) __builtin_ctz(word);
+#  endif
+
+#else
+
+  priority_t bit = 0;
+
+#if ACTIVITY_BITS > 32
+  if( ! (word & 0xFFFFFFFFu))
+    {
+      word >>= 32;
+      bit += 32u;
+    }
+#endif
+#if ACTIVITY_BITS > 16
+  if( ! (word & 0xFFFFu))
+    {
+      word >>= 16;
+      bit += 16u;
+    }
+#endif
+#if ACTIVITY_BITS > 8
+  if( ! (word & 0xFFu))
+    {
+      word >>= 8;
+      bit += 8u;
+    }
+#endif
+  if( ! (word & 0x0Fu))
+    {
+      word >>= 4;
+      bit += 4u;
+    }
+  if( ! (word & 0x03u))
+    {
+      word >>= 2;
+      bit += 2u;
+    }
+  if( ! (word & 0x01u))
+    {
+      bit += 1u;
+    }
+
+  return bit;
+
+#endif  /* PBUF_BUILTINS */
+}
+
+/**
+   Return the position of the highest set bit of the word passed in, which must not be zero.
+   \return bit position */
+
+STATIC priority_t highestBit(activity_word_t word)
+{
+#ifdef PBUF_BUILTINS
+
+#  if ACTIVITY_BITS > 32
+  return (priority_t) (63 - __builtin_clzll(word));
+#  else
+  return (priority_t) (31 - __builtin_clz(word));
+#  endif
+
+#else
+
+  priority_t bit = 0;
+
+#if ACTIVITY_BITS > 32
+  if(word >> 32)
+    {
+      word >>= 32;
+      bit += 32u;
+    }
+#endif
+#if ACTIVITY_BITS > 16
+  if(word >> 16)
+    {
+      word >>= 16;
+      bit += 16u;
+    }
+#endif
+#if ACTIVITY_BITS > 8
+  if(word >> 8)
+    {
+      word >>= 8;
+      bit += 8u;
+    }
+#endif
+  if(word >> 4)
+    {
+      word >>= 4;
+      bit += 4u;
+    }
+  if(word >> 2)
+    {
+      word >>= 2;
+      bit += 2u;
+    }
+  if(word >> 1)
+    {
+      bit += 1u;
+    }
+
+  return bit;
+
+#endif  /* PBUF_BUILTINS */
+}
+
+/**
+   Count the set bits of the word passed in.
+   \return number of set bits */
+
+STATIC uint8_t bitCount(activity_word_t word)
+{
+#ifdef PBUF_BUILTINS
+
+#  if ACTIVITY_BITS > 32
+  return (uint8_t) __builtin_popcountll(word);
+#  else
+  return (uint8_t) __builtin_popcount(word);
+#  endif
+
+#else
+
+  uint8_t returnVal = 0;
 
-      mask /= 2u;
+  while(word)
+    {
+      word &= (activity_word_t) (word - 1u);
+      returnVal++;
     }
 
   return returnVal;
+
+#endif  /* PBUF_BUILTINS */
 }
 
 /**
    Reset Heads and Tail
    \return VALID_RESET or INVALID_RESET */
 
-STATIC check_t resetBufferPointers(void)
+STATIC check_t resetBufferPointers(pbuf_t * bf)
 {
   check_t returnVal = VALID_RESET;
-  priority_t count;
+  uint16_t count;
+
+#ifdef ACTIVITY_LEAVES
+  bf->activity.summary = 0u;
+  for(count = 0; count < ACTIVITY_LEAVES; count++)
+    {
+      bf->activity.leaf[count] = 0u;
+    }
+#else
+  bf->activity = 0u;
+#endif  /* ACTIVITY_LEAVES */
+
+  bf->count = 0u;
+  bf->detached = 0u;
+#ifndef EXTERNAL_DATA_BUFFER
+  memset(bf->detachMap, 0, DETACH_MAP_WORDS(CAPACITY(bf)) * sizeof(uint32_t));
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+#ifdef PBUF_STAGED
+  resetStage(bf);
+#endif  /* PBUF_STAGED */
 
-  bf.activity = 0u;
-  if(writeTail(BUFFER_SIZE - 1) == VALID_INDEX)
+  if(writeTail(bf, (index_t) (CAPACITY(bf) - 1u)) == VALID_INDEX)
     {
-      for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
+      for(count = LOW_PRI; count < PRIORITIES(bf); count++)
         {
-          if(writeHead(BUFFER_SIZE - 1u, count) != VALID_WRITE)
+          bf->priorityCount[count] = 0u;
+          if(writeHead(bf, (index_t) (CAPACITY(bf) - 1u), (priority_t) count) != VALID_WRITE)
             {
               returnVal = INVALID_RESET;
               break;
@@ -408,44 +764,49 @@ STATIC check_t resetBufferPointers(void)
    Reset the Buffer
    \return VALID_RESET or INVALID_RESET */
 
-STATIC check_t resetBuffer(void)
+STATIC check_t resetBuffer(pbuf_t * bf)
 {
   check_t returnVal = VALID_RESET;
-  uint16_t count;
+  uint32_t count;
 
-  for(count = 0; count < BUFFER_SIZE; count++)
+  for(count = 0; count < CAPACITY(bf); count++)
     {
-      if( ! ((writeData(0u, count) == VALID_ELEMENT) &&
-             (writeNextIndex(count, (count + 1u) % BUFFER_SIZE) == VALID_INDEX)))
+      if( ! ((writeData(bf, 0u, (index_t) count) == VALID_ELEMENT) &&
+             (writeNextIndex(bf, (index_t) count, (index_t) ((count + 1u) % CAPACITY(bf))) == VALID_INDEX)))
         {
           returnVal = INVALID_RESET;
           break;
         }
     }
 
+#ifdef PAYLOAD_BUFFER
+  resetPayload(bf);
+#endif  /* PAYLOAD_BUFFER */
+
   return returnVal;
 }
 
-STATIC check_t writeElementIndex(index_t * index, priority_t priority)
+STATIC check_t writeElementIndex(pbuf_t * bf, index_t * index, priority_t priority)
 {
   check_t returnVal = INVALID_WRITE;
   priority_t lowestPri;
 
-  if(bufferFull() == BUFFER_NOT_FULL)
+  if(bufferFull(bf) == BUFFER_NOT_FULL)
     {
-      if(bufferEmpty() == BUFFER_EMPTY)
+      if(bufferEmpty(bf) == BUFFER_EMPTY)
         {
-          nextTailIndex(index);
+          nextTailIndex(bf, index);
         }
       else
         {
-          lowestPriority(&lowestPri);
-          nextIndex(index, headIndex(lowestPri));
+          lowestPriority(bf, &lowestPri);
+          nextIndex(bf, index, headIndex(bf, lowestPri));
         }
 
-      if((writeHead(*index, priority)) &&
-         (setActive(priority) == VALID_ACTIVE))
+      if((writeHead(bf, *index, priority)) &&
+         (setActive(bf, priority) == VALID_ACTIVE))
         {
+          countInsert(bf, priority);
           returnVal = VALID_WRITE;
         }
     }
@@ -460,103 +821,194 @@ STATIC check_t writeElementIndex(index_t * index, priority_t priority)
    where to store the new priority
    \return VALID_PRIORITY or INVALID_PRIORITY */
 
-check_t nextHighestPriority(priority_t * nextPriority, priority_t priority)
+STATIC check_t nextHighestPriority(pbuf_t * bf, priority_t * nextPriority, priority_t priority)
 {
   check_t returnVal = INVALID_PRIORITY;
-  priority_t priCount;
-  priority_t mask = 1u << (priority + 1);
+  uint16_t above = (uint16_t) priority + 1u;
 
-  for(priCount = priority + 1u; priCount < PRIORITY_SIZE; priCount++)
+#ifdef ACTIVITY_LEAVES
+
+  activity_word_t word;
+  uint8_t summary;
+  priority_t leaf;
+
+  if(above < PRIORITY_SIZE)
     {
-      if(bf.activity & mask)
+      leaf = (priority_t) (above / ACTIVITY_BITS);
+      word = bf->activity.leaf[leaf] >> (above % ACTIVITY_BITS);
+      if(word)
         {
-          *nextPriority = priCount;
+          *nextPriority = (priority_t) (above + lowestBit(word));
+          returnVal = VALID_PRIORITY;
+        }
+      else
+        {
+          summary = (uint8_t) (bf->activity.summary >> (leaf + 1u));
+          if(summary)
+            {
+              leaf = (priority_t) (leaf + 1u + lowestBit(summary));
+              *nextPriority = (priority_t) ((leaf * ACTIVITY_BITS) + lowestBit(bf->activity.leaf[leaf]));
+              returnVal = VALID_PRIORITY;
+            }
+        }
+    }
+
+#else
+
+  activity_word_t word;
+
+  if(above < PRIORITY_SIZE)
+    {
+      word = (activity_word_t) (bf->activity >> above);
+      if(word)
+        {
+          *nextPriority = (priority_t) (above + lowestBit(word));
+          returnVal = VALID_PRIORITY;
+        }
+    }
+
+#endif  /* ACTIVITY_LEAVES */
+
+  return returnVal;
+}
+
+#if ! defined(EXTERNAL_DATA_BUFFER) || defined(PBUF_AGING) || defined(PBUF_SCHEDULER)
+
+/**
+   Find the highest active priority below the priority passed in - the priority of the run
+   that follows its run in the buffer.
+   \return VALID_PRIORITY or INVALID_PRIORITY */
+
+STATIC check_t nextLowerPriority(pbuf_t * bf, priority_t * nextPriority, priority_t priority)
+{
+  check_t returnVal = INVALID_PRIORITY;
+
+#ifdef ACTIVITY_LEAVES
+
+  activity_word_t word;
+  uint8_t summary;
+  priority_t leaf = (priority_t) (priority / ACTIVITY_BITS);
+
+  word = bf->activity.leaf[leaf] & (((activity_word_t) 1u << (priority % ACTIVITY_BITS)) - 1u);
+  if(word)
+    {
+      *nextPriority = (priority_t) ((leaf * ACTIVITY_BITS) + highestBit(word));
+      returnVal = VALID_PRIORITY;
+    }
+  else
+    {
+      summary = (uint8_t) (bf->activity.summary & ((1u << leaf) - 1u));
+      if(summary)
+        {
+          leaf = highestBit(summary);
+          *nextPriority = (priority_t) ((leaf * ACTIVITY_BITS) + highestBit(bf->activity.leaf[leaf]));
           returnVal = VALID_PRIORITY;
-          break;
         }
-      mask *= 2;
     }
 
+#else
+
+  activity_word_t word;
+
+  word = (activity_word_t) (bf->activity & (((activity_word_t) 1u << priority) - 1u));
+  if(word)
+    {
+      *nextPriority = highestBit(word);
+      returnVal = VALID_PRIORITY;
+    }
+
+#endif  /* ACTIVITY_LEAVES */
+
   return returnVal;
 }
 
+#endif  /* ! EXTERNAL_DATA_BUFFER || PBUF_AGING || PBUF_SCHEDULER */
+
 /**
    Counts the number of active priorities
    \return number of active priorities */
 
-STATIC uint8_t activePriorityCount(void)
+STATIC uint8_t activePriorityCount(pbuf_t * bf)
 {
+#ifdef ACTIVITY_LEAVES
+
   uint8_t returnVal = 0;
-  priority_t priority;
-  priority_t mask = 1u;
+  priority_t leaf;
 
-  for(priority = LOW_PRI; priority < PRIORITY_SIZE; priority++)
+  for(leaf = 0; leaf < ACTIVITY_LEAVES; leaf++)
     {
-      if(bf.activity & mask)
-        {
-          returnVal++;
-        }
-      mask *= 2;
+      returnVal += bitCount(bf->activity.leaf[leaf]);
     }
 
   return returnVal;
+
+#else
+
+  return bitCount(bf->activity);
+
+#endif  /* ACTIVITY_LEAVES */
 }
 
 /**
    Determines the lowest priority tail index
    \return index of the lowest priority tail */
 
-STATIC index_t lowestPriorityTail(void)
+STATIC index_t lowestPriorityTail(pbuf_t * bf)
 {
   priority_t lowestButOnePri;
   priority_t lowestPri;
   index_t lowestTail;
 
-  lowestPriority(&lowestPri);
-  nextHighestPriority(&lowestButOnePri, lowestPri);
-  nextIndex(&lowestTail, headIndex(lowestButOnePri));
+  lowestPriority(bf, &lowestPri);
+  nextHighestPriority(bf, &lowestButOnePri, lowestPri);
+  nextIndex(bf, &lowestTail, headIndex(bf, lowestButOnePri));
   return lowestTail;
 }
 
 /**
-   Determine index of next insert and modify index variable passed in.
-   \return VALID_INSERT or INVALID_INSERT */
+   Determine index of next insert and modify index variable passed in. Inserts into a full
+   buffer are handed to its overflow policy.
+   \return VALID_INSERT, INVALID_INSERT, DROP_INSERT or REJECT_INSERT */
 
-STATIC check_t insertIndex(index_t * index, priority_t priority)
+STATIC check_t insertIndex(pbuf_t * bf, index_t * index, priority_t priority)
 {
   check_t returnVal = INVALID_INSERT;
   priority_t lowestPri;
 
-  if(bufferEmpty() == BUFFER_EMPTY)
+  if(bufferEmpty(bf) == BUFFER_EMPTY)
     {
-      if(insertEmptyIndex(index, priority) == VALID_INSERT)
+      if(insertEmptyIndex(bf, index, priority) == VALID_INSERT)
         {
           returnVal = VALID_INSERT;
         }
     }
 
-  else if(bufferFull() == BUFFER_FULL)
+  else if(bufferFull(bf) == BUFFER_FULL)
     {
-      if(insertFullIndex(index, priority) == VALID_INSERT)
+      // the policy selected by PBUF_setOverflow()
+      returnVal = bf->overflow(bf, index, priority);
+#ifdef PBUF_STATISTICS
+      if((returnVal != VALID_INSERT) && (validatePriority(bf, priority) == VALID_PRIORITY))
         {
-          returnVal = VALID_INSERT;
+          STAT(bf, rejections, priority);
         }
+#endif  /* PBUF_STATISTICS */
     }
 
   else
     {
       // buffer neither full nor empty
-      if((lowestPriority(&lowestPri) == VALID_PRIORITY) &&
+      if((lowestPriority(bf, &lowestPri) == VALID_PRIORITY) &&
          (priority > lowestPri))
         {
-          if(insertNotFullIndex(index, priority) == VALID_INSERT)
+          if(insertNotFullIndex(bf, index, priority) == VALID_INSERT)
             {
               returnVal = VALID_INSERT;
             }
         }
       else
         {
-          if(writeElementIndex(index, priority) == VALID_WRITE)
+          if(writeElementIndex(bf, index, priority) == VALID_WRITE)
             {
               returnVal = VALID_INSERT;
             }
@@ -570,19 +1022,18 @@ STATIC check_t insertIndex(index_t * index, priority_t priority)
 /**
    Insert an element into the buffer of a given priority and
    adjust the buffer to correct the prioritisation if required.
-   \return VALID_INSERT or INVALID_INSERT */
+   \return VALID_INSERT, INVALID_INSERT, or DROP_INSERT or REJECT_INSERT from the overflow policy */
 
-STATIC check_t insert(element_t element, priority_t priority)
+STATIC check_t insert(pbuf_t * bf, element_t element, priority_t priority)
 {
-  check_t returnVal = INVALID_INSERT;
+  check_t returnVal;
   index_t index;
 
-  if(insertIndex(&index, priority) == VALID_INSERT)
+  returnVal = insertIndex(bf, &index, priority);
+  if((returnVal == VALID_INSERT) &&
+     (writeData(bf, element, index) != VALID_ELEMENT))
     {
-      if(writeData(element, index) == VALID_ELEMENT)
-        {
-          returnVal = VALID_INSERT;
-        }
+      returnVal = INVALID_INSERT;
     }
 
   return returnVal;
@@ -591,74 +1042,501 @@ STATIC check_t insert(element_t element, priority_t priority)
 #ifndef EXTERNAL_DATA_BUFFER
 
 /**
-   Write the element passed in to the index passed in.
-   Check the index is within the bounds of the buffer.
-   \return VALID_INDEX or INVALID_INDEX */
+   Insert a run of elements of the given priority into the first free cells of the buffer.
+   There must be at least as many free cells as elements. The cells are written in one walk
+   along the free cells and, if the run belongs ahead of the lowest priority, moved into place
+   as a single segment with one splice, much as remap() moves a single cell.
+   \return VALID_INSERT or INVALID_INSERT */
 
-STATIC check_t writeData(element_t element, index_t index)
+STATIC check_t insertRun(pbuf_t * bf, const element_t * elements, count_t cells, priority_t priority)
 {
-  check_t returnVal = INVALID_ELEMENT;
-  if(index < BUFFER_SIZE)
+  check_t returnVal = INVALID_INSERT;
+  index_t bridgePt = tailIndex(bf);
+  index_t insertPt;
+  index_t insertNext;
+  index_t first;
+  index_t last;
+  index_t after;
+  priority_t lowestPri = priority;
+  count_t count;
+
+  if((validatePriority(bf, priority) == VALID_PRIORITY) &&
+     (cells > 0u) && (cells <= (count_t) (CAPACITY(bf) - bf->count - bf->detached)))
     {
-      bf.element[index].data = element;
-      returnVal = VALID_ELEMENT;
-    }
+      if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
+        {
+          lowestPriority(bf, &lowestPri);
+          bridgePt = headIndex(bf, lowestPri);
+        }
 
-  return returnVal;
-}
+      // write the run into the free cells following the bridge point
+      nextIndex(bf, &first, bridgePt);
+      last = first;
+      writeData(bf, elements[0], last);
+      countInsert(bf, priority);
+      for(count = 1; count < cells; count++)
+        {
+          nextIndex(bf, &last, last);
+          writeData(bf, elements[count], last);
+          countInsert(bf, priority);
+        }
 
-/**
-   Read the next available data element.
-   Check the index is within the bounds of the buffer.
-   \return VALID_ELEMENT or INVALID_ELEMENT */
+      if(priority > lowestPri)
+        {
+          // splice the run out from after the bridge point and in after the insert point
+          // a run ending at the tail already sits ahead of the readable cells
+          insertPt = insertPointNotFull(bf, priority);
+          nextIndex(bf, &insertNext, insertPt);
+          if((insertPt != last) && (insertNext != first))
+            {
+              nextIndex(bf, &after, last);
+              writeNextIndex(bf, bridgePt, after);
+              writeNextIndex(bf, last, insertNext);
+              writeNextIndex(bf, insertPt, first);
+            }
 
-STATIC check_t readData(element_t * element, index_t index)
-{
-  check_t returnVal = INVALID_ELEMENT;
-  if(index < BUFFER_SIZE)
-    {
-      *element = bf.element[index].data;
-      returnVal = VALID_ELEMENT;
+          if(tailIndex(bf) == last)
+            {
+              writeTail(bf, bridgePt);
+            }
+        }
+
+      writeHead(bf, last, priority);
+      setActive(bf, priority);
+      returnVal = VALID_INSERT;
     }
 
   return returnVal;
 }
 
-#endif  /* ! EXTERNAL_DATA_BUFFER */
-
 /**
-   Buffer Full checks whether there is any room left in the buffer for a new insertion.
-   A full buffer is indicated by an active priority buffer having the same value as the
-   tail pointer since the tail buffer indicates the final possible element of the buffer.
-   \return BUFFER_FULL or BUFFER_NOT_FULL */
+   Read up to max elements from the front of the buffer in one walk from the tail, passing
+   back the priority of each if priorities is not NULL. The runs are read highest priority
+   first; each run's length is its priority count, so activity flags are only cleared at
+   the end of a run, and the tail is moved once at the end.
+   \return number of elements read */
 
-STATIC check_t bufferFull(void)
+STATIC size_t readRuns(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max)
 {
-  check_t returnVal = BUFFER_NOT_FULL;
+  size_t returnVal = 0;
+  index_t index = tailIndex(bf);
   priority_t priority;
+  count_t cells;
 
-  for(priority = LOW_PRI ; priority < PRIORITY_SIZE; priority++)
+#ifdef PBUF_AGING
+  ageRuns(bf);
+#endif  /* PBUF_AGING */
+  while((returnVal < max) && (highestPriority(bf, &priority) == VALID_PRIORITY))
     {
-      if((activeStatus(priority) == ACTIVE) &&
-         (tailIndex() == headIndex(priority)))
+      cells = bf->priorityCount[priority];
+      if(cells > (max - returnVal))
         {
-          returnVal = BUFFER_FULL;
-          break;
+          cells = (count_t) (max - returnVal);
+        }
+      else
+        {
+          // the whole run is read
+          setInactive(bf, priority);
+        }
+
+      for(; cells > 0u; cells--)
+        {
+          nextIndex(bf, &index, index);
+          readData(bf, &elements[returnVal], index);
+          if(priorities != NULL)
+            {
+              priorities[returnVal] = priority;
+            }
+          countRemove(bf, priority);
+          STAT(bf, retrieves, priority);
+#ifdef PBUF_AGING
+          served(bf, priority);
+#endif  /* PBUF_AGING */
+#ifdef PAYLOAD_BUFFER
+          releasePayload(bf, index, priority);
+#endif  /* PAYLOAD_BUFFER */
+          returnVal++;
+        }
+    }
+
+  writeTail(bf, index);
+
+  return returnVal;
+}
+
+/**
+   Copy up to max elements from the front of the buffer, in the order they would be
+   retrieved, without changing the buffer. The priority of each is passed back if
+   priorities is not NULL. Each run is as long as its priority count, and is followed
+   by the run of the next lower active priority.
+   \return number of elements copied */
+
+STATIC size_t peekRuns(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max)
+{
+  size_t returnVal = 0;
+  index_t index = tailIndex(bf);
+  priority_t priority;
+  count_t cells = 0;
+
+  if(highestPriority(bf, &priority) == VALID_PRIORITY)
+    {
+      cells = bf->priorityCount[priority];
+    }
+
+  while((returnVal < max) && (cells > 0u))
+    {
+      nextIndex(bf, &index, index);
+      readData(bf, &elements[returnVal], index);
+      if(priorities != NULL)
+        {
+          priorities[returnVal] = priority;
+        }
+      returnVal++;
+
+      cells--;
+      if((cells == 0u) &&
+         (nextLowerPriority(bf, &priority, priority) == VALID_PRIORITY))
+        {
+          cells = bf->priorityCount[priority];
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Return the address of the data of the cell at the index passed in.
+   \return data address */
+
+STATIC void * slotData(pbuf_t * bf, index_t index)
+{
+#ifdef PBUF_RUNTIME_SIZE
+  return &bf->data[(size_t) index * bf->elementSize];
+#else
+  return &DATA(bf, index);
+#endif  /* PBUF_RUNTIME_SIZE */
+}
+
+/**
+   Find the index of the cell whose data is at the slot address passed in.
+   \return VALID_INDEX or INVALID_INDEX */
+
+STATIC check_t slotIndex(pbuf_t * bf, const void * slot, index_t * index)
+{
+  check_t returnVal = INVALID_INDEX;
+  uintptr_t first = (uintptr_t) slotData(bf, 0);
+  uintptr_t stride = (uintptr_t) slotData(bf, 1) - first;
+  uintptr_t offset = (uintptr_t) slot - first;
+
+  if(((uintptr_t) slot >= first) &&
+     ((offset % stride) == 0u) &&
+     ((offset / stride) < CAPACITY(bf)))
+    {
+      *index = (index_t) (offset / stride);
+      returnVal = VALID_INDEX;
+    }
+
+  return returnVal;
+}
+
+/**
+   Detach the first free cell from the buffer, leaving its neighbours linked to each other,
+   and modify index to refer to it. If it was the tail, the cell before it becomes the tail.
+   \return VALID_INDEX or INVALID_INDEX */
+
+STATIC check_t detachFree(pbuf_t * bf, index_t * index)
+{
+  check_t returnVal = INVALID_INDEX;
+  index_t bridgePt = tailIndex(bf);
+  index_t after;
+  priority_t lowestPri;
+
+  if(bufferFull(bf) == BUFFER_NOT_FULL)
+    {
+      if(lowestPriority(bf, &lowestPri) == VALID_PRIORITY)
+        {
+          bridgePt = headIndex(bf, lowestPri);
+        }
+
+      // a single cell left in the buffer cannot be detached
+      nextIndex(bf, index, bridgePt);
+      if(*index != bridgePt)
+        {
+          nextIndex(bf, &after, *index);
+          writeNextIndex(bf, bridgePt, after);
+          if(tailIndex(bf) == *index)
+            {
+              writeTail(bf, bridgePt);
+            }
+
+          bf->detached++;
+          returnVal = VALID_INDEX;
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Detach the cell holding the next element to be retrieved, leaving its neighbours linked to
+   each other, and modify index to refer to it and priority to its priority. The element is
+   removed from the buffer as for a retrieve, but its cell is not freed.
+   \return VALID_ELEMENT or INVALID_ELEMENT */
+
+STATIC check_t detachFirst(pbuf_t * bf, index_t * index, priority_t * priority)
+{
+  check_t returnVal = INVALID_ELEMENT;
+  index_t after;
+
+#ifdef PBUF_AGING
+  ageRuns(bf);
+#endif  /* PBUF_AGING */
+  // a single cell left in the buffer cannot be detached
+  if((bf->detached + 1u) < CAPACITY(bf))
+    {
+#ifdef PBUF_SCHEDULER
+      if(bf->schedule.policy != PBUF_STRICT_PRIORITY)
+        {
+          returnVal = detachServed(bf, index, priority);
+        }
+      else
+#endif  /* PBUF_SCHEDULER */
+      if((nextTailIndex(bf, index) == VALID_INDEX) &&
+         (adjustPriority(bf, priority) == VALID_PRIORITY))
+        {
+          nextIndex(bf, &after, *index);
+          writeNextIndex(bf, tailIndex(bf), after);
+          countRemove(bf, *priority);
+          STAT(bf, retrieves, *priority);
+#ifdef PBUF_AGING
+          served(bf, *priority);
+#endif  /* PBUF_AGING */
+#ifdef PAYLOAD_BUFFER
+          releasePayload(bf, *index, *priority);
+#endif  /* PAYLOAD_BUFFER */
+          bf->detached++;
+          returnVal = VALID_ELEMENT;
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Link a detached cell back into the buffer as the first free cell, and clear its detach
+   state. If the buffer had no free cell, the reattached cell becomes the tail. */
+
+STATIC void attachFree(pbuf_t * bf, index_t index)
+{
+  check_t full = bufferFull(bf);
+  index_t bridgePt = tailIndex(bf);
+  index_t after;
+  priority_t lowestPri;
+
+  if(lowestPriority(bf, &lowestPri) == VALID_PRIORITY)
+    {
+      bridgePt = headIndex(bf, lowestPri);
+    }
+
+  nextIndex(bf, &after, bridgePt);
+  writeNextIndex(bf, index, after);
+  writeNextIndex(bf, bridgePt, index);
+  if(full == BUFFER_FULL)
+    {
+      writeTail(bf, index);
+    }
+
+  writeDetachState(bf, index, CELL_ATTACHED);
+  bf->detached--;
+}
+
+/**
+   Read the detach state of the cell at the index passed in.
+   \return CELL_ATTACHED, CELL_RESERVED or CELL_ACQUIRED */
+
+STATIC uint8_t detachState(pbuf_t * bf, index_t index)
+{
+  return (uint8_t) ((bf->detachMap[index / 16u] >> ((index % 16u) * 2u)) & 3u);
+}
+
+/**
+   Write the detach state passed in to the cell at the index passed in. */
+
+STATIC void writeDetachState(pbuf_t * bf, index_t index, uint8_t state)
+{
+  uint32_t shift = (uint32_t) (index % 16u) * 2u;
+
+  bf->detachMap[index / 16u] = (bf->detachMap[index / 16u] & ~((uint32_t) 3u << shift)) |
+    ((uint32_t) state << shift);
+}
+
+/**
+   Write the element passed in to the index passed in.
+   Check the index is within the bounds of the buffer.
+   \return VALID_INDEX or INVALID_INDEX */
+
+STATIC check_t writeData(pbuf_t * bf, element_t element, index_t index)
+{
+  check_t returnVal = INVALID_ELEMENT;
+
+  if(checkIndex(bf, index) == VALID_INDEX)
+    {
+#ifdef PBUF_RUNTIME_SIZE
+
+      uint8_t * data = &bf->data[(size_t) index * bf->elementSize];
+      uint8_t data8 = (uint8_t) element;
+      uint16_t data16 = (uint16_t) element;
+      uint32_t data32 = (uint32_t) element;
+      uint64_t data64 = (uint64_t) element;
+
+      switch(bf->elementSize)
+        {
+        case 1:
+          memcpy(data, &data8, sizeof(data8));
+          break;
+        case 2:
+          memcpy(data, &data16, sizeof(data16));
+          break;
+        case 4:
+          memcpy(data, &data32, sizeof(data32));
+          break;
+        default:
+          memcpy(data, &data64, sizeof(data64));
+          break;
+        }
+
+#else
+
+      DATA(bf, index) = element;
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
+      returnVal = VALID_ELEMENT;
+    }
+
+  return returnVal;
+}
+
+/**
+   Read the next available data element.
+   Check the index is within the bounds of the buffer.
+   \return VALID_ELEMENT or INVALID_ELEMENT */
+
+STATIC check_t readData(pbuf_t * bf, element_t * element, index_t index)
+{
+  check_t returnVal = INVALID_ELEMENT;
+
+  if(checkIndex(bf, index) == VALID_INDEX)
+    {
+#ifdef PBUF_RUNTIME_SIZE
+
+      uint8_t * data = &bf->data[(size_t) index * bf->elementSize];
+      uint8_t data8;
+      uint16_t data16;
+      uint32_t data32;
+      uint64_t data64;
+
+      switch(bf->elementSize)
+        {
+        case 1:
+          memcpy(&data8, data, sizeof(data8));
+          *element = (element_t) data8;
+          break;
+        case 2:
+          memcpy(&data16, data, sizeof(data16));
+          *element = (element_t) data16;
+          break;
+        case 4:
+          memcpy(&data32, data, sizeof(data32));
+          *element = (element_t) data32;
+          break;
+        default:
+          memcpy(&data64, data, sizeof(data64));
+          *element = (element_t) data64;
+          break;
         }
-    }
+
+#else
+
+      *element = DATA(bf, index);
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
+      returnVal = VALID_ELEMENT;
+    }
+
+  return returnVal;
+}
+
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+
+/**
+   Buffer Full checks whether there is any room left in the buffer for a new insertion.
+   The buffer is full when the element count, plus any cells reserved, has reached the
+   buffer capacity.
+   \return BUFFER_FULL or BUFFER_NOT_FULL */
+
+STATIC check_t bufferFull(pbuf_t * bf)
+{
+  check_t returnVal = BUFFER_NOT_FULL;
+
+  if((bf->count + bf->detached) == CAPACITY(bf))
+    {
+      returnVal = BUFFER_FULL;
+    }
 
   return returnVal;
 }
 
+/**
+   Count an element inserted at the priority passed in. */
+
+STATIC void countInsert(pbuf_t * bf, priority_t priority)
+{
+  bf->count++;
+  bf->priorityCount[priority]++;
+  STAT(bf, inserts, priority);
+#ifdef PBUF_AGING
+  if(bf->priorityCount[priority] == 1u)
+    {
+      // a run starts ageing when it becomes active
+      bf->aging.stamp[priority] = PBUF_AGING_NOW(bf);
+    }
+#endif  /* PBUF_AGING */
+#ifdef PBUF_STATISTICS
+  if(bf->count > bf->stats.highWater)
+    {
+      bf->stats.highWater = bf->count;
+    }
+  if(bf->priorityCount[priority] > bf->stats.priorityHighWater[priority])
+    {
+      bf->stats.priorityHighWater[priority] = bf->priorityCount[priority];
+    }
+#endif  /* PBUF_STATISTICS */
+}
+
+/**
+   Count an element removed from the priority passed in. */
+
+STATIC void countRemove(pbuf_t * bf, priority_t priority)
+{
+  bf->count--;
+  bf->priorityCount[priority]--;
+}
+
 /**
    Check whether the buffer is empty.
    \return BUFFER_EMPTY or BUFFER_NOT_EMPTY */
 
-STATIC check_t bufferEmpty(void)
+STATIC check_t bufferEmpty(pbuf_t * bf)
 {
   check_t returnVal = BUFFER_NOT_EMPTY;
 
-  if( ! bf.activity)
+#ifdef ACTIVITY_LEAVES
+  if( ! bf->activity.summary)
+#else
+  if( ! bf->activity)
+#endif  /* ACTIVITY_LEAVES */
     {
       returnVal = BUFFER_EMPTY;
     }
@@ -666,11 +1544,11 @@ STATIC check_t bufferEmpty(void)
   return returnVal;
 }
 
-STATIC check_t insertEmptyIndex(index_t * index, priority_t priority)
+STATIC check_t insertEmptyIndex(pbuf_t * bf, index_t * index, priority_t priority)
 {
   check_t returnVal = INVALID_INSERT;
 
-  if(writeElementIndex(index, priority) == VALID_WRITE)
+  if(writeElementIndex(bf, index, priority) == VALID_WRITE)
     {
       returnVal = VALID_INSERT;
     }
@@ -684,14 +1562,15 @@ STATIC check_t insertEmptyIndex(index_t * index, priority_t priority)
    Modifies the index to reflect the insert point.
    \return VALID_INSERT or INVALID_INSERT */
 
-STATIC check_t insertNotFullIndex(index_t * index, priority_t priority)
+STATIC check_t insertNotFullIndex(pbuf_t * bf, index_t * index, priority_t priority)
 {
   check_t returnVal = INVALID_INSERT;
 
-  if(firstFreeElementIndex(index) == VALID_INDEX)
+  if(firstFreeElementIndex(bf, index) == VALID_INDEX)
     {
-      if(remapNotFull(*index, priority) == VALID_REMAP)
+      if(remapNotFull(bf, *index, priority) == VALID_REMAP)
         {
+          countInsert(bf, priority);
           returnVal = VALID_INSERT;
         }
     }
@@ -705,18 +1584,18 @@ STATIC check_t insertNotFullIndex(index_t * index, priority_t priority)
    Modifies the index to reflect the insert point.
    \return VALID_INSERT or INVALID_INSERT */
 
-STATIC check_t insertFullIndex(index_t * index, priority_t priority)
+STATIC check_t insertFullIndex(pbuf_t * bf, index_t * index, priority_t priority)
 {
   check_t returnVal = INVALID_INSERT;
   priority_t lowestPri;
 
   // if lower or equal priority data in buffer find lowest
-  if((lowestPriority(&lowestPri)) == VALID_PRIORITY)
+  if((lowestPriority(bf, &lowestPri)) == VALID_PRIORITY)
     {
       if(lowestPri <= priority)
         {
           // overwrite oldest element at lowest priority
-          if(overwriteElementIndex(index, priority) == VALID_WRITE)
+          if(overwriteElementIndex(bf, index, priority) == VALID_WRITE)
             {
               returnVal = VALID_INSERT;
             }
@@ -727,45 +1606,85 @@ STATIC check_t insertFullIndex(index_t * index, priority_t priority)
 }
 
 /**
-   Mark the highest priority inactive if necessary.
-   \return VALID_PRIORITY or INVALID_PRIORITY */
+   Overflow policy PBUF_OVERWRITE_LOWEST. Overwrite the oldest element of the lowest priority
+   if that priority is no higher than the one passed in.
+   \return VALID_INSERT or INVALID_INSERT */
 
-STATIC check_t adjustPriority(void)
+STATIC check_t overflowOverwrite(pbuf_t * bf, index_t * index, priority_t priority)
 {
-  check_t returnVal = INVALID_PRIORITY;
-  priority_t priority;
-  index_t index;
+  check_t returnVal = INVALID_INSERT;
+  priority_t lowestPri;
 
-  if((highestPriority(&priority) == VALID_PRIORITY) &&
-     (activeStatus(priority) == ACTIVE) &&
-     (nextTailIndex(&index) == VALID_INDEX))
+  if(lowestPriority(bf, &lowestPri) == VALID_PRIORITY)
     {
-      if(headIndex(priority) == index)
+      if(bf->detached > 0u)
         {
-          setInactive(priority);
+          // reserved cells shorten the ring, so the overwritten cell is freed before the insert
+          if((lowestPri <= priority) &&
+             (removeOldestIndex(bf, index, lowestPri) == VALID_ELEMENT))
+            {
+              returnVal = insertIndex(bf, index, priority);
+            }
+        }
+      else if(insertFullIndex(bf, index, priority) == VALID_INSERT)
+        {
+#ifdef PAYLOAD_BUFFER
+          // the overwritten element is the oldest of the lowest priority
+          releasePayload(bf, *index, lowestPri);
+#endif  /* PAYLOAD_BUFFER */
+          returnVal = VALID_INSERT;
         }
-
-      returnVal = VALID_PRIORITY;
     }
 
   return returnVal;
 }
 
 /**
-   Read element from the buffer and assign to the
-   element pointer passed in.
-   \return VALID_ELEMENT or INVALID_ELEMENT */
+   Overflow policy PBUF_DROP_INCOMING. The new element is discarded.
+   \return DROP_INSERT */
 
-STATIC check_t readElementIndex(index_t * index)
+STATIC check_t overflowDrop(pbuf_t * bf, index_t * index, priority_t priority)
 {
-  check_t returnVal = INVALID_ELEMENT;
+  (void) bf;
+  (void) index;
+  (void) priority;
+
+  return DROP_INSERT;
+}
+
+/**
+   Overflow policy PBUF_REJECT_INCOMING. The new element is turned away.
+   \return REJECT_INSERT */
+
+STATIC check_t overflowReject(pbuf_t * bf, index_t * index, priority_t priority)
+{
+  (void) bf;
+  (void) index;
+  (void) priority;
+
+  return REJECT_INSERT;
+}
+
+/**
+   Overflow policy PBUF_EVICT_OLDEST. Overwrite as PBUF_OVERWRITE_LOWEST would, or, if every
+   element held is of a higher priority than the one passed in, remove the oldest element of the
+   lowest priority and insert into the cell freed.
+   \return VALID_INSERT or INVALID_INSERT */
+
+STATIC check_t overflowEvict(pbuf_t * bf, index_t * index, priority_t priority)
+{
+  check_t returnVal = INVALID_INSERT;
+  priority_t lowestPri;
 
-  if(nextTailIndex(index) == VALID_INDEX)
+  if(lowestPriority(bf, &lowestPri) == VALID_PRIORITY)
     {
-      if((adjustPriority() == VALID_PRIORITY) &&
-         (writeTail(*index) == VALID_INDEX))
+      if(lowestPri <= priority)
         {
-          returnVal = VALID_ELEMENT;
+          returnVal = overflowOverwrite(bf, index, priority);
+        }
+      else if(removeOldestIndex(bf, index, lowestPri) == VALID_ELEMENT)
+        {
+          returnVal = insertIndex(bf, index, priority);
         }
     }
 
@@ -773,397 +1692,2672 @@ STATIC check_t readElementIndex(index_t * index)
 }
 
 /**
-   Remap the links of the indexes passed in.
-   These refer to buffer elements and cause the buffer
-   to be remapped or re-routed.
-   We modify three links as follows:
+   Apply the overflow policy of the buffer passed in to an insert of the priority passed in
+   that must first remove elements, and pass back the highest priority it may remove: the
+   new element's under PBUF_OVERWRITE_LOWEST, and any under PBUF_EVICT_OLDEST.
+   \return VALID_INSERT, or DROP_INSERT or REJECT_INSERT if the policy removes nothing */
 
-   ```
+STATIC check_t overflowLimit(pbuf_t * bf, priority_t priority, priority_t * limit)
+{
+  check_t returnVal = VALID_INSERT;
 
-   save a1*
-   a1* = b
-   a2* = b*
-   b* = saved a1*
+  *limit = priority;
+  if(bf->overflow == overflowEvict)
+    {
+      *limit = (priority_t) (PRIORITIES(bf) - 1u);
+    }
+  else if(bf->overflow == overflowDrop)
+    {
+      returnVal = DROP_INSERT;
+    }
+  else if(bf->overflow == overflowReject)
+    {
+      returnVal = REJECT_INSERT;
+    }
 
-   ```
+  if(returnVal != VALID_INSERT)
+    {
+      STAT(bf, rejections, priority);
+    }
 
-   \return VALID_REMAP or INVALID_REMAP */
+  return returnVal;
+}
 
+/**
+   \return the API return value for the insert result passed in: zero if the element was stored
+   or dropped by PBUF_DROP_INCOMING, PBUF_REJECTED if PBUF_REJECT_INCOMING turned it away, and
+   one otherwise */
+
+STATIC int insertStatus(check_t result)
+{
+  int returnVal = 1;
+
+  if((result == VALID_INSERT) || (result == DROP_INSERT))
+    {
+      returnVal = 0;
+    }
+  else if(result == REJECT_INSERT)
+    {
+      returnVal = PBUF_REJECTED;
+    }
+
+  return returnVal;
+}
+
+/**
+   Mark the highest priority inactive if necessary. The priority of the element about
+   to be read is passed back to the caller.
+   \return VALID_PRIORITY or INVALID_PRIORITY */
+
+STATIC check_t adjustPriority(pbuf_t * bf, priority_t * priority)
+{
+  check_t returnVal = INVALID_PRIORITY;
+  index_t index;
+
+  if((highestPriority(bf, priority) == VALID_PRIORITY) &&
+     (activeStatus(bf, *priority) == ACTIVE) &&
+     (nextTailIndex(bf, &index) == VALID_INDEX))
+    {
+      if(headIndex(bf, *priority) == index)
+        {
+          setInactive(bf, *priority);
+        }
+
+      returnVal = VALID_PRIORITY;
+    }
+
+  return returnVal;
+}
+
+/**
+   Read element from the buffer and assign to the
+   element pointer passed in.
+   \return VALID_ELEMENT or INVALID_ELEMENT */
+
+STATIC check_t readElementIndex(pbuf_t * bf, index_t * index)
+{
+  check_t returnVal = INVALID_ELEMENT;
+  priority_t priority;
+
+#ifdef PBUF_AGING
+  ageRuns(bf);
+#endif  /* PBUF_AGING */
+#ifdef PBUF_SCHEDULER
+  if(bf->schedule.policy != PBUF_STRICT_PRIORITY)
+    {
+      returnVal = readServedIndex(bf, index, &priority);
+    }
+  else
+#endif  /* PBUF_SCHEDULER */
+  if(nextTailIndex(bf, index) == VALID_INDEX)
+    {
+      if((adjustPriority(bf, &priority) == VALID_PRIORITY) &&
+         (writeTail(bf, *index) == VALID_INDEX))
+        {
+          countRemove(bf, priority);
+          STAT(bf, retrieves, priority);
+#ifdef PBUF_AGING
+          served(bf, priority);
+#endif  /* PBUF_AGING */
+#ifdef PAYLOAD_BUFFER
+          releasePayload(bf, *index, priority);
+#endif  /* PAYLOAD_BUFFER */
+          returnVal = VALID_ELEMENT;
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Find the cell before the oldest element of the active priority passed in: the newest element
+   of the next highest active priority, or the tail if there is none.
+   \return the index of the cell */
+
+STATIC index_t runBefore(pbuf_t * bf, priority_t priority)
+{
+  index_t returnVal = tailIndex(bf);
+  priority_t nextPri;
+
+  if(nextHighestPriority(bf, &nextPri, priority) == VALID_PRIORITY)
+    {
+      returnVal = headIndex(bf, nextPri);
+    }
+
+  return returnVal;
+}
+
+/**
+   Unlink the oldest element of the priority passed in, wherever it lies in the buffer, and
+   modify index to refer to it. The oldest of the highest priority is read as normal. Any other
+   element is remapped to the first free cell after the lowest priority head, and becomes the
+   tail if the buffer was full. The element is counted out, and its data left in the cell.
+   \return VALID_ELEMENT or INVALID_ELEMENT */
+
+STATIC check_t unlinkOldestIndex(pbuf_t * bf, index_t * index, priority_t priority)
+{
+  check_t returnVal = INVALID_ELEMENT;
+  check_t full = bufferFull(bf);
+  index_t before;
+  priority_t lowestPri;
+
+  if((activeStatus(bf, priority) == ACTIVE) &&
+     (lowestPriority(bf, &lowestPri) == VALID_PRIORITY))
+    {
+      before = runBefore(bf, priority);
+      if(nextIndex(bf, index, before) == VALID_INDEX)
+        {
+          if(headIndex(bf, priority) == *index)
+            {
+              setInactive(bf, priority);
+            }
+
+          if(before == tailIndex(bf))
+            {
+              if(writeTail(bf, *index) == VALID_INDEX)
+                {
+                  returnVal = VALID_ELEMENT;
+                }
+            }
+          else if((priority == lowestPri) &&
+                  (activeStatus(bf, priority) == INACTIVE))
+            {
+              // the only element of the lowest priority is already the first free cell
+              returnVal = VALID_ELEMENT;
+            }
+          else if(remap(bf, headIndex(bf, lowestPri), before, *index) == VALID_REMAP)
+            {
+              if(full == BUFFER_FULL)
+                {
+                  writeTail(bf, *index);
+                }
+              returnVal = VALID_ELEMENT;
+            }
+        }
+
+      if(returnVal == VALID_ELEMENT)
+        {
+          countRemove(bf, priority);
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Remove the oldest element of the priority passed in, wherever it lies in the buffer, and
+   modify index to refer to it. It is only called to make room, so the element counts as
+   overwritten.
+   \return VALID_ELEMENT or INVALID_ELEMENT */
+
+STATIC check_t removeOldestIndex(pbuf_t * bf, index_t * index, priority_t priority)
+{
+  check_t returnVal = INVALID_ELEMENT;
+
+  if(unlinkOldestIndex(bf, index, priority) == VALID_ELEMENT)
+    {
+      STAT(bf, overwrites, priority);
+#ifdef PAYLOAD_BUFFER
+      releasePayload(bf, *index, priority);
+#endif  /* PAYLOAD_BUFFER */
+      returnVal = VALID_ELEMENT;
+    }
+
+  return returnVal;
+}
+
+/**
+   Remap the links of the indexes passed in.
+   These refer to buffer elements and cause the buffer
+   to be remapped or re-routed.
+   We modify three links as follows:
+
+   ```
+
+   save a1*
+   a1* = b
+   a2* = b*
+   b* = saved a1*
+
+   ```
+
+   \return VALID_REMAP or INVALID_REMAP */
+
+
+STATIC check_t remap(pbuf_t * bf, index_t a1, index_t a2, index_t b)
+{
+  check_t returnVal = INVALID_REMAP;
+  index_t a1ptr;
+  index_t a2ptr;
+  index_t bptr;
+
+  if((checkIndex(bf, a1) == VALID_INDEX) &&
+     (checkIndex(bf, a2) == VALID_INDEX) &&
+     (checkIndex(bf, b) == VALID_INDEX))
+    {
+      if((nextIndex(bf, &a1ptr, a1) == VALID_INDEX) &&
+         (nextIndex(bf, &bptr, b) == VALID_INDEX) &&
+         (nextIndex(bf, &a2ptr, a2) == VALID_INDEX))
+        {
+          // don't remap if it is not needed
+          if(a1ptr != b)
+            {
+              if((writeNextIndex(bf, a1, b) == VALID_INDEX) &&
+                 (nextIndex(bf, &bptr, b) == VALID_INDEX) &&
+                 (writeNextIndex(bf, a2, bptr) == VALID_INDEX) &&
+                 (writeNextIndex(bf, b, a1ptr) == VALID_INDEX))
+                {
+                  returnVal = VALID_REMAP;
+                }
+            }
+          else
+            {
+              returnVal = VALID_REMAP;
+            }
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   insertPointNotFull() calculates the index of the valid insert point to be used when remapping the buffer.
+   This routine is particularly used when the buffer is not full and an overwrite hasn't taken place.
+   The priority passed in is the priority of the newly added element. The new element follows the newest
+   element of its own priority, or of the next highest active priority, or the tail when no equal or higher
+   priority is active. See the 'Adding data to the Buffer' document for more information.
+   \return insert point index */
+
+STATIC index_t insertPointNotFull(pbuf_t * bf, priority_t priority)
+{
+  index_t returnVal = tailIndex(bf);
+  priority_t nextPri;
+
+  if(activeStatus(bf, priority) == ACTIVE)
+    {
+      returnVal = headIndex(bf, priority);
+    }
+  else if(nextHighestPriority(bf, &nextPri, priority) == VALID_PRIORITY)
+    {
+      returnVal = headIndex(bf, nextPri);
+    }
+
+  return returnVal;
+}
+
+/**
+   Calculate the index of the valid insert point to be used when remapping the buffer.
+   This routine is particularly used when an overwrite has taken place due to a full buffer.
+   The priority passed in is the priority of the newly added element. It must be calculated before
+   the overwritten element is remapped, and is then found in the same way as for a not full buffer.
+   See 'adding_data_to_the_Buffer' for more information.
+   \return insert point index */
+
+STATIC index_t insertPointFull(pbuf_t * bf, priority_t priority)
+{
+  return insertPointNotFull(bf, priority);
+}
+
+/**
+   Calculate the bridgePoint when the buffer is full. The bridgePoint is passed to the
+   remap routine to notify the bridgePoint (see 'adding_data_to_the_Buffer' for more information).
+   \return bridge point index */
+
+STATIC index_t bridgePointFull(pbuf_t * bf)
+{
+  index_t returnVal = tailIndex(bf);
+  priority_t lowestPri;
+  priority_t nextPri;
+
+  if((lowestPriority(bf, &lowestPri) == VALID_PRIORITY) &&
+     (nextHighestPriority(bf, &nextPri, lowestPri) == VALID_PRIORITY))
+    {
+      returnVal = headIndex(bf, nextPri);
+    }
+
+  return returnVal;
+}
+
+/**
+   Calculate the bridge point when the buffer is not full. The bridge point is passed to the
+   remap routine to indicate the bridge point (see 'adding_data_to_the_Buffer' for more information).
+   \return bridge point index */
+
+STATIC index_t bridgePointNotFull(pbuf_t * bf)
+{
+  priority_t lowestPri;
+
+  lowestPriority(bf, &lowestPri);
+  return headIndex(bf, lowestPri);
+}
+
+/**
+   Remap buffer for a not full buffer for the index of priority
+   passed in.
+   \return VALID_PRIORITY or INVALID_PRIORITY */
+
+STATIC check_t remapNotFull(pbuf_t * bf, index_t newIndex, priority_t priority)
+{
+  check_t returnVal = INVALID_REMAP;
+  index_t insertPt = insertPointNotFull(bf, priority);
+  index_t bridgePt = bridgePointNotFull(bf);
+
+  if((writeHead(bf, newIndex, priority) == VALID_WRITE) &&
+     (setActive(bf, priority) == VALID_ACTIVE))
+    {
+      if(remap(bf, insertPt, bridgePt, newIndex) == VALID_REMAP)
+        {
+          if(tailIndex(bf) != newIndex)
+            {
+              returnVal = VALID_REMAP;
+            }
+          else
+            {
+              if(writeTail(bf, bridgePt) == VALID_INDEX)
+                {
+                  returnVal = VALID_REMAP;
+                }
+            }
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Remap buffer where the buffer is full relevant to the priority
+   passed in.
+   \return VALID_PRIORITY or INVALID_PRIORITY */
+
+STATIC check_t remapFull(pbuf_t * bf, index_t index, priority_t priority)
+{
+  check_t returnVal = INVALID_REMAP;
+  index_t insertPt = insertPointFull(bf, priority);
+  index_t bridgePt = bridgePointFull(bf);
+  index_t lowestPriTailIdx = lowestPriorityTail(bf);
+  priority_t lowestPri;
+
+  if((writeHead(bf, index, priority) == VALID_WRITE) &&
+     (setActive(bf, priority) == VALID_ACTIVE))
+    {
+      if(remap(bf, insertPt, bridgePt, index))
+        {
+          if(index == tailIndex(bf))
+            {
+              if((lowestPriority(bf, &lowestPri) == VALID_PRIORITY) &&
+                 (lowestPri != priority) &&
+                 (lowestPriTailIdx  == tailIndex(bf)))
+                {
+                  setInactive(bf, lowestPri);
+                }
+            }
+
+          // reset tail to possibly new lowest pri
+          if(lowestPriority(bf, &lowestPri) == VALID_PRIORITY)
+            {
+              if(writeTail(bf, headIndex(bf, lowestPri)) == VALID_INDEX)
+                {
+                  returnVal = VALID_REMAP;
+                }
+            }
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Overwrite index without remapping if buffer is full and only
+   a single priority exists on the buffer
+   \return VALID_WRITE or INVALID_WRITE */
+
+STATIC check_t overwriteSinglePriorityIndex(pbuf_t * bf, index_t * index, priority_t priority)
+{
+  check_t returnVal = INVALID_WRITE;
+
+  if(nextTailIndex(bf, index) == VALID_INDEX)
+    {
+      if(writeHead(bf, *index, priority) == VALID_WRITE)
+        {
+          if(activeStatus(bf, priority) == ACTIVE)
+            {
+              incTail(bf);
+            }
+          else
+            {
+              setActive(bf, priority);
+            }
+
+          returnVal = VALID_WRITE;
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Overwrite index since buffer is full and there are no unused elements.
+   \return VALID_WRITE or INVALID_WRITE */
+
+STATIC check_t overwriteElementIndex(pbuf_t * bf, index_t * index, priority_t priority)
+{
+  check_t returnVal = INVALID_WRITE;
+  priority_t priorityCount = activePriorityCount(bf);
+  priority_t lowestPri;
+
+  // the overwritten element is always the oldest of the lowest priority
+  if(lowestPriority(bf, &lowestPri) == VALID_PRIORITY)
+    {
+      if(priorityCount == 1)
+        {
+          returnVal = overwriteSinglePriorityIndex(bf, index, priority);
+        }
+      else
+        {
+          *index = lowestPriorityTail(bf);
+          if(remapFull(bf, *index, priority) == VALID_REMAP)
+            {
+              returnVal = VALID_WRITE;
+            }
+        }
+
+      if(returnVal == VALID_WRITE)
+        {
+          countRemove(bf, lowestPri);
+          STAT(bf, overwrites, lowestPri);
+          countInsert(bf, priority);
+        }
+    }
+
+  return returnVal;
+}
+
+#ifdef PBUF_RUNTIME_SIZE
+
+/**
+   Round the size passed in up to the alignment of the memory passed to PBUF_create().
+   \return aligned size */
+
+STATIC size_t alignedBytes(size_t bytes)
+{
+  return (bytes + PBUF_ALIGNMENT - 1u) & ~(size_t) (PBUF_ALIGNMENT - 1u);
+}
+
+/**
+   Check a runtime buffer configuration against the compile-time maxima.
+   \return non-zero if the configuration may be created */
+
+STATIC int validConfiguration(size_t capacity, size_t priorities, size_t element_size)
+{
+  return (capacity >= 3u) && (capacity <= BUFFER_SIZE) &&
+    (priorities >= 2u) && (priorities <= PRIORITY_SIZE) &&
+    ((element_size == 1u) || (element_size == 2u) || (element_size == 4u) || (element_size == 8u)) &&
+    (element_size <= sizeof(element_t));
+}
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
+//////////////////////////////// payload ////////////////////////////////
+
+#ifdef PAYLOAD_BUFFER
+
+/**
+   Put every arena chunk on the free list and detach all payloads. */
+
+STATIC void resetPayload(pbuf_t * bf)
+{
+  uint32_t count;
+
+  for(count = 0; count < PAYLOAD_CHUNKS; count++)
+    {
+      bf->chunkNext[count] = (chunk_t) (count + 1u);
+    }
+  bf->chunkNext[PAYLOAD_CHUNKS - 1u] = CHUNK_NONE;
+  bf->freeChunk = 0u;
+  bf->freeChunks = PAYLOAD_CHUNKS;
+
+  for(count = 0; count < BUFFER_SIZE; count++)
+    {
+      CHUNK(bf, count) = CHUNK_NONE;
+      LENGTH(bf, count) = 0u;
+    }
+
+  for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
+    {
+      bf->priorityChunks[count] = 0u;
+    }
+}
+
+/**
+   Calculate the number of arena chunks needed by a payload of the length passed in.
+   \return number of chunks */
+
+STATIC uint32_t payloadChunks(size_t length)
+{
+  return (uint32_t) ((length + PAYLOAD_CHUNK_SIZE - 1u) / PAYLOAD_CHUNK_SIZE);
+}
+
+/**
+   Make room for a new element of the priority passed in, with a payload of the number of
+   chunks passed in. The oldest elements of the lowest priority are removed until there is
+   a free cell and enough free chunks; cells reserved or acquired are not free. Only the
+   priorities the overflow policy allows are removed, and nothing is removed unless enough
+   room can be made from them.
+   \return VALID_INSERT, INVALID_INSERT, or DROP_INSERT or REJECT_INSERT from the policy */
+
+STATIC check_t payloadRoom(pbuf_t * bf, uint32_t chunks, priority_t priority)
+{
+  check_t returnVal = VALID_INSERT;
+  uint32_t chunksAvailable = bf->freeChunks;
+  uint32_t cellsAvailable = BUFFER_SIZE - bf->count - bf->detached;
+  priority_t limit = priority;
+  priority_t nextPri;
+  index_t index;
+
+  if((chunksAvailable < chunks) || (cellsAvailable == 0u))
+    {
+      returnVal = overflowLimit(bf, priority, &limit);
+    }
+
+  if((returnVal == VALID_INSERT) &&
+     (lowestPriority(bf, &nextPri) == VALID_PRIORITY))
+    {
+      do
+        {
+          if(nextPri > limit)
+            {
+              break;
+            }
+          chunksAvailable += bf->priorityChunks[nextPri];
+          cellsAvailable += bf->priorityCount[nextPri];
+        } while(nextHighestPriority(bf, &nextPri, nextPri) == VALID_PRIORITY);
+    }
+
+  if((returnVal == VALID_INSERT) &&
+     (chunksAvailable >= chunks) && (cellsAvailable > 0u))
+    {
+      while((bf->freeChunks < chunks) || (bufferFull(bf) == BUFFER_FULL))
+        {
+          if( ! ((lowestPriority(bf, &nextPri) == VALID_PRIORITY) &&
+                 (removeOldestIndex(bf, &index, nextPri) == VALID_ELEMENT)))
+            {
+              returnVal = INVALID_INSERT;
+              break;
+            }
+        }
+    }
+  else if(returnVal == VALID_INSERT)
+    {
+      returnVal = INVALID_INSERT;
+    }
+
+  return returnVal;
+}
+
+/**
+   Copy the payload passed in to chunks taken from the free list, and attach them to the
+   element at the index passed in. There must be enough free chunks.
+   \return VALID_WRITE or INVALID_WRITE */
+
+STATIC check_t writePayload(pbuf_t * bf, index_t index, const uint8_t * payload, payload_size_t length, priority_t priority)
+{
+  check_t returnVal = INVALID_WRITE;
+  uint32_t chunks = payloadChunks(length);
+  payload_size_t offset = 0;
+  payload_size_t piece;
+  chunk_t chunk;
+  chunk_t last = CHUNK_NONE;
+
+  if(chunks <= bf->freeChunks)
+    {
+      CHUNK(bf, index) = CHUNK_NONE;
+      LENGTH(bf, index) = length;
+      bf->priorityChunks[priority] = (chunk_t) (bf->priorityChunks[priority] + chunks);
+      bf->freeChunks = (chunk_t) (bf->freeChunks - chunks);
+
+      while(offset < length)
+        {
+          chunk = bf->freeChunk;
+          bf->freeChunk = bf->chunkNext[chunk];
+          bf->chunkNext[chunk] = CHUNK_NONE;
+
+          piece = (payload_size_t) (length - offset);
+          if(piece > PAYLOAD_CHUNK_SIZE)
+            {
+              piece = PAYLOAD_CHUNK_SIZE;
+            }
+          memcpy(bf->arena[chunk], &payload[offset], piece);
+          offset = (payload_size_t) (offset + piece);
+
+          if(last == CHUNK_NONE)
+            {
+              CHUNK(bf, index) = chunk;
+            }
+          else
+            {
+              bf->chunkNext[last] = chunk;
+            }
+          last = chunk;
+        }
+
+      returnVal = VALID_WRITE;
+    }
+
+  return returnVal;
+}
+
+/**
+   Copy the payload of the element at the index passed in to the memory passed in, which
+   must hold the whole payload. */
+
+STATIC void readPayload(pbuf_t * bf, index_t index, uint8_t * payload)
+{
+  payload_size_t offset = 0;
+  payload_size_t piece;
+  chunk_t chunk = CHUNK(bf, index);
+
+  while(chunk != CHUNK_NONE)
+    {
+      piece = (payload_size_t) (LENGTH(bf, index) - offset);
+      if(piece > PAYLOAD_CHUNK_SIZE)
+        {
+          piece = PAYLOAD_CHUNK_SIZE;
+        }
+      memcpy(&payload[offset], bf->arena[chunk], piece);
+      offset = (payload_size_t) (offset + piece);
+      chunk = bf->chunkNext[chunk];
+    }
+}
+
+/**
+   Return the payload chunks of the element at the index passed in, of the priority passed
+   in, to the free list. */
+
+STATIC void releasePayload(pbuf_t * bf, index_t index, priority_t priority)
+{
+  chunk_t chunk = CHUNK(bf, index);
+  chunk_t next;
+
+  while(chunk != CHUNK_NONE)
+    {
+      next = bf->chunkNext[chunk];
+      bf->chunkNext[chunk] = bf->freeChunk;
+      bf->freeChunk = chunk;
+      bf->freeChunks++;
+      bf->priorityChunks[priority]--;
+      chunk = next;
+    }
+
+  CHUNK(bf, index) = CHUNK_NONE;
+  LENGTH(bf, index) = 0u;
+}
+
+#endif  /* PAYLOAD_BUFFER */
+
+//////////////////////////////// staging ////////////////////////////////
+
+#ifdef PBUF_SPSC
+
+/**
+   Empty the staging ring. Neither thread may be using the buffer. */
+
+STATIC void resetStage(pbuf_t * bf)
+{
+  atomic_store_explicit(&bf->stage.write, 0u, memory_order_relaxed);
+  atomic_store_explicit(&bf->stage.read, 0u, memory_order_relaxed);
+}
+
+/**
+   Place an element in the staging ring, called by the producer only. The cell is written
+   before the write counter is released, so the consumer never sees a partly written cell.
+   \return VALID_INSERT or INVALID_INSERT */
+
+STATIC check_t stageInsert(pbuf_t * bf, element_t element, priority_t priority)
+{
+  check_t returnVal = INVALID_INSERT;
+  uint_fast32_t write = atomic_load_explicit(&bf->stage.write, memory_order_relaxed);
+  uint_fast32_t read = atomic_load_explicit(&bf->stage.read, memory_order_acquire);
+
+  if((validatePriority(bf, priority) == VALID_PRIORITY) &&
+     ((uint32_t) (write - read) < PBUF_STAGE_SIZE))
+    {
+      bf->stage.element[write % PBUF_STAGE_SIZE] = element;
+      bf->stage.priority[write % PBUF_STAGE_SIZE] = priority;
+      atomic_store_explicit(&bf->stage.write, (uint32_t) (write + 1u), memory_order_release);
+      returnVal = VALID_INSERT;
+    }
+
+  return returnVal;
+}
+
+/**
+   Move every staged element into the buffer in the order it was staged, called by the
+   consumer only. The read counter is released once the cells have been read, handing
+   them back to the producer. */
+
+STATIC void drainStage(pbuf_t * bf)
+{
+  uint_fast32_t read = atomic_load_explicit(&bf->stage.read, memory_order_relaxed);
+  uint_fast32_t write = atomic_load_explicit(&bf->stage.write, memory_order_acquire);
+
+  if(read != write)
+    {
+      for(; read != write; read = (uint32_t) (read + 1u))
+        {
+          insert(bf, bf->stage.element[read % PBUF_STAGE_SIZE], bf->stage.priority[read % PBUF_STAGE_SIZE]);
+        }
+
+      atomic_store_explicit(&bf->stage.read, read, memory_order_release);
+    }
+}
+
+#elif defined(PBUF_MPSC)
+
+/**
+   Empty every lane. No thread may be using the buffer. */
+
+STATIC void resetStage(pbuf_t * bf)
+{
+  uint32_t lane;
+  uint32_t cell;
+
+  for(lane = 0; lane < PRIORITY_SIZE; lane++)
+    {
+      atomic_store_explicit(&bf->stage.lane[lane].write, 0u, memory_order_relaxed);
+      bf->stage.lane[lane].read = 0u;
+      for(cell = 0; cell < PBUF_STAGE_SIZE; cell++)
+        {
+          atomic_store_explicit(&bf->stage.lane[lane].cell[cell].sequence, cell, memory_order_relaxed);
+        }
+    }
+
+  for(lane = 0; lane < STAGE_WORDS; lane++)
+    {
+      atomic_store_explicit(&bf->stage.active[lane], 0u, memory_order_relaxed);
+    }
+}
+
+/**
+   Place an element in the lane of its priority, called by any producer. A producer claims the
+   next cell by moving the write counter on with a compare and swap, writes the element, then
+   releases the cell's sequence so the consumer never sees a partly written cell. The lane's
+   activity bit is set last.
+   \return VALID_INSERT or INVALID_INSERT */
+
+STATIC check_t stageInsert(pbuf_t * bf, element_t element, priority_t priority)
+{
+  check_t returnVal = INVALID_INSERT;
+  check_t searching = VALID_PRIORITY;
+  lane_t * lane;
+  lane_cell_t * cell = NULL;
+  uint_fast32_t write;
+  int32_t turn;
+
+  if(validatePriority(bf, priority) == VALID_PRIORITY)
+    {
+      lane = &bf->stage.lane[priority];
+      write = atomic_load_explicit(&lane->write, memory_order_relaxed);
+      while(searching == VALID_PRIORITY)
+        {
+          cell = &lane->cell[write % PBUF_STAGE_SIZE];
+          turn = (int32_t) (uint32_t) (atomic_load_explicit(&cell->sequence, memory_order_acquire) - write);
+          if(turn == 0)
+            {
+              // the cell is free; claim it unless another producer got there first
+              if(atomic_compare_exchange_weak_explicit(&lane->write, &write, (uint32_t) (write + 1u),
+                                                       memory_order_relaxed, memory_order_relaxed))
+                {
+                  returnVal = VALID_INSERT;
+                  searching = INVALID_PRIORITY;
+                }
+            }
+          else if(turn < 0)
+            {
+              // the cell still holds an element from the last time round, so the lane is full
+              searching = INVALID_PRIORITY;
+            }
+          else
+            {
+              write = atomic_load_explicit(&lane->write, memory_order_relaxed);
+            }
+        }
+
+      if(returnVal == VALID_INSERT)
+        {
+          cell->element = element;
+          atomic_store_explicit(&cell->sequence, (uint32_t) (write + 1u), memory_order_release);
+          atomic_fetch_or_explicit(&bf->stage.active[priority / 64u], (uint64_t) 1u << (priority % 64u),
+                                   memory_order_release);
+        }
+    }
+
+  return returnVal;
+}
+
+/**
+   Move the elements of one lane into the buffer in the order they were claimed, up to one lane
+   full, called by the consumer only. Each cell is handed back to the producers as soon as it is
+   read. */
+
+STATIC void drainLane(pbuf_t * bf, priority_t priority)
+{
+  lane_t * lane = &bf->stage.lane[priority];
+  lane_cell_t * cell = &lane->cell[lane->read % PBUF_STAGE_SIZE];
+  uint32_t count;
+
+  for(count = 0;
+      (count < PBUF_STAGE_SIZE) &&
+        ((uint32_t) atomic_load_explicit(&cell->sequence, memory_order_acquire) == (uint32_t) (lane->read + 1u));
+      count++)
+    {
+      insert(bf, cell->element, priority);
+      atomic_store_explicit(&cell->sequence, (uint32_t) (lane->read + PBUF_STAGE_SIZE), memory_order_release);
+      lane->read++;
+      cell = &lane->cell[lane->read % PBUF_STAGE_SIZE];
+    }
+}
+
+/**
+   Move the elements of every active lane into the buffer, highest priority first, called by
+   the consumer only. */
+
+STATIC void drainStage(pbuf_t * bf)
+{
+  uint64_t active;
+  uint32_t word;
+  uint32_t bit;
+
+  for(word = STAGE_WORDS; word-- > 0u; )
+    {
+      if(atomic_load_explicit(&bf->stage.active[word], memory_order_relaxed))
+        {
+          active = atomic_exchange_explicit(&bf->stage.active[word], 0u, memory_order_acquire);
+          for(bit = 64u; active; )
+            {
+              bit--;
+              if((active >> bit) & 1u)
+                {
+                  active &= ~((uint64_t) 1u << bit);
+                  drainLane(bf, (priority_t) ((word * 64u) + bit));
+                }
+            }
+        }
+    }
+}
+
+#endif  /* PBUF_SPSC */
+
+//////////////////////////////// waiting ////////////////////////////////
+
+#ifdef PBUF_WAIT
+
+/**
+   Initialise the lock and the condition variables of the buffer passed in, with no thread
+   waiting. The condition variables time out against the monotonic clock, so a change to the
+   time of day does not stretch or cut short a wait.
+   \return VALID_RESET or INVALID_RESET */
+
+STATIC check_t resetWait(pbuf_t * bf)
+{
+  check_t returnVal = INVALID_RESET;
+  pthread_condattr_t attr;
+  uint32_t priority;
+
+  if(pthread_condattr_init(&attr) == 0)
+    {
+      if((pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) == 0) &&
+         (pthread_mutex_init(&bf->wait.lock, NULL) == 0))
+        {
+          returnVal = VALID_RESET;
+          for(priority = LOW_PRI; priority < PRIORITY_SIZE; priority++)
+            {
+              bf->wait.waiting[priority] = 0u;
+              if(pthread_cond_init(&bf->wait.ready[priority], &attr) != 0)
+                {
+                  returnVal = INVALID_RESET;
+                }
+            }
+        }
+      pthread_condattr_destroy(&attr);
+    }
+  bf->wait.waiters = 0u;
+
+  return returnVal;
+}
+
+/**
+   Wake the threads waiting for an element of the priority passed in or lower, called with the
+   buffer locked after an insert. Threads waiting for a higher priority are left asleep. */
+
+STATIC void wakeWaiters(pbuf_t * bf, priority_t priority)
+{
+  uint32_t waiting;
+
+  if(bf->wait.waiters > 0u)
+    {
+      for(waiting = LOW_PRI; waiting <= priority; waiting++)
+        {
+          if(bf->wait.waiting[waiting] > 0u)
+            {
+              pthread_cond_broadcast(&bf->wait.ready[waiting]);
+            }
+        }
+    }
+}
+
+/**
+   Check whether the next element to be retrieved is of at least the priority passed in.
+   \return VALID_PRIORITY or INVALID_PRIORITY */
+
+STATIC check_t readyFor(pbuf_t * bf, priority_t priority)
+{
+  check_t returnVal = INVALID_PRIORITY;
+  priority_t servedPri;
+
+  if((servedPriority(bf, &servedPri) == VALID_PRIORITY) && (servedPri >= priority))
+    {
+      returnVal = VALID_PRIORITY;
+    }
+
+  return returnVal;
+}
+
+/**
+   Set the deadline passed in to timeout_ns nanoseconds from now on the monotonic clock. */
+
+STATIC void waitDeadline(struct timespec * deadline, uint64_t timeout_ns)
+{
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_sec += (time_t) (timeout_ns / 1000000000u);
+  deadline->tv_nsec += (long) (timeout_ns % 1000000000u);
+  if(deadline->tv_nsec >= 1000000000L)
+    {
+      deadline->tv_sec++;
+      deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+#endif  /* PBUF_WAIT */
+
+//////////////////////////////// aging ////////////////////////////////
+
+#ifdef PBUF_AGING
+
+/**
+   Check the age of one run below the highest priority, and promote it if it has reached the
+   threshold. Each call checks the next lower active priority to the one checked last, starting
+   again below the highest, so each run is checked at least once in as many retrievals as there
+   are active priorities, at the cost of one bit scan per retrieval. */
+
+STATIC void ageRuns(pbuf_t * bf)
+{
+  check_t found = INVALID_PRIORITY;
+  priority_t highestPri;
+  priority_t priority;
+
+  if((bf->aging.threshold > 0u) &&
+     (highestPriority(bf, &highestPri) == VALID_PRIORITY))
+    {
+      if(bf->aging.cursor < highestPri)
+        {
+          found = nextLowerPriority(bf, &priority, bf->aging.cursor);
+        }
+      if(found != VALID_PRIORITY)
+        {
+          found = nextLowerPriority(bf, &priority, highestPri);
+        }
+
+      if(found == VALID_PRIORITY)
+        {
+          bf->aging.cursor = priority;
+          if((uint32_t) (PBUF_AGING_NOW(bf) - bf->aging.stamp[priority]) >= bf->aging.threshold)
+            {
+              promoteRun(bf, priority);
+            }
+        }
+    }
+}
+
+/**
+   Promote the whole run of the priority passed in, which is below the highest active priority,
+   to the next priority up. Runs lie in the ring in priority order, so the run already follows that
+   of the next priority up, or the next higher active priority if that one is inactive. Its elements
+   join the end of the next priority's run by moving that priority's head to the run's newest cell,
+   and no link is rewritten. A newly active priority starts ageing from now. */
+
+STATIC void promoteRun(pbuf_t * bf, priority_t priority)
+{
+  priority_t target = (priority_t) (priority + 1u);
+
+  writeHead(bf, headIndex(bf, priority), target);
+  if(activeStatus(bf, target) == INACTIVE)
+    {
+      setActive(bf, target);
+      bf->aging.stamp[target] = PBUF_AGING_NOW(bf);
+    }
+  setInactive(bf, priority);
+
+  bf->priorityCount[target] += bf->priorityCount[priority];
+  bf->priorityCount[priority] = 0u;
+#ifdef PBUF_STATISTICS
+  if(bf->priorityCount[target] > bf->stats.priorityHighWater[target])
+    {
+      bf->stats.priorityHighWater[target] = bf->priorityCount[target];
+    }
+#endif  /* PBUF_STATISTICS */
+#ifdef PAYLOAD_BUFFER
+  bf->priorityChunks[target] += bf->priorityChunks[priority];
+  bf->priorityChunks[priority] = 0u;
+#endif  /* PAYLOAD_BUFFER */
+}
+
+/**
+   Note that an element of the priority passed in has been retrieved, so its run is served. */
+
+STATIC void served(pbuf_t * bf, priority_t priority)
+{
+  bf->aging.clock++;
+  bf->aging.stamp[priority] = PBUF_AGING_NOW(bf);
+}
+
+#endif  /* PBUF_AGING */
+
+//////////////////////////////// scheduling ////////////////////////////////
+
+#if defined(PBUF_SCHEDULER) || defined(PBUF_WAIT) || defined(PAYLOAD_BUFFER)
+
+/**
+   Find the priority of the next element to be retrieved. In strict priority order it is the
+   highest active priority. Under a weighted policy it is the current priority while its turn
+   lasts, and then the priority whose turn nextTurn() starts.
+   \return VALID_PRIORITY or INVALID_PRIORITY */
+
+STATIC check_t servedPriority(pbuf_t * bf, priority_t * priority)
+{
+  check_t returnVal = INVALID_PRIORITY;
+#ifdef PBUF_SCHEDULER
+  priority_t current = bf->schedule.current;
+#endif  /* PBUF_SCHEDULER */
+
+  if(highestPriority(bf, priority) == VALID_PRIORITY)
+    {
+#ifdef PBUF_SCHEDULER
+      if(bf->schedule.policy != PBUF_STRICT_PRIORITY)
+        {
+          if((activeStatus(bf, current) == ACTIVE) && (bf->schedule.credit[current] > 0))
+            {
+              *priority = current;
+            }
+          else
+            {
+              *priority = nextTurn(bf, current);
+            }
+        }
+#endif  /* PBUF_SCHEDULER */
+      returnVal = VALID_PRIORITY;
+    }
+
+  return returnVal;
+}
+
+#endif  /* PBUF_SCHEDULER || PBUF_WAIT || PAYLOAD_BUFFER */
+
+#if (defined(PBUF_SCHEDULER) && ! defined(EXTERNAL_DATA_BUFFER)) || defined(PAYLOAD_BUFFER)
+
+/**
+   Find the cell of the next element to be retrieved, and its priority.
+   \return VALID_INDEX or INVALID_INDEX */
+
+STATIC check_t firstIndex(pbuf_t * bf, index_t * index, priority_t * priority)
+{
+  check_t returnVal = INVALID_INDEX;
+
+  if(servedPriority(bf, priority) == VALID_PRIORITY)
+    {
+      returnVal = nextIndex(bf, index, runBefore(bf, *priority));
+    }
+
+  return returnVal;
+}
+
+#endif  /* (PBUF_SCHEDULER && ! EXTERNAL_DATA_BUFFER) || PAYLOAD_BUFFER */
+
+#ifdef PBUF_SCHEDULER
+
+/**
+   Read the oldest element of the priority whose turn it is, wherever it lies in the buffer,
+   modify index to refer to it and priority to its priority, and charge it to that priority.
+   \return VALID_ELEMENT or INVALID_ELEMENT */
+
+STATIC check_t readServedIndex(pbuf_t * bf, index_t * index, priority_t * priority)
+{
+  check_t returnVal = INVALID_ELEMENT;
+
+  if((servedPriority(bf, priority) == VALID_PRIORITY) &&
+     (unlinkOldestIndex(bf, index, *priority) == VALID_ELEMENT))
+    {
+      charge(bf, *priority, *index);
+      STAT(bf, retrieves, *priority);
+#ifdef PBUF_AGING
+      served(bf, *priority);
+#endif  /* PBUF_AGING */
+#ifdef PAYLOAD_BUFFER
+      releasePayload(bf, *index, *priority);
+#endif  /* PAYLOAD_BUFFER */
+      returnVal = VALID_ELEMENT;
+    }
+
+  return returnVal;
+}
+
+/**
+   Find the priority whose turn follows that of the priority passed in: the next lower active
+   priority, or the highest once the lowest has had its turn.
+   \return the priority whose turn is next */
+
+STATIC priority_t followingTurn(pbuf_t * bf, priority_t priority)
+{
+  if(nextLowerPriority(bf, &priority, priority) != VALID_PRIORITY)
+    {
+      highestPriority(bf, &priority);
+    }
+
+  return priority;
+}
+
+/**
+   Start the turn of the priority after the one passed in. A turn adds the priority's weight to
+   its credit, and a priority still in debt after that sits the turn out, so the turn passes on.
+   Rather than passing the turn round until a debt is paid, one walk of the active priorities
+   finds the fewest whole rounds any of them must sit out, and a second adds the weights of
+   those rounds to each, so the work is bounded by the number of active priorities and not by
+   the debts run up.
+   \return the priority whose turn it is */
+
+STATIC priority_t nextTurn(pbuf_t * bf, priority_t priority)
+{
+  priority_t first = followingTurn(bf, priority);
+  priority_t turn = first;
+  int64_t fewest = INT64_MAX;
+  int64_t rounds;
+  int64_t credit;
+
+  // the first to come out of debt, in the order the turn passes, takes it
+  priority = first;
+  do
+    {
+      credit = bf->schedule.credit[priority];
+      rounds = ((credit > 0) ? 0 : -credit) / (int64_t) bf->schedule.weight[priority];
+      if(rounds < fewest)
+        {
+          fewest = rounds;
+          turn = priority;
+        }
+      priority = followingTurn(bf, priority);
+    } while(priority != first);
+
+  // it and those before it in the last round have one more turn than the rest
+  rounds = fewest + 1;
+  do
+    {
+      if(rounds > 0)
+        {
+          // credit left by a run that emptied is not carried
+          credit = bf->schedule.credit[priority];
+          credit = ((credit > 0) ? 0 : credit) + (rounds * (int64_t) bf->schedule.weight[priority]);
+          bf->schedule.credit[priority] = (int32_t) credit;
+        }
+      if(priority == turn)
+        {
+          rounds = fewest;
+        }
+      priority = followingTurn(bf, priority);
+    } while(priority != first);
+
+  bf->schedule.current = turn;
+
+  return turn;
+}
+
+/**
+   Charge the element just retrieved from the index passed in to its priority's credit. Each
+   element costs one, or its payload length in bytes under deficit round-robin. The whole of
+   any debt is carried, and paid off by the turns the priority sits out, so over many turns
+   each priority gets its weight's share of elements or bytes. An emptied run loses the rest
+   of its turn. */
+
+STATIC void charge(pbuf_t * bf, priority_t priority, index_t index)
+{
+  int64_t credit = bf->schedule.credit[priority];
+  int64_t cost = 1;
+
+#ifdef PAYLOAD_BUFFER
+  if((bf->schedule.policy == PBUF_DEFICIT_ROUND_ROBIN) && (LENGTH(bf, index) > 1u))
+    {
+      cost = (int64_t) LENGTH(bf, index);
+    }
+#else
+  (void) index;
+#endif  /* PAYLOAD_BUFFER */
+
+  credit -= cost;
+  if(credit < INT32_MIN)
+    {
+      credit = INT32_MIN;
+    }
+  if((bf->priorityCount[priority] == 0u) && (credit > 0))
+    {
+      credit = 0;
+    }
+
+  bf->schedule.credit[priority] = (int32_t) credit;
+}
+
+#ifndef EXTERNAL_DATA_BUFFER
+
+/**
+   Read up to max elements in the order the scheduler serves them, passing back the priority
+   of each if priorities is not NULL. Each element is unlinked on its own, as by
+   PBUF_retrieve(), since the runs are not read in buffer order.
+   \return number of elements read */
+
+STATIC size_t readServed(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max)
+{
+  size_t returnVal = 0;
+  index_t index;
+  priority_t priority;
+
+#ifdef PBUF_AGING
+  ageRuns(bf);
+#endif  /* PBUF_AGING */
+  while((returnVal < max) &&
+        (readServedIndex(bf, &index, &priority) == VALID_ELEMENT))
+    {
+      readData(bf, &elements[returnVal], index);
+      if(priorities != NULL)
+        {
+          priorities[returnVal] = priority;
+        }
+      returnVal++;
+    }
+
+  return returnVal;
+}
+
+/**
+   Copy the next element the scheduler serves, and its priority if priorities is not NULL,
+   without removing it. The turn it is served in may be started, as the retrieve would.
+   Later elements depend on the credit the first one spends, so only the first is copied.
+   \return number of elements copied */
+
+STATIC size_t peekServed(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max)
+{
+  size_t returnVal = 0;
+  index_t index;
+  priority_t priority;
+
+  if((max > 0u) && (firstIndex(bf, &index, &priority) == VALID_INDEX))
+    {
+      readData(bf, elements, index);
+      if(priorities != NULL)
+        {
+          *priorities = priority;
+        }
+      returnVal = 1u;
+    }
+
+  return returnVal;
+}
+
+/**
+   Detach the cell of the next element the scheduler serves, as detachFirst() does for the
+   oldest element of the highest priority. The element is read as for a retrieve. Read from the
+   front of the buffer its cell becomes the tail, and the old tail takes its place; otherwise
+   its cell is left as the first free cell, and detached as one.
+   \return VALID_ELEMENT or INVALID_ELEMENT */
+
+STATIC check_t detachServed(pbuf_t * bf, index_t * index, priority_t * priority)
+{
+  check_t returnVal = INVALID_ELEMENT;
+  index_t tail = tailIndex(bf);
+  index_t after;
+
+  if(readServedIndex(bf, index, priority) == VALID_ELEMENT)
+    {
+      if((tailIndex(bf) == *index) && (tail != *index))
+        {
+          nextIndex(bf, &after, *index);
+          writeNextIndex(bf, tail, after);
+          writeTail(bf, tail);
+          bf->detached++;
+          returnVal = VALID_ELEMENT;
+        }
+      else if((detachFree(bf, &after) == VALID_INDEX) && (after == *index))
+        {
+          returnVal = VALID_ELEMENT;
+        }
+    }
+
+  return returnVal;
+}
+
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+
+#endif  /* PBUF_SCHEDULER */
+
+//////////////////////////////// events ////////////////////////////////
+
+#ifdef PBUF_EVENTFD
+
+/**
+   Open the readable eventfd of the buffer passed in, and mark the buffer empty for the readiness
+   check of its first reset. The writable one is opened on demand by PBUF_writableFd(), so
+   buffers that never throttle a producer do not pay for it.
+   \return VALID_RESET if the eventfd is open */
+
+STATIC check_t openFds(pbuf_t * bf)
+{
+  check_t returnVal = INVALID_RESET;
+
+  bf->readableFd = eventfd(0u, EFD_NONBLOCK | EFD_CLOEXEC);
+  bf->writableFd = -1;
+  bf->readiness = 0u;
+
+  // PBUF_reset() notes the readiness on entry, before it has reset the buffer
+  bf->count = 0u;
+  bf->detached = 0u;
+  memset(&bf->activity, 0, sizeof(bf->activity));
+  if(bf->readableFd >= 0)
+    {
+      returnVal = VALID_RESET;
+    }
+
+  return returnVal;
+}
+
+/**
+   \return READY_NOT_EMPTY and READY_NOT_FULL as they apply to the buffer passed in */
+
+STATIC uint8_t readiness(pbuf_t * bf)
+{
+  uint8_t returnVal = 0u;
+
+  if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
+    {
+      returnVal |= READY_NOT_EMPTY;
+    }
+
+  if(bufferFull(bf) == BUFFER_NOT_FULL)
+    {
+      returnVal |= READY_NOT_FULL;
+    }
+
+  return returnVal;
+}
+
+/**
+   Note the readiness of the buffer passed in on entry to a critical region. */
+
+STATIC void markReadiness(pbuf_t * bf)
+{
+  bf->readiness = readiness(bf);
+}
+
+/**
+   Write to the eventfd of each transition the buffer passed in has made since its critical region
+   was entered - empty to non-empty, or full to not full. An insert into a buffer that already held
+   elements, or an overwrite of a full buffer, makes no transition and so no system call. */
+
+STATIC void signalReadiness(pbuf_t * bf)
+{
+  uint64_t one = 1u;
+  uint8_t raised = (uint8_t) (readiness(bf) & ~bf->readiness);
+
+  if((raised & READY_NOT_EMPTY) && (bf->readableFd >= 0))
+    {
+      (void) ! write(bf->readableFd, &one, sizeof(one));
+    }
+
+  if((raised & READY_NOT_FULL) && (bf->writableFd >= 0))
+    {
+      (void) ! write(bf->writableFd, &one, sizeof(one));
+    }
+}
+
+#endif  /* PBUF_EVENTFD */
+
+//////////////////////////////// shards ////////////////////////////////
+
+#ifdef PBUF_SHARDS
+
+/**
+   Take the spinlock of the shard passed in, calling PBUF_SPIN_WAIT() while another thread holds it. */
+
+STATIC void lockShard(pbuf_shard_t * shard)
+{
+  while(atomic_flag_test_and_set_explicit(&shard->lock, memory_order_acquire))
+    {
+      PBUF_SPIN_WAIT();
+    }
+}
+
+/**
+   Give up the spinlock of the shard passed in. */
+
+STATIC void unlockShard(pbuf_shard_t * shard)
+{
+  atomic_flag_clear_explicit(&shard->lock, memory_order_release);
+}
+
+/**
+   Publish the highest priority of the shard passed in after a change to its buffer, called with
+   the shard locked. The summary word is shared by every thread, so its bit is only written when
+   the shard turns empty or non-empty, not on every insert and retrieve. */
+
+STATIC void publishShard(pbuf_sharded_t * sb, uint32_t shard)
+{
+  priority_t priority;
+  unsigned top = 0u;
+  unsigned previous = atomic_load_explicit(&sb->shard[shard].top, memory_order_relaxed);
+
+  if(highestPriority(&sb->shard[shard].bf, &priority) == VALID_PRIORITY)
+    {
+      top = (unsigned) priority + 1u;
+    }
+
+  atomic_store_explicit(&sb->shard[shard].top, top, memory_order_relaxed);
+  if((previous == 0u) && (top != 0u))
+    {
+      atomic_fetch_or_explicit(&sb->summary, (uint64_t) 1u << shard, memory_order_relaxed);
+    }
+  else if((previous != 0u) && (top == 0u))
+    {
+      atomic_fetch_and_explicit(&sb->summary, ~((uint64_t) 1u << shard), memory_order_relaxed);
+    }
+}
+
+/**
+   Choose the shard to retrieve from for the thread owning the shard passed in - its own shard,
+   unless another non-empty shard holds a higher priority. Only the shards flagged in the summary
+   word are looked at, from the thread's own shard round, so that threads finding the same priority
+   in several shards spread out rather than all taking from the lowest numbered. The search stops
+   early at the highest priority. The shards are not locked, so the choice may be out of date by
+   the time the thread locks the shard chosen.
+   \return shard, or PBUF_SHARDS if every shard is empty */
+
+STATIC uint32_t chooseShard(pbuf_sharded_t * sb, uint32_t shard)
+{
+  uint32_t returnVal = PBUF_SHARDS;
+  uint64_t busy = atomic_load_explicit(&sb->summary, memory_order_relaxed);
+  unsigned best = 0u;
+  unsigned top;
+  uint32_t bit;
+
+  // rotate the summary so that the thread's own shard is bit zero
+  if(shard > 0u)
+    {
+      busy = (busy >> shard) | (busy << (64u - shard));
+    }
+
+  while(busy)
+    {
+#ifdef PBUF_BUILTINS
+      bit = (uint32_t) __builtin_ctzll(busy);
+#else
+      for(bit = 0; ! ((busy >> bit) & 1u); bit++)
+        {
+        }
+#endif  /* PBUF_BUILTINS */
+      busy &= busy - 1u;
+
+      top = atomic_load_explicit(&sb->shard[(shard + bit) % 64u].top, memory_order_relaxed);
+      if(top > best)
+        {
+          best = top;
+          returnVal = (shard + bit) % 64u;
+          if(best == PRIORITY_SIZE)
+            {
+              busy = 0u;
+            }
+        }
+    }
+
+  return returnVal;
+}
+
+#endif  /* PBUF_SHARDS */
+
+/** @} */
+/* end of Internal group */
+
+//////////////////////////////// Exposed API ////////////////////////////////
+
+/**
+   @defgroup API API
+   This is the exposed API
+   @{ */
+
+#ifdef PBUF_RUNTIME_SIZE
+
+/**
+   Return the number of bytes of memory PBUF_create() needs for a buffer of the
+   capacity and element size passed in. This covers the pbuf_t, the cells, the detach map and the data.
+   \return number of bytes, or zero for an invalid configuration */
+
+size_t PBUF_requiredBytes(size_t capacity, size_t element_size)
+{
+  size_t returnVal = 0;
+
+  if(validConfiguration(capacity, 2u, element_size))
+    {
+      returnVal = alignedBytes(sizeof(pbuf_t)) + alignedBytes(capacity * sizeof(cell_t));
+
+#ifndef EXTERNAL_DATA_BUFFER
+
+      returnVal += alignedBytes(DETACH_MAP_WORDS(capacity) * sizeof(uint32_t));
+      returnVal += capacity * element_size;
+
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+    }
+
+  return returnVal;
+}
+
+/**
+   Create a buffer instance in the caller-owned memory passed in, sized at run time.
+   The memory must be aligned to PBUF_ALIGNMENT bytes and at least PBUF_requiredBytes()
+   long, and must stay valid while the instance is in use. Capacity, priorities and
+   element size may not exceed BUFFER_SIZE, PRIORITY_SIZE and ELEMENT_SIZE.
+   \return the initialised instance, or NULL if the memory or configuration is invalid */
+
+pbuf_t * PBUF_create(void * mem, size_t bytes, size_t capacity, size_t priorities, size_t element_size)
+{
+  pbuf_t * returnVal = NULL;
+  pbuf_t * bf = (pbuf_t *) mem;
+  size_t required = PBUF_requiredBytes(capacity, element_size);
+  check_t ready = VALID_RESET;
+
+  if((mem != NULL) &&
+     (((uintptr_t) mem % PBUF_ALIGNMENT) == 0u) &&
+     validConfiguration(capacity, priorities, element_size) &&
+     (bytes >= required))
+    {
+      bf->element = (cell_t *) ((uint8_t *) mem + alignedBytes(sizeof(pbuf_t)));
+#ifdef EXTERNAL_DATA_BUFFER
+      bf->data = (uint8_t *) bf->element + alignedBytes(capacity * sizeof(cell_t));
+#else
+      bf->detachMap = (uint32_t *) ((uint8_t *) bf->element + alignedBytes(capacity * sizeof(cell_t)));
+      bf->data = (uint8_t *) bf->detachMap + alignedBytes(DETACH_MAP_WORDS(capacity) * sizeof(uint32_t));
+#endif  /* EXTERNAL_DATA_BUFFER */
+      bf->capacity = (count_t) capacity;
+      bf->priorities = (uint16_t) priorities;
+      bf->elementSize = (uint8_t) element_size;
+      bf->overflow = overflowOverwrite;
+      bf->generation = 0u;
+#ifdef PBUF_AGING
+      memset(&bf->aging, 0, sizeof(bf->aging));
+#endif  /* PBUF_AGING */
+#ifdef PBUF_SCHEDULER
+      memset(&bf->schedule, 0, sizeof(bf->schedule));
+#endif  /* PBUF_SCHEDULER */
+#ifdef PBUF_CRITICAL_SPINLOCK
+      atomic_flag_clear_explicit(&bf->critical, memory_order_relaxed);
+#endif  /* PBUF_CRITICAL_SPINLOCK */
+
+#ifdef PBUF_WAIT
+      ready = resetWait(bf);
+#endif  /* PBUF_WAIT */
+#ifdef PBUF_EVENTFD
+      if(ready == VALID_RESET)
+        {
+          ready = openFds(bf);
+        }
+#endif  /* PBUF_EVENTFD */
+      if((ready == VALID_RESET) && (PBUF_reset(bf) == 0))
+        {
+#ifdef PBUF_STATISTICS
+          PBUF_resetStatistics(bf);
+#endif  /* PBUF_STATISTICS */
+          returnVal = bf;
+        }
+    }
+
+  return returnVal;
+}
+
+#else
+
+/**
+   Initialise a caller-owned buffer instance. Must be called before any other
+   API command is applied to the instance. No memory is allocated; all state
+   lives in the pbuf_t passed in.
+   \return zero on successful initialisation */
+
+int PBUF_init(pbuf_t * bf)
+{
+  int returnVal = 1;
+  check_t ready = VALID_RESET;
+
+  bf->overflow = overflowOverwrite;
+  bf->generation = 0u;
+#ifdef PBUF_AGING
+  memset(&bf->aging, 0, sizeof(bf->aging));
+#endif  /* PBUF_AGING */
+#ifdef PBUF_SCHEDULER
+  memset(&bf->schedule, 0, sizeof(bf->schedule));
+#endif  /* PBUF_SCHEDULER */
+#ifdef PBUF_CRITICAL_SPINLOCK
+  atomic_flag_clear_explicit(&bf->critical, memory_order_relaxed);
+#endif  /* PBUF_CRITICAL_SPINLOCK */
+#ifdef PBUF_WAIT
+  ready = resetWait(bf);
+#endif  /* PBUF_WAIT */
+#ifdef PBUF_EVENTFD
+  if(ready == VALID_RESET)
+    {
+      ready = openFds(bf);
+    }
+#endif  /* PBUF_EVENTFD */
+  if(ready == VALID_RESET)
+    {
+      returnVal = PBUF_reset(bf);
+#ifdef PBUF_STATISTICS
+      PBUF_resetStatistics(bf);
+#endif  /* PBUF_STATISTICS */
+    }
+
+  return returnVal;
+}
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
+/**
+   Reset Buffer.
+   \return zero on successful reset */
+
+int PBUF_reset(pbuf_t * bf)
+{
+  int returnVal;
+
+  ENTER_REGION(bf);
+  returnVal = ! ((resetBufferPointers(bf) == VALID_RESET) &&
+                 (resetBuffer(bf) == VALID_RESET));
+  EXIT_REGION(bf);
+
+  return returnVal;
+}
+
+/**
+   Select what an insert into the full buffer passed in does: PBUF_OVERWRITE_LOWEST,
+   PBUF_DROP_INCOMING, PBUF_REJECT_INCOMING or PBUF_EVICT_OLDEST. PBUF_init() and PBUF_create()
+   select PBUF_OVERWRITE_LOWEST; any other policy is selected once, straight after. The policy
+   is held as a handler that only inserts into a full buffer call, so other inserts do not test it.
+   It governs PBUF_insert(), PBUF_insertBatch(), PBUF_insertIndex(), PBUF_insertPayload() and
+   PBUF_reserve().
+   \return zero for a valid policy */
+
+int PBUF_setOverflow(pbuf_t * bf, unsigned policy)
+{
+  static check_t (* const handler[])(pbuf_t * bf, index_t * index, priority_t priority) =
+    {overflowOverwrite, overflowDrop, overflowReject, overflowEvict};
+  int returnVal = 1;
+
+  if(policy < (sizeof(handler) / sizeof(handler[0])))
+    {
+      ENTER_REGION(bf);
+      bf->overflow = handler[policy];
+      EXIT_REGION(bf);
+      returnVal = 0;
+    }
+
+  return returnVal;
+}
+
+/**
+   Check if buffer is empty.
+   \return non-zero if buffer is empty.
+*/
+
+int PBUF_empty(pbuf_t * bf)
+{
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  return (bufferEmpty(bf) == BUFFER_EMPTY);
+}
+
+/**
+   Check if buffer is full.
+   \return non-zero if buffer is full.
+*/
+
+int PBUF_full(pbuf_t * bf)
+{
+  int returnVal;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  ENTER_REGION(bf);
+  returnVal = (bufferFull(bf) == BUFFER_FULL);
+  EXIT_REGION(bf);
+
+  return returnVal;
+}
+
+/**
+   Return the size of buffer.
+   \return size of buffer
+*/
+
+int PBUF_bufferSize(pbuf_t * bf)
+{
+  (void) bf;
+  return (int) CAPACITY(bf);
+}
+
+/**
+   Return the number of elements held in the buffer.
+   \return number of elements */
+
+int PBUF_count(pbuf_t * bf)
+{
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  return (int) bf->count;
+}
+
+/**
+   Return the number of elements held in the buffer at the priority passed in.
+   \return number of elements, or zero for an invalid priority */
+
+int PBUF_countPriority(pbuf_t * bf, priority_t priority)
+{
+  int returnVal = 0;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  if(validatePriority(bf, priority) == VALID_PRIORITY)
+    {
+      returnVal = (int) bf->priorityCount[priority];
+    }
+
+  return returnVal;
+}
+
+#ifdef PBUF_AGING
+
+/**
+   Set the age at which a run of the buffer passed in is promoted to the next priority up, in
+   retrievals or in the units of PBUF_AGING_NOW(). A threshold of zero, the default, turns
+   aging off. A run's age restarts whenever one of its elements is retrieved, so a run that is
+   being served is never promoted.
+   \return zero on success */
+
+int PBUF_setAging(pbuf_t * bf, uint32_t threshold)
+{
+  ENTER_REGION(bf);
+  bf->aging.threshold = threshold;
+  EXIT_REGION(bf);
+
+  return 0;
+}
+
+#endif  /* PBUF_AGING */
+
+#ifdef PBUF_SCHEDULER
+
+/**
+   Select how the buffer passed in chooses the next element to retrieve: PBUF_STRICT_PRIORITY,
+   PBUF_WEIGHTED_ROUND_ROBIN or PBUF_DEFICIT_ROUND_ROBIN. PBUF_init() and PBUF_create() select
+   PBUF_STRICT_PRIORITY; any other policy is selected once, straight after, with a weight from 1
+   to INT32_MAX for each priority - elements per turn, or payload bytes per turn for deficit
+   round-robin. Weights may be NULL for strict priority order. The round starts again from the
+   highest active priority. A payload larger than its priority's weight leaves the priority in
+   debt, and it sits out turns until the debt is paid.
+   \return zero for a valid policy and weights */
+
+int PBUF_setScheduler(pbuf_t * bf, unsigned policy, const uint32_t * weights)
+{
+  int returnVal = 1;
+  uint32_t priority;
+
+  if(policy <= PBUF_DEFICIT_ROUND_ROBIN)
+    {
+      returnVal = 0;
+      for(priority = 0; (policy != PBUF_STRICT_PRIORITY) && (priority < PRIORITIES(bf)); priority++)
+        {
+          if((weights == NULL) || (weights[priority] == 0u) || (weights[priority] > (uint32_t) INT32_MAX))
+            {
+              returnVal = 1;
+            }
+        }
+    }
+
+  if(returnVal == 0)
+    {
+      ENTER_REGION(bf);
+      memset(&bf->schedule, 0, sizeof(bf->schedule));
+      for(priority = 0; (weights != NULL) && (priority < PRIORITIES(bf)); priority++)
+        {
+          bf->schedule.weight[priority] = weights[priority];
+        }
+      bf->schedule.policy = (uint8_t) policy;
+      EXIT_REGION(bf);
+    }
+
+  return returnVal;
+}
+
+#endif  /* PBUF_SCHEDULER */
+
+#ifdef PBUF_STATISTICS
+
+/**
+   Copy the statistics of the buffer passed in to the snapshot passed in. The copy is taken
+   inside the critical region, so its counters agree with each other.
+   \return zero on success */
+
+int PBUF_statistics(pbuf_t * bf, pbuf_stats_t * snapshot)
+{
+  int returnVal = 1;
+
+  if(snapshot != NULL)
+    {
+      ENTER_REGION(bf);
+      *snapshot = bf->stats;
+      EXIT_REGION(bf);
+      returnVal = 0;
+    }
+
+  return returnVal;
+}
+
+/**
+   Clear the counters of the buffer passed in, and restart its high-water marks from the
+   elements it holds now.
+   \return zero on success */
+
+int PBUF_resetStatistics(pbuf_t * bf)
+{
+  uint32_t priority;
+
+  ENTER_REGION(bf);
+  memset(&bf->stats, 0, sizeof(bf->stats));
+  bf->stats.highWater = bf->count;
+  for(priority = 0; priority < PRIORITIES(bf); priority++)
+    {
+      bf->stats.priorityHighWater[priority] = bf->priorityCount[priority];
+    }
+  EXIT_REGION(bf);
+
+  return 0;
+}
+
+#endif  /* PBUF_STATISTICS */
+
+#ifndef EXTERNAL_DATA_BUFFER
+
+/**
+   Insert data into the buffer of the given priority.
+   \return zero for a valid insert, or an insert dropped by PBUF_DROP_INCOMING.
+   \return PBUF_REJECTED if the buffer is full and its policy is PBUF_REJECT_INCOMING.
+   \return other non-zero for an invalid insert. */
+
+int PBUF_insert(pbuf_t * bf, element_t element, priority_t priority)
+{
+#ifdef PBUF_STAGED
+  return ! (stageInsert(bf, element, priority) == VALID_INSERT);
+#else
+  check_t returnVal;
+
+  ENTER_REGION(bf);
+  returnVal = insert(bf, element, priority);
+#ifdef PBUF_WAIT
+  if(returnVal == VALID_INSERT)
+    {
+      wakeWaiters(bf, priority);
+    }
+#endif  /* PBUF_WAIT */
+  EXIT_REGION(bf);
+
+  return insertStatus(returnVal);
+#endif  /* PBUF_STAGED */
+}
+
+/**
+   Insert n elements of the given priority, in order, as if each were passed to
+   PBUF_insert(). Those that fit in the free cells are linked in as one run; the rest
+   are handled by the overflow policy, stopping at the first that is not stored. The
+   number stored and the number of elements overwritten are passed back if the pointers
+   are not NULL.
+   \return zero if all n elements were inserted, or the rest dropped by PBUF_DROP_INCOMING.
+   \return PBUF_REJECTED if the rest were rejected by PBUF_REJECT_INCOMING.
+   \return other non-zero otherwise. */
+
+int PBUF_insertBatch(pbuf_t * bf, const element_t * elements, size_t n, priority_t priority,
+                     size_t * inserted, size_t * overwritten)
+{
+  check_t result = INVALID_INSERT;
+  size_t stored = 0;
+  size_t evicted = 0;
+  size_t cells;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  if((elements != NULL) && (validatePriority(bf, priority) == VALID_PRIORITY))
+    {
+      ENTER_REGION(bf);
+      cells = (size_t) (CAPACITY(bf) - bf->count - bf->detached);
+      if(cells > n)
+        {
+          cells = n;
+        }
+
+      if((cells > 0u) &&
+         (insertRun(bf, elements, (count_t) cells, priority) == VALID_INSERT))
+        {
+          stored = cells;
+        }
+
+      // the buffer is now full, so each further insert takes the overflow policy
+      result = VALID_INSERT;
+      while((stored < n) && (result == VALID_INSERT))
+        {
+          result = insert(bf, elements[stored], priority);
+          if(result == VALID_INSERT)
+            {
+              stored++;
+              evicted++;
+            }
+        }
+#ifdef PBUF_WAIT
+      if(stored > 0u)
+        {
+          wakeWaiters(bf, priority);
+        }
+#endif  /* PBUF_WAIT */
+      EXIT_REGION(bf);
+    }
+
+  if(inserted != NULL)
+    {
+      *inserted = stored;
+    }
+
+  if(overwritten != NULL)
+    {
+      *overwritten = evicted;
+    }
+
+  return (stored == n) ? 0 : insertStatus(result);
+}
+
+/**
+   Retrieve an element from the tail of the buffer and assign to
+   the element pointer passed in.
+   \return zero on successful retrieve.
+   \return non-zero on failed retrieve. */
+
+int PBUF_retrieve(pbuf_t * bf, element_t * element)
+{
+  check_t returnVal = INVALID_RETRIEVE;
+  index_t index;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  ENTER_REGION(bf);
+  if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
+    {
+      if((readElementIndex(bf, &index) == VALID_ELEMENT) &&
+         (readData(bf, element, index) == VALID_ELEMENT))
+        {
+          returnVal = VALID_RETRIEVE;
+        }
+    }
+  EXIT_REGION(bf);
+
+  return returnVal;
+}
+
+#ifdef PBUF_WAIT
+
+/**
+   Retrieve an element as PBUF_retrieve() does, but only once the next element to be retrieved
+   is of at least min_priority, blocking for up to timeout_ns nanoseconds until one is inserted.
+   A min_priority of zero takes any element. A timeout of zero does not block, and
+   PBUF_WAIT_FOREVER blocks for as long as it takes. Inserts of a lower priority than
+   min_priority do not wake the calling thread.
+   \return zero on successful retrieve.
+   \return non-zero on timeout or an invalid priority. */
 
-STATIC check_t remap(index_t a1, index_t a2, index_t b)
+int PBUF_retrieveWait(pbuf_t * bf, element_t * element, priority_t min_priority, uint64_t timeout_ns)
 {
-  check_t returnVal = INVALID_REMAP;
-  index_t a1ptr;
-  index_t a2ptr;
-  index_t bptr;
+  check_t returnVal = INVALID_RETRIEVE;
+  struct timespec deadline;
+  int waitResult = 0;
+  index_t index;
 
-  if((checkIndex(a1) == VALID_INDEX) &&
-     (checkIndex(a2) == VALID_INDEX) &&
-     (checkIndex(b) == VALID_INDEX))
+  if((element != NULL) && (validatePriority(bf, min_priority) == VALID_PRIORITY))
     {
-      if((nextIndex(&a1ptr, a1) == VALID_INDEX) &&
-         (nextIndex(&bptr, b) == VALID_INDEX) &&
-         (nextIndex(&a2ptr, a2) == VALID_INDEX))
+      waitDeadline(&deadline, (timeout_ns == PBUF_WAIT_FOREVER) ? 0u : timeout_ns);
+      ENTER_REGION(bf);
+      while((readyFor(bf, min_priority) == INVALID_PRIORITY) && (timeout_ns > 0u) && (waitResult == 0))
         {
-          // don't remap if it is not needed
-          if(a1ptr != b)
+          bf->wait.waiting[min_priority]++;
+          bf->wait.waiters++;
+          if(timeout_ns == PBUF_WAIT_FOREVER)
             {
-              if((writeNextIndex(a1, b) == VALID_INDEX) &&
-                 (nextIndex(&bptr, b) == VALID_INDEX) &&
-                 (writeNextIndex(a2, bptr) == VALID_INDEX) &&
-                 (writeNextIndex(b, a1ptr) == VALID_INDEX))
-                {
-                  returnVal = VALID_REMAP;
-                }
+              waitResult = pthread_cond_wait(&bf->wait.ready[min_priority], &bf->wait.lock);
             }
           else
             {
-              returnVal = VALID_REMAP;
+              waitResult = pthread_cond_timedwait(&bf->wait.ready[min_priority], &bf->wait.lock, &deadline);
             }
+          bf->wait.waiting[min_priority]--;
+          bf->wait.waiters--;
+        }
+#ifdef PBUF_EVENTFD
+      markReadiness(bf);
+#endif  /* PBUF_EVENTFD */
+
+      if((readyFor(bf, min_priority) == VALID_PRIORITY) &&
+         (readElementIndex(bf, &index) == VALID_ELEMENT) &&
+         (readData(bf, element, index) == VALID_ELEMENT))
+        {
+          returnVal = VALID_RETRIEVE;
         }
+      EXIT_REGION(bf);
     }
 
   return returnVal;
 }
 
+#endif  /* PBUF_WAIT */
+
+#ifdef PBUF_EVENTFD
+
 /**
-   insertPointNotFull() calculates the index of the valid insert point to be used when remapping the buffer.
-   This routine is particularly used when the buffer is not full and an overwrite hasn't taken place.
-   The priority passed in is the priority of the newly added element. See the 'Adding data to the Buffer' document
-   for more information.
-   \return VALID_PRIORITY or INVALID_PRIORITY */
+   The eventfd that becomes readable when the buffer passed in goes from empty to non-empty.
+   It is written once per transition, not once per insert, so it suits an edge-triggered
+   epoll loop: on EPOLLIN read the eventfd to clear it, then retrieve until the buffer is empty.
+   \return the eventfd, or -1 if it has been closed */
 
-STATIC index_t insertPointNotFull(priority_t priority)
+int PBUF_readableFd(pbuf_t * bf)
 {
-  index_t returnVal = 255;
-  priority_t highestPri;
+  return bf->readableFd;
+}
+
+/**
+   The eventfd that becomes readable when the buffer passed in goes from full to not full,
+   for producers that wait for room. It is opened on the first call.
+   \return the eventfd, or -1 if it could not be opened */
 
-  if(highestPriority(&highestPri) == VALID_PRIORITY)
+int PBUF_writableFd(pbuf_t * bf)
+{
+  ENTER_REGION(bf);
+  if(bf->writableFd < 0)
     {
-      // priority higher to highest pri in use?
-      if(priority > highestPri)
-        {
-          returnVal = tailIndex();
-        }
-      else
-        {
-          returnVal = headIndex(highestPri);
-        }
+      bf->writableFd = eventfd(0u, EFD_NONBLOCK | EFD_CLOEXEC);
     }
+  EXIT_REGION(bf);
 
-  return returnVal;
+  return bf->writableFd;
 }
 
 /**
-   Calculate the index of the valid insert point to be used when remapping the buffer.
-   This routine is particularly used when an overwrite has taken place due to a full buffer.
-   The priority passed in is the priority of the newly added element.
-   See 'adding_data_to_the_Buffer' for more information.
-   \return insert point index */
+   Close the eventfds of the buffer passed in. Call when the instance is no longer in use.
+   \return zero on success */
 
-index_t insertPointFull(priority_t priority)
+int PBUF_closeFds(pbuf_t * bf)
 {
-  index_t returnVal = tailIndex();
-  priority_t count;
+  int returnVal = 0;
 
-  for(count = priority; count < PRIORITY_SIZE; count++)
+  ENTER_REGION(bf);
+  if((bf->readableFd >= 0) && (close(bf->readableFd) != 0))
     {
-      if(activeStatus(count) == ACTIVE)
-        {
-          returnVal = headIndex(priority);
-          break;
-        }
+      returnVal = 1;
+    }
+  if((bf->writableFd >= 0) && (close(bf->writableFd) != 0))
+    {
+      returnVal = 1;
     }
+  bf->readableFd = -1;
+  bf->writableFd = -1;
+  EXIT_REGION(bf);
+
   return returnVal;
 }
 
+#endif  /* PBUF_EVENTFD */
+
 /**
-   Calculate the bridgePoint when the buffer is full. The bridgePoint is passed to the
-   remap routine to notify the bridgePoint (see 'adding_data_to_the_Buffer' for more information).
-   \return bridge point index */
+   Retrieve up to max elements, highest priority first and oldest first within a priority,
+   as if by repeated calls to PBUF_retrieve(). Under a PBUF_SCHEDULER weighted policy they come
+   in the order it serves them instead. The priority of each element is assigned to pri_out if
+   it is not NULL.
+   \return number of elements retrieved */
 
-index_t bridgePointFull(void)
+size_t PBUF_retrieveBatch(pbuf_t * bf, element_t * out, size_t max, priority_t * pri_out)
 {
-  index_t returnVal = tailIndex();
-  priority_t count;
-  priority_t lowestPri;
-
-  lowestPriority(&lowestPri);
+  size_t returnVal = 0;
 
-  for(count = lowestPri + 1; count < PRIORITY_SIZE; count++)
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  if(out != NULL)
     {
-      if(activeStatus(count) == ACTIVE)
+      ENTER_REGION(bf);
+#ifdef PBUF_SCHEDULER
+      if(bf->schedule.policy != PBUF_STRICT_PRIORITY)
         {
-          returnVal = headIndex(count);
-          break;
+          returnVal = readServed(bf, out, pri_out, max);
         }
+      else
+#endif  /* PBUF_SCHEDULER */
+      returnVal = readRuns(bf, out, pri_out, max);
+      EXIT_REGION(bf);
     }
+
   return returnVal;
 }
 
 /**
-   Calculate the bridge point when the buffer is not full. The bridge point is passed to the
-   remap routine to indicate the bridge point (see 'adding_data_to_the_Buffer' for more information).
-   \return bridge point index */
-
-STATIC index_t bridgePointNotFull(void)
+   Reserve a cell for an element of the given priority, to be written in place through the
+   slot pointer passed back. The cell is detached from the buffer until it is committed with
+   PBUF_commit() or returned with PBUF_abort(), so it cannot be retrieved. If the buffer is
+   full, the oldest element of the lowest priority is removed, as the overflow policy allows.
+   One cell always stays in the buffer, so at most BUFFER_SIZE - 1 cells may be reserved at
+   once.
+   \return zero for a valid reserve.
+   \return PBUF_REJECTED if PBUF_REJECT_INCOMING turned the reserve away.
+   \return other non-zero values for an invalid reserve, including one dropped by
+   PBUF_DROP_INCOMING. */
+
+int PBUF_reserve(pbuf_t * bf, priority_t priority, void ** slot)
 {
+  check_t returnVal = INVALID_INSERT;
+  index_t index;
   priority_t lowestPri;
+  priority_t limit;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  if((validatePriority(bf, priority) == VALID_PRIORITY) && (slot != NULL))
+    {
+      ENTER_REGION(bf);
+      if((bf->detached + 1u) < CAPACITY(bf))
+        {
+          returnVal = VALID_INSERT;
+          if(bufferFull(bf) == BUFFER_FULL)
+            {
+              returnVal = overflowLimit(bf, priority, &limit);
+              if((returnVal == VALID_INSERT) &&
+                 ! ((lowestPriority(bf, &lowestPri) == VALID_PRIORITY) &&
+                    (lowestPri <= limit) &&
+                    (removeOldestIndex(bf, &index, lowestPri) == VALID_ELEMENT)))
+                {
+                  returnVal = INVALID_INSERT;
+                }
+            }
+        }
+
+      if(returnVal == VALID_INSERT)
+        {
+          returnVal = INVALID_INSERT;
+          if(detachFree(bf, &index) == VALID_INDEX)
+            {
+              // the detached cell's link holds its priority until it is committed
+              LINK(bf, index) = (index_t) priority;
+              writeDetachState(bf, index, CELL_RESERVED);
+              *slot = slotData(bf, index);
+              returnVal = VALID_INSERT;
+            }
+        }
+      EXIT_REGION(bf);
+    }
 
-  lowestPriority(&lowestPri);
-  return headIndex(lowestPri);
+  // a dropped reserve has no slot to pass back
+  return (returnVal == DROP_INSERT) ? 1 : insertStatus(returnVal);
 }
 
 /**
-   Remap buffer for a not full buffer for the index of priority
-   passed in.
-   \return VALID_PRIORITY or INVALID_PRIORITY */
+   Insert the element written to a reserved slot into the buffer at the priority it was
+   reserved with. The element is not copied.
+   \return zero for a valid commit.
+   \return non-zero if the slot was not reserved. */
 
-STATIC check_t remapNotFull(index_t newIndex, priority_t priority)
+int PBUF_commit(pbuf_t * bf, void * slot)
 {
-  check_t returnVal = INVALID_REMAP;
-  index_t insertPt = insertPointNotFull(priority);
-  index_t bridgePt = bridgePointNotFull();
+  check_t returnVal = INVALID_INSERT;
+  index_t index;
+  index_t insertIdx;
+  priority_t priority;
 
-  if((writeHead(newIndex, priority) == VALID_WRITE) &&
-     (setActive(priority) == VALID_ACTIVE))
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  if((slot != NULL) && (slotIndex(bf, slot, &index) == VALID_INDEX))
     {
-      if(remap(insertPt, bridgePt, newIndex) == VALID_REMAP)
+      ENTER_REGION(bf);
+      if(detachState(bf, index) == CELL_RESERVED)
         {
-          if(tailIndex() != newIndex)
-            {
-              returnVal = VALID_REMAP;
-            }
-          else
+          priority = (priority_t) LINK(bf, index);
+
+          // the reattached cell is the first free cell, so it is the one inserted
+          attachFree(bf, index);
+          if((insertIndex(bf, &insertIdx, priority) == VALID_INSERT) &&
+             (insertIdx == index))
             {
-              if(writeTail(bridgePt) == VALID_INDEX)
-                {
-                  returnVal = VALID_REMAP;
-                }
+              returnVal = VALID_INSERT;
+#ifdef PBUF_WAIT
+              wakeWaiters(bf, priority);
+#endif  /* PBUF_WAIT */
             }
         }
+      EXIT_REGION(bf);
     }
 
-  return returnVal;
+  return ! (returnVal == VALID_INSERT);
 }
 
 /**
-   Remap buffer where the buffer is full relevant to the priority
-   passed in.
-   \return VALID_PRIORITY or INVALID_PRIORITY */
+   Return a reserved slot to the buffer without inserting it.
+   \return zero for a valid abort.
+   \return non-zero if the slot was not reserved. */
 
-STATIC check_t remapFull(index_t index, priority_t priority)
+int PBUF_abort(pbuf_t * bf, void * slot)
 {
-  check_t returnVal = INVALID_REMAP;
-  index_t insertPt = insertPointFull(priority);
-  index_t bridgePt = bridgePointFull();
-  index_t lowestPriTailIdx = lowestPriorityTail();
-  priority_t lowestPri;
+  int returnVal = 1;
+  index_t index;
 
-  if((writeHead(index, priority) == VALID_WRITE) &&
-     (setActive(priority) == VALID_ACTIVE))
+  if((slot != NULL) && (slotIndex(bf, slot, &index) == VALID_INDEX))
     {
-      if(remap(insertPt, bridgePt, index))
+      ENTER_REGION(bf);
+      if(detachState(bf, index) == CELL_RESERVED)
         {
-          if(index == tailIndex())
-            {
-              if((lowestPriority(&lowestPri) == VALID_PRIORITY) &&
-                 (lowestPri != priority) &&
-                 (lowestPriTailIdx  == tailIndex()))
-                {
-                  setInactive(lowestPri);
-                }
-            }
-
-          // reset tail to possibly new lowest pri
-          if(lowestPriority(&lowestPri) == VALID_PRIORITY)
-            {
-              if(writeTail(headIndex(lowestPri)) == VALID_INDEX)
-                {
-                  returnVal = VALID_REMAP;
-                }
-            }
+          attachFree(bf, index);
+          returnVal = 0;
         }
+      EXIT_REGION(bf);
     }
 
   return returnVal;
 }
 
 /**
-   Overwrite index without remapping if buffer is full and only
-   a single priority exists on the buffer
-   \return VALID_WRITE or INVALID_WRITE */
-
-STATIC check_t overwriteSinglePriorityIndex(index_t * index, priority_t priority)
+   Remove the next element to be retrieved from the buffer without copying it. A pointer to
+   the element is passed back through slot, and its priority if the priority pointer is not
+   NULL. The cell stays detached, so it cannot be overwritten, until it is handed back with
+   PBUF_release(). As for reserved cells, one cell always stays in the buffer.
+   \return zero if an element was acquired.
+   \return non-zero if the buffer is empty. */
+
+int PBUF_acquire(pbuf_t * bf, const void ** slot, priority_t * priority)
 {
-  check_t returnVal = INVALID_WRITE;
+  check_t returnVal = INVALID_RETRIEVE;
+  index_t index;
+  priority_t highestPri;
 
-  if(nextTailIndex(index) == VALID_INDEX)
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  if(slot != NULL)
     {
-      if(writeHead(*index, priority) == VALID_WRITE)
+      ENTER_REGION(bf);
+      if((bufferEmpty(bf) == BUFFER_NOT_EMPTY) &&
+         (detachFirst(bf, &index, &highestPri) == VALID_ELEMENT))
         {
-          if(activeStatus(priority) == ACTIVE)
+          writeDetachState(bf, index, CELL_ACQUIRED);
+          *slot = slotData(bf, index);
+          if(priority != NULL)
             {
-              incTail();
+              *priority = highestPri;
             }
-          else
-            {
-              setActive(priority);
-            }
-
-          returnVal = VALID_WRITE;
+          returnVal = VALID_RETRIEVE;
         }
+      EXIT_REGION(bf);
     }
 
   return returnVal;
 }
 
 /**
-   Overwrite index since buffer is full and there are no unused elements.
-   \return VALID_WRITE or INVALID_WRITE */
+   Return an acquired cell to the buffer as a free cell.
+   \return zero for a valid release.
+   \return non-zero if the slot was not acquired. */
 
-STATIC check_t overwriteElementIndex(index_t * index, priority_t priority)
+int PBUF_release(pbuf_t * bf, const void * slot)
 {
-  check_t returnVal = INVALID_WRITE;
-  priority_t priorityCount = activePriorityCount();
+  int returnVal = 1;
+  index_t index;
 
-  if(priorityCount == 1)
-    {
-      returnVal = overwriteSinglePriorityIndex(index, priority);
-    }
-  else
+  if((slot != NULL) && (slotIndex(bf, slot, &index) == VALID_INDEX))
     {
-      *index = lowestPriorityTail();
-      if(remapFull(*index, priority) == VALID_REMAP)
+      ENTER_REGION(bf);
+      if(detachState(bf, index) == CELL_ACQUIRED)
         {
-          returnVal = VALID_WRITE;
+          attachFree(bf, index);
+          returnVal = 0;
         }
+      EXIT_REGION(bf);
     }
 
   return returnVal;
 }
 
-/** @} */
-/* end of Internal group */
-
-//////////////////////////////// Exposed API ////////////////////////////////
-
-/**
-   @defgroup API API
-   This is the exposed API
-   @{ */
-
 /**
-   Reset Buffer.
-   \return zero on successful reset */
+   Copy the next element to be retrieved, and its priority if the priority pointer is not
+   NULL, without removing it from the buffer.
+   \return zero if there is an element.
+   \return non-zero if the buffer is empty. */
 
-int PBUF_reset(void)
+int PBUF_peek(pbuf_t * bf, element_t * element, priority_t * priority)
 {
-  return ! ((resetBufferPointers() == VALID_RESET) &&
-            (resetBuffer() == VALID_RESET));
+  return ! ((element != NULL) && (PBUF_peekN(bf, element, 1, priority) == 1u));
 }
 
 /**
-   Check if buffer is empty.
-   \return non-zero if buffer is empty.
-*/
+   Copy up to max of the next elements to be retrieved, in retrieve order, without removing
+   them from the buffer. Under a PBUF_SCHEDULER weighted policy only the next element is copied.
+   The priority of each element is assigned to pri_out if it is not NULL.
+   \return number of elements copied */
 
-int PBUF_empty(void)
+size_t PBUF_peekN(pbuf_t * bf, element_t * out, size_t max, priority_t * pri_out)
 {
-  return (bufferEmpty() == BUFFER_EMPTY);
+  size_t returnVal = 0;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  if(out != NULL)
+    {
+      ENTER_REGION(bf);
+#ifdef PBUF_SCHEDULER
+      if(bf->schedule.policy != PBUF_STRICT_PRIORITY)
+        {
+          returnVal = peekServed(bf, out, pri_out, max);
+        }
+      else
+#endif  /* PBUF_SCHEDULER */
+      returnVal = peekRuns(bf, out, pri_out, max);
+      EXIT_REGION(bf);
+    }
+
+  return returnVal;
 }
 
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+
 /**
-   Check if buffer is full.
-   \return non-zero if buffer is full.
-*/
+   Find the cell for an element of the given priority. If the buffer is full the element
+   evicted by the overflow policy is always the oldest of the lowest priority, so its cell
+   and priority are reported without a search.
+   \return the status, cell, evicted cell and priority, and generation of the insert */
 
-int PBUF_full(void)
+pbuf_insert_t PBUF_insertIndex(pbuf_t * bf, priority_t priority)
 {
-  return bufferFull() == BUFFER_FULL;
+  pbuf_insert_t returnVal = {1, -1, -1, 0u, 0u};
+  check_t result;
+  check_t full;
+  index_t tempIndex;
+  priority_t lowestPri = 0u;
+
+  ENTER_REGION(bf);
+  full = bufferFull(bf);
+  if(full == BUFFER_FULL)
+    {
+      lowestPriority(bf, &lowestPri);
+    }
+
+  result = insertIndex(bf, &tempIndex, priority);
+  if(result == VALID_INSERT)
+    {
+      returnVal.index = (int) tempIndex;
+      returnVal.generation = ++bf->generation;
+      if(full == BUFFER_FULL)
+        {
+          returnVal.evictedIndex = (int) tempIndex;
+          returnVal.evictedPriority = lowestPri;
+        }
+    }
+  EXIT_REGION(bf);
+  returnVal.status = insertStatus(result);
+
+  return returnVal;
 }
 
 /**
-   Return the size of buffer.
-   \return size of buffer
-*/
+   Retrieve index is passed to the caller by modifying index.
+   Zero returned if a valid retrieve has happened.
+   \return zero on successful retrieve.
+   \return non-zero on failed retrieve. */
 
-int PBUF_bufferSize(void)
+int PBUF_retrieveIndex(pbuf_t * bf, int * index)
 {
-  return BUFFER_SIZE;
-}
+  check_t returnVal = INVALID_RETRIEVE;
+  index_t tempIndex;
 
+  ENTER_REGION(bf);
+  if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
+    {
+      if(readElementIndex(bf, &tempIndex) == VALID_ELEMENT)
+        {
+          *index = (int) tempIndex;
+          returnVal = VALID_RETRIEVE;
+        }
+    }
+  EXIT_REGION(bf);
 
-#ifndef EXTERNAL_DATA_BUFFER
+  return returnVal;
+}
 
-/**
-   Insert data into the buffer of the given priority.
-   \return zero for a valid insert.
-   \return non-zero for an invalid insert. */
+#ifdef PAYLOAD_BUFFER
 
-int PBUF_insert(element_t element, priority_t priority)
+/**
+   Insert a copy of the payload passed in, of the length passed in, into the buffer at the
+   priority passed in. While there is no free cell or not enough of the arena is free, the
+   oldest element of the lowest priority is removed, as the overflow policy allows. The
+   payload is copied into the arena, so the caller's copy may be reused straight away.
+   \return zero for a valid insert, or one dropped by PBUF_DROP_INCOMING.
+   \return PBUF_REJECTED if PBUF_REJECT_INCOMING turned the payload away.
+   \return other non-zero values if the payload cannot fit. */
+
+int PBUF_insertPayload(pbuf_t * bf, const void * payload, size_t length, priority_t priority)
 {
-  return ! (insert(element, priority) == VALID_INSERT);
+  check_t returnVal = INVALID_INSERT;
+  index_t index;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  if((validatePriority(bf, priority) == VALID_PRIORITY) &&
+     (length <= ((size_t) PAYLOAD_CHUNKS * PAYLOAD_CHUNK_SIZE)) &&
+     ((payload != NULL) || (length == 0u)))
+    {
+      ENTER_REGION(bf);
+      returnVal = payloadRoom(bf, payloadChunks(length), priority);
+      if((returnVal == VALID_INSERT) &&
+         (insertIndex(bf, &index, priority) == VALID_INSERT) &&
+         (writeData(bf, 0u, index) == VALID_ELEMENT) &&
+         (writePayload(bf, index, (const uint8_t *) payload, (payload_size_t) length, priority) == VALID_WRITE))
+        {
+#ifdef PBUF_WAIT
+          wakeWaiters(bf, priority);
+#endif  /* PBUF_WAIT */
+        }
+      else if(returnVal == VALID_INSERT)
+        {
+          returnVal = INVALID_INSERT;
+        }
+      EXIT_REGION(bf);
+    }
+
+  return insertStatus(returnVal);
 }
 
 /**
-   Retrieve an element from the tail of the buffer and assign to
-   the element pointer passed in.
+   Retrieve the next payload into the memory passed in, of the size passed in, and pass its
+   length back. If the memory is too small the payload is left in the buffer, and its length
+   is passed back so that the caller can retry.
    \return zero on successful retrieve.
    \return non-zero on failed retrieve. */
 
-int PBUF_retrieve(element_t * element)
+int PBUF_retrievePayload(pbuf_t * bf, void * payload, size_t size, size_t * length)
 {
   check_t returnVal = INVALID_RETRIEVE;
   index_t index;
+  priority_t servedPri;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  ENTER_REGION(bf);
+  if((bufferEmpty(bf) == BUFFER_NOT_EMPTY) &&
+     (firstIndex(bf, &index, &servedPri) == VALID_INDEX))
+    {
+      *length = LENGTH(bf, index);
+      if(*length <= size)
+        {
+          readPayload(bf, index, (uint8_t *) payload);
+          if(readElementIndex(bf, &index) == VALID_ELEMENT)
+            {
+              returnVal = VALID_RETRIEVE;
+            }
+        }
+    }
+  EXIT_REGION(bf);
+
+  return returnVal;
+}
 
-  if( ! PBUF_empty())
+/**
+   Copy the next payload into the memory passed in, of the size passed in, without removing
+   it, and pass back its length and, if the priority pointer is not NULL, its priority. The
+   length is passed back even if the memory is too small, so a payload can be sized before
+   it is retrieved.
+   \return zero if the payload was copied.
+   \return non-zero if the buffer is empty or the memory is too small. */
+
+int PBUF_peekPayload(pbuf_t * bf, void * payload, size_t size, size_t * length, priority_t * priority)
+{
+  check_t returnVal = INVALID_RETRIEVE;
+  index_t index;
+  priority_t servedPri;
+
+#ifdef PBUF_STAGED
+  drainStage(bf);
+#endif  /* PBUF_STAGED */
+  ENTER_REGION(bf);
+  if((bufferEmpty(bf) == BUFFER_NOT_EMPTY) &&
+     (firstIndex(bf, &index, &servedPri) == VALID_INDEX))
     {
-      if((readElementIndex(&index) == VALID_ELEMENT) &&
-         (readData(element, index) == VALID_ELEMENT))
+      *length = LENGTH(bf, index);
+      if(priority != NULL)
+        {
+          *priority = servedPri;
+        }
+
+      if(*length <= size)
         {
+          readPayload(bf, index, (uint8_t *) payload);
           returnVal = VALID_RETRIEVE;
         }
     }
+  EXIT_REGION(bf);
+
   return returnVal;
 }
 
-#endif  /* ! EXTERNAL_DATA_BUFFER */
+#endif  /* PAYLOAD_BUFFER */
+
+#ifdef PBUF_SHARDS
 
 /**
-   Insert index of the given priority is passed to by
-   modifying index. Zero is returned for a successful
-   insert.
+   Initialise a caller-owned sharded buffer, emptying every shard. Must be called before any
+   other sharded API command is applied to the instance, and while no other thread is using it.
+   \return zero on successful initialisation */
+
+int PBUF_shardedInit(pbuf_sharded_t * sb)
+{
+  int returnVal = 0;
+  uint32_t shard;
+
+  atomic_store_explicit(&sb->summary, 0u, memory_order_relaxed);
+  for(shard = 0; shard < PBUF_SHARDS; shard++)
+    {
+      atomic_flag_clear_explicit(&sb->shard[shard].lock, memory_order_relaxed);
+      atomic_store_explicit(&sb->shard[shard].top, 0u, memory_order_relaxed);
+      returnVal |= PBUF_init(&sb->shard[shard].bf);
+    }
+
+  return returnVal;
+}
+
+/**
+   Insert an element of the priority passed in into the shard passed in, normally the calling
+   thread's own. If the shard is full its oldest element of the lowest priority is overwritten,
+   as PBUF_insert() would.
    \return zero for a valid insert.
    \return non-zero for an invalid insert. */
 
-int PBUF_insertIndex(int * index, priority_t priority)
+int PBUF_shardedInsert(pbuf_sharded_t * sb, unsigned shard, element_t element, priority_t priority)
 {
-  return ! (insertIndex((index_t *) index, priority) == VALID_INSERT);
+  int returnVal = 1;
+
+  if(shard < PBUF_SHARDS)
+    {
+      lockShard(&sb->shard[shard]);
+      returnVal = PBUF_insert(&sb->shard[shard].bf, element, priority);
+      publishShard(sb, shard);
+      unlockShard(&sb->shard[shard]);
+    }
+
+  return returnVal;
 }
 
 /**
-   Retrieve index is passed to the caller by modifying index.
-   Zero returned if a valid retrieve has happened.
+   Retrieve an element for the thread owning the shard passed in, and its priority if the priority
+   pointer is not NULL. The element comes from the thread's own shard unless another shard holds a
+   higher priority, or its own shard is empty, when the highest priority element of the other
+   shards is taken instead. If another thread empties the shard chosen first, the choice is made
+   again, a bounded number of times.
    \return zero on successful retrieve.
-   \return non-zero on failed retrieve. */
+   \return non-zero if every shard was empty. */
 
-int PBUF_retrieveIndex(int * index)
+int PBUF_shardedRetrieve(pbuf_sharded_t * sb, unsigned shard, element_t * element, priority_t * priority)
 {
-  check_t returnVal = INVALID_RETRIEVE;
-  index_t tempIndex;
+  int returnVal = 1;
+  uint32_t tries;
+  uint32_t chosen;
 
-  if(bufferEmpty() == BUFFER_EMPTY)
+  if((shard < PBUF_SHARDS) && (element != NULL))
     {
-      if(readElementIndex(&tempIndex) == VALID_ELEMENT)
+      chosen = chooseShard(sb, shard);
+      for(tries = 0; (chosen < PBUF_SHARDS) && (tries <= PBUF_SHARDS); tries++)
         {
-          *index = (int) tempIndex;
-          returnVal = VALID_RETRIEVE;
+          lockShard(&sb->shard[chosen]);
+          if(PBUF_retrieveBatch(&sb->shard[chosen].bf, element, 1u, priority) == 1u)
+            {
+              returnVal = 0;
+            }
+          publishShard(sb, chosen);
+          unlockShard(&sb->shard[chosen]);
+
+          chosen = returnVal ? chooseShard(sb, shard) : PBUF_SHARDS;
         }
     }
+
   return returnVal;
 }
 
+#endif  /* PBUF_SHARDS */
+
 /** @} */
 /* end of API group */
 
@@ -1184,19 +4378,20 @@ int PBUF_retrieveIndex(int * index)
    Requires DEBUG to be defined at compile time.
 */
 
-void PBUF_print(void)
+void PBUF_print(pbuf_t * bf)
 {
-  uint16_t count;
+  uint32_t count;
   index_t index;
   index_t lastIndex;
   priority_t vmh;
+  element_t element;
 
   printf("buffer:\n path: ");
-  if(bufferEmpty() == BUFFER_NOT_EMPTY)
+  if(bufferEmpty(bf) == BUFFER_NOT_EMPTY)
     {
-      index = tailIndex();
-      lowestPriority(&vmh);
-      lastIndex = headIndex(vmh);
+      index = tailIndex(bf);
+      lowestPriority(bf, &vmh);
+      lastIndex = headIndex(bf, vmh);
       count = 0;
       do
         {
@@ -1204,46 +4399,48 @@ void PBUF_print(void)
             {
               printf(" -> ");
             }
-          nextIndex(&index, index);
-          printf("%u", bf.element[index].data);
+          nextIndex(bf, &index, index);
+          readData(bf, &element, index);
+          printf("%lu", (unsigned long) element);
           count++;
         } while(index != lastIndex);
     }
 
   printf("\n data: ");
 
-  for(count = 0; count < BUFFER_SIZE; count++)
+  for(count = 0; count < CAPACITY(bf); count++)
     {
       if(count > 0)
         {
           printf(", ");
         }
-      printf("%u", bf.element[count].data);
+      readData(bf, &element, (index_t) count);
+      printf("%lu", (unsigned long) element);
     }
   printf("\n next:  ");
 
-  for(count = 0; count < BUFFER_SIZE; count++)
+  for(count = 0; count < CAPACITY(bf); count++)
     {
       if(count > 0)
         {
           printf(", ");
         }
-      printf("%u", bf.element[count].next);
+      printf("%lu", (unsigned long) LINK(bf, count));
     }
 
   printf("\n");
-  for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
+  for(count = LOW_PRI; count < PRIORITIES(bf); count++)
     {
-      printf("head(%u):   %u, ", count, headIndex(count));
+      printf("head(%u):   %lu, ", (unsigned) count, (unsigned long) headIndex(bf, count));
     }
-  printf("tail:  %u", tailIndex());
+  printf("tail:  %lu", (unsigned long) tailIndex(bf));
 
   printf("\n");
-  for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
+  for(count = LOW_PRI; count < PRIORITIES(bf); count++)
     {
-      printf("active(%u): %u, ", count, (activeStatus(count) == ACTIVE));
+      printf("active(%u): %u, ", (unsigned) count, (activeStatus(bf, count) == ACTIVE));
     }
-  printf("empty: %u", PBUF_empty());
+  printf("empty: %u, count: %lu", PBUF_empty(bf), (unsigned long) bf->count);
   printf("\n");
   printf("  .   .   .   .   .   .   .   .   .   .   .   .   .   .   .   .\n");
 }
@@ -2,26 +2,34 @@
 #define PRIORITY_BUFFER_H
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #define VERSION 0.2.1
 
 /**
-   Set Buffer Size Here - Size may be anything between 3 and 256 buffer elements */
+   define PBUF_RUNTIME_SIZE to size buffers at run time with PBUF_create(). BUFFER_SIZE,
+   PRIORITY_SIZE and ELEMENT_SIZE are then the largest capacity, number of priorities and
+   element size that PBUF_create() will accept. */
 
-#ifndef BUFFER_SIZE
+  //#define PBUF_RUNTIME_SIZE
 
-#  define BUFFER_SIZE 4
+/**
+   Memory passed to PBUF_create() must be aligned to PBUF_ALIGNMENT bytes. */
 
-#endif  /* !BUFFER_SIZE */
+#define PBUF_ALIGNMENT 8u
 
 /**
-   Set Number of priority levels Here (8 max) */
+   Set Buffer Size Here - Size may be anything from 3 buffer elements upwards.
+   Links are 8-bit up to 256 elements, 16-bit up to 65536 elements and 32-bit beyond. */
 
-#ifndef PRIORITY_SIZE
+#ifndef BUFFER_SIZE
 
-#  define PRIORITY_SIZE 3
+#  define BUFFER_SIZE 4
 
-#endif  /* !PRIORITY_SIZE */
+#endif  /* !BUFFER_SIZE */
+
+/**
+   Set Number of priority levels Here (2 to 256) */
 
 #ifndef PRIORITY_SIZE
 
@@ -32,7 +40,11 @@
 /**
    Set the element size here (8, 16, 32, 0r 64) */
 
-#define ELEMENT_SIZE 8
+#ifndef ELEMENT_SIZE
+
+#  define ELEMENT_SIZE 8
+
+#endif  /* !ELEMENT_SIZE */
 
 /**
    The element_t type holds a buffer element.
@@ -65,21 +77,1102 @@ typedef uint64_t element_t;
 
   //#define EXTERNAL_DATA_BUFFER
 
+/**
+   define PBUF_SOA_LAYOUT to hold the links and the data in separate arrays rather than
+   interleaved in cell_t, so that walking or remapping links touches only a dense array of
+   index_t. Runtime sized buffers already hold their data apart from their links. */
+
+  //#define PBUF_SOA_LAYOUT
+
+#if defined(PBUF_SOA_LAYOUT) && defined(PBUF_RUNTIME_SIZE)
+
+# error ERROR: PBUF_SOA_LAYOUT cannot be combined with PBUF_RUNTIME_SIZE
+
+#endif  /* PBUF_SOA_LAYOUT && PBUF_RUNTIME_SIZE */
+
+/**
+   define PBUF_SPSC for one producer thread and one consumer thread without locks. PBUF_insert()
+   is then the producer's only call: it places the element in a staging ring of PBUF_STAGE_SIZE
+   cells, synchronised by C11 atomics, and fails only if the staging ring is full. Every other
+   call belongs to the consumer, which moves staged elements into the buffer, overwriting as
+   PBUF_insert() otherwise would, before it retrieves, peeks or tests for empty. Needs C11. */
+
+  //#define PBUF_SPSC
+
+/**
+   define PBUF_MPSC for any number of producer threads and one consumer thread without locks. As
+   with PBUF_SPSC, PBUF_insert() is the producers' only call, but each priority has its own lane of
+   PBUF_STAGE_SIZE cells that producers claim with a compare and swap, and an atomic bit per
+   priority tells the consumer which lanes hold elements. PBUF_insert() fails only if the lane for
+   its priority is full. Needs C11. */
+
+  //#define PBUF_MPSC
+
+#if defined(PBUF_SPSC) && defined(PBUF_MPSC)
+
+# error ERROR: PBUF_SPSC cannot be combined with PBUF_MPSC
+
+#endif  /* PBUF_SPSC && PBUF_MPSC */
+
+#if defined(PBUF_SPSC) || defined(PBUF_MPSC)
+
+#  define PBUF_STAGED
+
+#  if ! defined(__STDC_VERSION__) || (__STDC_VERSION__ < 201112L) || defined(__STDC_NO_ATOMICS__)
+
+#    error ERROR: PBUF_SPSC and PBUF_MPSC need a C11 compiler with atomics
+
+#  endif  /* __STDC_VERSION__ */
+
+#  ifdef EXTERNAL_DATA_BUFFER
+
+#    error ERROR: PBUF_SPSC and PBUF_MPSC cannot be combined with EXTERNAL_DATA_BUFFER
+
+#  endif  /* EXTERNAL_DATA_BUFFER */
+
+#  include <stdatomic.h>
+
+#  ifndef PBUF_STAGE_SIZE
+#    define PBUF_STAGE_SIZE 64
+#  endif  /* !PBUF_STAGE_SIZE */
+
+#  if PBUF_STAGE_SIZE < 2 || (PBUF_STAGE_SIZE & (PBUF_STAGE_SIZE - 1)) != 0
+
+#    error ERROR: PBUF_STAGE_SIZE should be a power of two from 2 upwards
+
+#  endif  /* PBUF_STAGE_SIZE */
+
+#  ifdef PBUF_MPSC
+#    define STAGE_WORDS ((PRIORITY_SIZE + 63) / 64)
+#  endif  /* PBUF_MPSC */
+
+#endif  /* PBUF_SPSC || PBUF_MPSC */
+
+/**
+   define PBUF_SHARDS as the number of shards (1 to 64) for a pbuf_sharded_t of that many buffers,
+   for any number of threads that both insert and retrieve. Each thread inserts into a shard of its
+   own, under a spinlock held only for the one call, and retrieves from its own shard unless another
+   shard holds a higher priority, or its own is empty, when it takes the highest priority work from
+   another shard instead. Priority order therefore holds across the shards only approximately, as a
+   shard's highest priority may change while a thread is choosing. PBUF_SPIN_WAIT() is called on
+   each turn of a spinlock and may be defined to yield the processor. Needs C11. */
+
+  //#define PBUF_SHARDS 8
+
+#ifdef PBUF_SHARDS
+
+#  if PBUF_SHARDS < 1 || PBUF_SHARDS > 64
+
+#    error ERROR: PBUF_SHARDS should be a value from 1 to 64
+
+#  endif  /* PBUF_SHARDS */
+
+#  if ! defined(__STDC_VERSION__) || (__STDC_VERSION__ < 201112L) || defined(__STDC_NO_ATOMICS__)
+
+#    error ERROR: PBUF_SHARDS needs a C11 compiler with atomics
+
+#  endif  /* __STDC_VERSION__ */
+
+#  if defined(PBUF_STAGED) || defined(PBUF_RUNTIME_SIZE) || defined(EXTERNAL_DATA_BUFFER)
+
+#    error ERROR: PBUF_SHARDS cannot be combined with PBUF_SPSC, PBUF_MPSC, PBUF_RUNTIME_SIZE or EXTERNAL_DATA_BUFFER
+
+#  endif  /* PBUF_STAGED || PBUF_RUNTIME_SIZE || EXTERNAL_DATA_BUFFER */
+
+#  include <stdatomic.h>
+
+#endif  /* PBUF_SHARDS */
+
+/**
+   PBUF_ENTER_CRITICAL(bf) and PBUF_EXIT_CRITICAL(bf) bracket each region in which the library reads
+   or updates the links, heads, tail, activity flags and counts of the buffer passed in. Each API call
+   enters at most one region, after checking its arguments and before returning, and never calls
+   another API command from inside it, so the hooks need not nest. PBUF_empty(), PBUF_count() and
+   PBUF_countPriority() read a single field and take no region. By default the hooks do nothing.
+
+   For bare metal, define them to mask interrupts, for instance on Cortex-M:
+
+     #define PBUF_ENTER_CRITICAL(bf) uint32_t pbufMask = __get_PRIMASK(); __disable_irq()
+     #define PBUF_EXIT_CRITICAL(bf) __set_PRIMASK(pbufMask)
+
+   Or define PBUF_CRITICAL_SPINLOCK to hold a C11 spinlock in each pbuf_t, calling PBUF_SPIN_WAIT()
+   on each turn while another thread holds it. Needs C11. */
+
+  //#define PBUF_CRITICAL_SPINLOCK
+
+/**
+   define PBUF_WAIT for PBUF_retrieveWait(), which blocks until the buffer holds an element of at
+   least a given priority or a timeout expires. Each pbuf_t then holds a POSIX mutex, which the
+   critical section hooks take, and a condition variable per priority. An insert wakes only the
+   threads waiting for its priority or lower. Define PBUF_WAIT on the compiler command line, since
+   the library needs POSIX declarations from its very first include. */
+
+  //#define PBUF_WAIT
+
+#ifdef PBUF_WAIT
+
+#  if defined(PBUF_STAGED) || defined(PBUF_CRITICAL_SPINLOCK) || defined(EXTERNAL_DATA_BUFFER)
+
+#    error ERROR: PBUF_WAIT cannot be combined with PBUF_SPSC, PBUF_MPSC, PBUF_CRITICAL_SPINLOCK or EXTERNAL_DATA_BUFFER
+
+#  endif  /* PBUF_STAGED || PBUF_CRITICAL_SPINLOCK || EXTERNAL_DATA_BUFFER */
+
+#  if defined(PBUF_ENTER_CRITICAL) || defined(PBUF_EXIT_CRITICAL)
+
+#    error ERROR: PBUF_WAIT cannot be combined with PBUF_ENTER_CRITICAL or PBUF_EXIT_CRITICAL
+
+#  endif  /* PBUF_ENTER_CRITICAL || PBUF_EXIT_CRITICAL */
+
+#  include <pthread.h>
+
+#  define PBUF_ENTER_CRITICAL(bf) pthread_mutex_lock(&(bf)->wait.lock)
+#  define PBUF_EXIT_CRITICAL(bf) pthread_mutex_unlock(&(bf)->wait.lock)
+
+/**
+   Timeout for PBUF_retrieveWait() to wait for as long as it takes */
+
+#  define PBUF_WAIT_FOREVER UINT64_MAX
+
+#endif  /* PBUF_WAIT */
+
+/**
+   define PBUF_EVENTFD (Linux) for event loops that cannot block in a library call. Each buffer then
+   has an eventfd, from PBUF_readableFd(), written once each time the buffer turns from empty to
+   non-empty, and optionally a second, from PBUF_writableFd(), written once each time it turns from
+   full to not full. Either may be registered with epoll. A consumer woken by the first should read
+   the eventfd to clear it and then retrieve until the buffer is empty, since no more is written
+   until the buffer has been empty again. Define PBUF_EVENTFD on the compiler command line. */
+
+  //#define PBUF_EVENTFD
+
+#if defined(PBUF_EVENTFD) && defined(PBUF_STAGED)
+
+#  error ERROR: PBUF_EVENTFD cannot be combined with PBUF_SPSC or PBUF_MPSC
+
+#endif  /* PBUF_EVENTFD && PBUF_STAGED */
+
+/**
+   define PBUF_STATISTICS to keep a pbuf_stats_t in each buffer, counting inserts, retrieves,
+   overwrites and rejections at each priority and the high-water marks of occupancy. Read it with
+   PBUF_statistics() and clear it with PBUF_resetStatistics(). Without it the counters are not
+   compiled in. Define PBUF_STATISTICS on the compiler command line. */
+
+  //#define PBUF_STATISTICS
+
+/**
+   define PBUF_AGING to stop a steady stream of high priority elements starving lower priorities.
+   Each priority's run of elements ages from when it becomes active until one of its elements is
+   retrieved. Once its age reaches the threshold given to PBUF_setAging(), the whole run is promoted
+   to the next priority up. Age is counted in retrievals unless PBUF_AGING_NOW(bf) is defined to
+   return a 32-bit time, such as a millisecond tick, when the threshold is in the same units. */
+
+  //#define PBUF_AGING
+
+#if defined(PBUF_AGING) && ! defined(PBUF_AGING_NOW)
+
+#  define PBUF_AGING_NOW(bf) ((bf)->aging.clock)
+
+#endif  /* PBUF_AGING && ! PBUF_AGING_NOW */
+
+/**
+   define PBUF_SCHEDULER for PBUF_setScheduler(), which replaces strict priority order with a share
+   of retrievals for each active priority in proportion to a weight: by weighted round-robin, in
+   elements, or by deficit round-robin, in payload bytes when PAYLOAD_BUFFER is defined. Each buffer
+   then holds a weight and a credit per priority. Strict priority order stays the default. */
+
+  //#define PBUF_SCHEDULER
+
+#ifdef PBUF_CRITICAL_SPINLOCK
+
+#  if ! defined(__STDC_VERSION__) || (__STDC_VERSION__ < 201112L) || defined(__STDC_NO_ATOMICS__)
+
+#    error ERROR: PBUF_CRITICAL_SPINLOCK needs a C11 compiler with atomics
+
+#  endif  /* __STDC_VERSION__ */
+
+#  if defined(PBUF_ENTER_CRITICAL) || defined(PBUF_EXIT_CRITICAL)
+
+#    error ERROR: PBUF_CRITICAL_SPINLOCK cannot be combined with PBUF_ENTER_CRITICAL or PBUF_EXIT_CRITICAL
+
+#  endif  /* PBUF_ENTER_CRITICAL || PBUF_EXIT_CRITICAL */
+
+#  include <stdatomic.h>
+
+#  define PBUF_ENTER_CRITICAL(bf)                                       \
+  while(atomic_flag_test_and_set_explicit(&(bf)->critical, memory_order_acquire)) \
+    {                                                                   \
+      PBUF_SPIN_WAIT();                                                 \
+    }
+#  define PBUF_EXIT_CRITICAL(bf) atomic_flag_clear_explicit(&(bf)->critical, memory_order_release)
+
+#endif  /* PBUF_CRITICAL_SPINLOCK */
+
+#ifndef PBUF_ENTER_CRITICAL
+#  define PBUF_ENTER_CRITICAL(bf) ((void) 0)
+#endif  /* !PBUF_ENTER_CRITICAL */
+
+#ifndef PBUF_EXIT_CRITICAL
+#  define PBUF_EXIT_CRITICAL(bf) ((void) 0)
+#endif  /* !PBUF_EXIT_CRITICAL */
+
+#ifndef PBUF_SPIN_WAIT
+#  define PBUF_SPIN_WAIT() ((void) 0)
+#endif  /* !PBUF_SPIN_WAIT */
+
 /**
    The priority_t type holds a priority value.
 */
 
 typedef uint8_t priority_t;
 
-int PBUF_reset(void);
-int PBUF_empty(void);
-int PBUF_full(void);
-int PBUF_bufferSize(void);
+#if BUFFER_SIZE < 3 || BUFFER_SIZE > 4294967295
+
+# error ERROR: BUFFER_SIZE should be a value from 3 to 4294967295
+
+#endif  /* BUFFER_SIZE */
+
+/**
+   The index_t type holds an index value. Its width is chosen from BUFFER_SIZE so that
+   small buffers keep their 8-bit links and cell_t stays as small as possible. */
+
+#if BUFFER_SIZE <= 256
+
+typedef uint8_t index_t;
+
+#elif BUFFER_SIZE <= 65536
+
+typedef uint16_t index_t;
+
+#else
+
+typedef uint32_t index_t;
+
+#endif  /* BUFFER_SIZE */
+
+/**
+   The count_t type holds a count of elements, from zero up to BUFFER_SIZE. */
+
+#if BUFFER_SIZE <= 255
+
+typedef uint8_t count_t;
+
+#elif BUFFER_SIZE <= 65535
+
+typedef uint16_t count_t;
+
+#else
+
+typedef uint32_t count_t;
+
+#endif  /* BUFFER_SIZE */
+
+/**
+   define PAYLOAD_BUFFER to store a variable length payload with each element. Payloads are held in an
+   arena of PAYLOAD_BYTES bytes, split into chunks of PAYLOAD_CHUNK_SIZE bytes which are chained together
+   for payloads longer than a chunk. */
+
+  //#define PAYLOAD_BUFFER
+
+#ifdef PAYLOAD_BUFFER
+
+#  ifndef PAYLOAD_BYTES
+#    define PAYLOAD_BYTES 1024
+#  endif  /* !PAYLOAD_BYTES */
+
+#  ifndef PAYLOAD_CHUNK_SIZE
+#    define PAYLOAD_CHUNK_SIZE 32
+#  endif  /* !PAYLOAD_CHUNK_SIZE */
+
+#  define PAYLOAD_CHUNKS (PAYLOAD_BYTES / PAYLOAD_CHUNK_SIZE)
+
+#  if PAYLOAD_CHUNK_SIZE < 1 || PAYLOAD_CHUNKS < 1 || PAYLOAD_CHUNKS > 4294967294
+
+#    error ERROR: PAYLOAD_BYTES should hold from 1 to 4294967294 chunks of PAYLOAD_CHUNK_SIZE bytes
+
+#  endif  /* PAYLOAD_CHUNKS */
+
+#  if defined(EXTERNAL_DATA_BUFFER) || defined(PBUF_RUNTIME_SIZE)
+
+#    error ERROR: PAYLOAD_BUFFER cannot be combined with EXTERNAL_DATA_BUFFER or PBUF_RUNTIME_SIZE
+
+#  endif  /* EXTERNAL_DATA_BUFFER || PBUF_RUNTIME_SIZE */
+
+/**
+   The chunk_t type holds the index of a payload chunk. Its largest value marks the end of a chain. */
+
+#  if PAYLOAD_CHUNKS <= 255
+
+typedef uint8_t chunk_t;
+
+#  elif PAYLOAD_CHUNKS <= 65535
+
+typedef uint16_t chunk_t;
+
+#  else
+
+typedef uint32_t chunk_t;
+
+#  endif  /* PAYLOAD_CHUNKS */
+
+/**
+   The payload_size_t type holds the length of a payload in bytes. */
+
+#  if PAYLOAD_BYTES <= 65535
+
+typedef uint16_t payload_size_t;
+
+#  else
+
+typedef uint32_t payload_size_t;
+
+#  endif  /* PAYLOAD_BYTES */
+
+#endif  /* PAYLOAD_BUFFER */
+
+#if PRIORITY_SIZE < 2 || PRIORITY_SIZE > 256
+
+# error ERROR: PRIORITY_SIZE should be a value from 2 to 256
+
+#endif  /* PRIORITY_SIZE */
+
+/**
+   The activity_t type holds data known as activity flags - one bit per priority. If the buffer currently
+   holds data of a given priority, the appropriate bit is set to ACTIVE. Once all elements of a particular
+   quality of data are retrieved from the buffer, the relevant flag is set to INACTIVE. The respective head
+   only holds relevant data when the flag is ACTIVE.
+
+   Up to 64 priorities the flags fit a single word of 8, 16, 32 or 64 bits. Beyond that the flags are
+   held in 64-bit leaf words, with a summary word holding one bit per non-empty leaf, so that finding the
+   lowest or highest active priority is always a fixed number of word scans. */
+
+#if PRIORITY_SIZE <= 8
+
+typedef uint8_t activity_t;
+#  define ACTIVITY_BITS 8
+
+#elif PRIORITY_SIZE <= 16
+
+typedef uint16_t activity_t;
+#  define ACTIVITY_BITS 16
+
+#elif PRIORITY_SIZE <= 32
+
+typedef uint32_t activity_t;
+#  define ACTIVITY_BITS 32
+
+#elif PRIORITY_SIZE <= 64
+
+typedef uint64_t activity_t;
+#  define ACTIVITY_BITS 64
+
+#else
+
+#  define ACTIVITY_BITS 64
+#  define ACTIVITY_LEAVES ((PRIORITY_SIZE + ACTIVITY_BITS - 1) / ACTIVITY_BITS)
+
+typedef struct ACTIVITY_T
+{
+  /**
+     summary holds one bit per leaf, set while that leaf has any active flag. */
+
+  uint8_t summary;
+
+  /**
+     leaf holds the activity flags, 64 priorities per word. */
+
+  uint64_t leaf[ACTIVITY_LEAVES];
+
+} activity_t;
+
+#endif  /* PRIORITY_SIZE */
+
+/**
+   The cell_t structure is the buffers composite element. It holds an element and a next variable per slot in
+   the buffer. This linkage around the circular buffer enables the buffer to be re-routed or remapped easily,
+   allowing for prioritised data to be organised in order of preference. In other words, it can be quickly
+   re-arranged to allow higher orders of priority to be retrieved from the buffer quicker than lower orders
+   of priority. With PBUF_SOA_LAYOUT the same fields are held in separate arrays of the pbuf_t instead. */
+
+typedef struct CELL_T
+{
+
+  /**
+     data holds the data of the element. Runtime sized buffers hold their data
+     separately, since the element size is only known at run time. */
+
+#if ! defined(EXTERNAL_DATA_BUFFER) && ! defined(PBUF_RUNTIME_SIZE)
+
+  element_t data;
+
+#endif  /* ! EXTERNAL_DATA_BUFFER && ! PBUF_RUNTIME_SIZE */
+
+#ifdef PAYLOAD_BUFFER
+
+  /**
+     chunk is the first arena chunk of the payload, or the end of chain marker if there is none. */
+
+  chunk_t chunk;
+
+  /**
+     length is the length of the payload in bytes. */
+
+  payload_size_t length;
+
+#endif  /* PAYLOAD_BUFFER */
+
+  /**
+     next is a link pointing to the next element in the buffer. */
+
+  index_t next;
+
+} cell_t;
+
+/**
+   The ptr_t structure holds the tail and array of heads pointers' which point into the buffer.
+   these are used to ensure buffer access is very fast. The head array size is
+   configured by the library user. */
+
+typedef struct PTR_T
+{
+  /**
+     tail is a pointer to the buffer element to be read next.
+     This is the element having the highest priority in the buffer. */
+
+  index_t tail;
+
+  /**
+     head is an array of pointers to the respective heads of the priorities on the buffer.
+     These are required to know where to insert future prioritised data. */
+
+  index_t head[PRIORITY_SIZE];
+
+} ptr_t;
+
+#ifdef PBUF_SPSC
+
+/**
+   The stage_t structure is the staging ring between the producer and the consumer. The write and
+   read counters run freely and are masked to a cell. The producer writes a cell and then releases
+   the write counter; the consumer acquires the write counter, moves the cells into the buffer and
+   then releases the read counter. The counters sit either side of the cells, so they do not share
+   a cache line unless the ring is very small. */
+
+typedef struct STAGE_T
+{
+  /**
+     Number of elements ever staged, written by the producer only. */
+
+  atomic_uint_fast32_t write;
+
+  /**
+     Staged elements and their priorities */
+
+  element_t element[PBUF_STAGE_SIZE];
+  priority_t priority[PBUF_STAGE_SIZE];
+
+  /**
+     Number of elements ever moved into the buffer, written by the consumer only. */
+
+  atomic_uint_fast32_t read;
+
+} stage_t;
+
+#elif defined(PBUF_MPSC)
+
+/**
+   The lane_cell_t structure is one cell of a lane. Its sequence says whose turn it is: a producer
+   may claim the cell when the sequence equals the lane's write counter, and the consumer may read
+   it when the sequence is one more than the lane's read counter. */
+
+typedef struct LANE_CELL_T
+{
+  atomic_uint_fast32_t sequence;
+  element_t element;
+
+} lane_cell_t;
+
+/**
+   The lane_t structure holds the elements of one priority inserted by the producers and not yet
+   moved into the buffer. */
+
+typedef struct LANE_T
+{
+  /**
+     Number of cells ever claimed by the producers */
+
+  atomic_uint_fast32_t write;
+
+  lane_cell_t cell[PBUF_STAGE_SIZE];
+
+  /**
+     Number of cells ever read, by the consumer only */
+
+  uint32_t read;
+
+} lane_t;
+
+/**
+   The stage_t structure holds a lane per priority, and a bit per priority set by a producer once
+   it has filled a cell of that lane. The consumer clears a word of bits before emptying its lanes,
+   so an element inserted meanwhile leaves its bit set for the next time. */
+
+typedef struct STAGE_T
+{
+  lane_t lane[PRIORITY_SIZE];
+  atomic_uint_fast64_t active[STAGE_WORDS];
+
+} stage_t;
+
+#endif  /* PBUF_SPSC */
+
+#ifdef PBUF_WAIT
+
+/**
+   The wait_t structure holds the lock and the condition variables for threads blocked in
+   PBUF_retrieveWait(). A thread waiting for an element of at least priority p waits on ready[p],
+   so an insert only signals the condition variables of its own priority and below. */
+
+typedef struct WAIT_T
+{
+  /**
+     Lock taken by PBUF_ENTER_CRITICAL() */
+
+  pthread_mutex_t lock;
+
+  /**
+     Signalled when an element of at least each priority is inserted */
+
+  pthread_cond_t ready[PRIORITY_SIZE];
+
+  /**
+     Number of threads waiting on each condition variable, and in total */
+
+  uint16_t waiting[PRIORITY_SIZE];
+  uint32_t waiters;
+
+} wait_t;
+
+#endif  /* PBUF_WAIT */
+
+#ifdef PBUF_AGING
+
+/**
+   The aging_t structure holds the age of each priority's run for PBUF_AGING. A run's stamp is
+   the PBUF_AGING_NOW() time at which it became active or last had an element retrieved. */
+
+typedef struct AGING_T
+{
+  /**
+     Age at which a run is promoted, or zero to leave runs where they are */
+
+  uint32_t threshold;
+
+  /**
+     Number of elements retrieved, the default PBUF_AGING_NOW() */
+
+  uint32_t clock;
+
+  /**
+     Time each priority's run became active or was last served */
+
+  uint32_t stamp[PRIORITY_SIZE];
+
+  /**
+     Priority whose run was checked last */
+
+  priority_t cursor;
+
+} aging_t;
+
+#endif  /* PBUF_AGING */
+
+#ifdef PBUF_SCHEDULER
+
+/**
+   Retrieval policies for PBUF_setScheduler(). PBUF_STRICT_PRIORITY, the default, retrieves the
+   oldest element of the highest priority. PBUF_WEIGHTED_ROUND_ROBIN gives each active priority in
+   turn, highest first, as many retrievals as its weight. PBUF_DEFICIT_ROUND_ROBIN gives each a
+   turn worth its weight in bytes of payload; an element without a payload costs one byte. */
+
+#define PBUF_STRICT_PRIORITY 0u
+#define PBUF_WEIGHTED_ROUND_ROBIN 1u
+#define PBUF_DEFICIT_ROUND_ROBIN 2u
+
+/**
+   The schedule_t structure holds the retrieval policy of a buffer built with PBUF_SCHEDULER, and
+   the state of its round. A priority's turn lasts while its credit is positive. */
+
+typedef struct SCHEDULE_T
+{
+  /**
+     Credit added to each priority at the start of its turn */
+
+  uint32_t weight[PRIORITY_SIZE];
+
+  /**
+     Credit left to each priority, negative while it is in debt from its last turn */
+
+  int32_t credit[PRIORITY_SIZE];
+
+  /**
+     Priority whose turn it is or was last */
+
+  priority_t current;
+
+  /**
+     PBUF_STRICT_PRIORITY, PBUF_WEIGHTED_ROUND_ROBIN or PBUF_DEFICIT_ROUND_ROBIN */
+
+  uint8_t policy;
+
+} schedule_t;
+
+#endif  /* PBUF_SCHEDULER */
+
+/**
+   Overflow policies for PBUF_setOverflow(), deciding what an insert into a full buffer does.
+   PBUF_OVERWRITE_LOWEST, the default, overwrites the oldest element of the lowest priority if
+   that priority is no higher than the new element's, and otherwise fails. PBUF_DROP_INCOMING
+   discards the new element and reports success. PBUF_REJECT_INCOMING discards it and returns
+   PBUF_REJECTED. PBUF_EVICT_OLDEST always stores the new element, removing the oldest element
+   of the lowest priority to make room whatever the new element's priority. The policy also
+   governs PBUF_insertPayload() and PBUF_reserve(), though a dropped reserve fails. */
+
+#define PBUF_OVERWRITE_LOWEST 0u
+#define PBUF_DROP_INCOMING 1u
+#define PBUF_REJECT_INCOMING 2u
+#define PBUF_EVICT_OLDEST 3u
+
+/**
+   Returned by the insert commands when the buffer is full and its policy is PBUF_REJECT_INCOMING */
+
+#define PBUF_REJECTED 2
+
+/**
+   The pbuf_insert_t structure is the result of PBUF_insertIndex(). In headless mode the caller
+   owns the data of each cell, so it is told which cell to write and, when the buffer was full,
+   which cell's element was evicted to make room, so that its data can be released at once. */
+
+typedef struct PBUF_INSERT_T
+{
+  /**
+     Zero if the insert was valid or dropped by PBUF_DROP_INCOMING, PBUF_REJECTED if it was
+     rejected by PBUF_REJECT_INCOMING, and other non-zero if it was invalid */
+
+  int status;
+
+  /**
+     Cell for the new element, or -1 if it was not stored */
+
+  int index;
+
+  /**
+     Cell of the element evicted to make room, or -1 if none was. The evicted element's cell is
+     the one reused, so this is the same as index when set. */
+
+  int evictedIndex;
+
+  /**
+     Priority of the evicted element */
+
+  priority_t evictedPriority;
+
+  /**
+     Number of elements stored by PBUF_insertIndex() since the buffer was initialised, including
+     this one. Kept alongside the caller's data, it tells a reused cell's occupants apart. */
+
+  uint32_t generation;
+
+} pbuf_insert_t;
+
+#ifdef PBUF_STATISTICS
+
+/**
+   The pbuf_stats_t structure holds the statistics of a buffer built with PBUF_STATISTICS.
+   Each counter is indexed by priority and wraps at 2^32. */
+
+typedef struct PBUF_STATS_T
+{
+  /**
+     Elements stored */
+
+  uint32_t inserts[PRIORITY_SIZE];
+
+  /**
+     Elements retrieved, in place or in batches as well as singly */
+
+  uint32_t retrieves[PRIORITY_SIZE];
+
+  /**
+     Elements of this priority overwritten or evicted to make room for another */
+
+  uint32_t overwrites[PRIORITY_SIZE];
+
+  /**
+     Inserts of this priority into a full buffer that were not stored */
+
+  uint32_t rejections[PRIORITY_SIZE];
+
+  /**
+     Most elements held at once, in total and at each priority */
+
+  count_t highWater;
+  count_t priorityHighWater[PRIORITY_SIZE];
+
+} pbuf_stats_t;
+
+#endif  /* PBUF_STATISTICS */
+
+/**
+   The number of 32-bit words in the detach map of a buffer of the number of cells passed in,
+   which holds two bits of detach state per cell. */
+
+#define DETACH_MAP_WORDS(cells) (((cells) + 15u) / 16u)
+
+/**
+   The pbuf_t structure holds the relevant data required for operating a single buffer.
+   Storage is owned by the caller, so any number of independent buffers may be declared
+   and passed by handle to the API.
+   Its size is determined at compile time and depends upon the configuration applied. With
+   PBUF_RUNTIME_SIZE the cells, detach map and data follow the pbuf_t in memory passed to
+   PBUF_create().
+   There is a single tail, a head for each priority, and an activity word (or summary and
+   leaf words) for storing an activity flag per priority. Element counts, in total and per
+   priority, are kept up to date on every insert and retrieve. In addition there is the
+   buffer itself, each cell containing an element of data storage and a pointer to the
+   following cell, or with PBUF_SOA_LAYOUT an array of pointers and a separate array of
+   data. Tail, heads and pointers are index_t wide. */
+
+typedef struct PBUF_T {
+
+  /**
+     Tail and Head pointers */
+
+  ptr_t ptr;
+
+#ifdef PBUF_RUNTIME_SIZE
+
+  /**
+     Array of buffer composite elements, in the memory passed to PBUF_create() */
+
+  cell_t * element;
+
+  /**
+     Element data, elementSize bytes per cell, in the memory passed to PBUF_create() */
+
+  uint8_t * data;
+
+  /**
+     Number of cells in the buffer */
+
+  count_t capacity;
+
+  /**
+     Number of priorities in use */
+
+  uint16_t priorities;
+
+  /**
+     Size of each element in bytes (1, 2, 4 or 8) */
+
+  uint8_t elementSize;
+
+#elif defined(PBUF_SOA_LAYOUT)
+
+  /**
+     Link from each cell to the next */
+
+  index_t next[BUFFER_SIZE];
+
+#ifndef EXTERNAL_DATA_BUFFER
+
+  /**
+     Data held in each cell */
+
+  element_t data[BUFFER_SIZE];
+
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+
+#ifdef PAYLOAD_BUFFER
+
+  /**
+     First arena chunk of each cell's payload */
+
+  chunk_t chunk[BUFFER_SIZE];
+
+  /**
+     Length of each cell's payload in bytes */
+
+  payload_size_t length[BUFFER_SIZE];
+
+#endif  /* PAYLOAD_BUFFER */
+
+#else
+
+  /**
+     Array of buffer composite elements */
+
+  cell_t element[BUFFER_SIZE];
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
+  /**
+     Storage for activity statuses of priorities in use.
+     Activity status may be ACTIVE or INACTIVE. */
+
+  activity_t activity;
+
+  /**
+     Number of elements held in the buffer. */
+
+  count_t count;
+
+  /**
+     Number of elements held in the buffer at each priority. */
+
+  count_t priorityCount[PRIORITY_SIZE];
+
+  /**
+     Number of cells detached from the buffer: reserved with PBUF_reserve() and not yet
+     committed or aborted, or acquired with PBUF_acquire() and not yet released. */
+
+  count_t detached;
+
+#ifndef EXTERNAL_DATA_BUFFER
+
+  /**
+     Detach state of each cell, two bits per cell: reserved, acquired or neither. With
+     PBUF_RUNTIME_SIZE the map follows the cells in the memory passed to PBUF_create(). */
+
+#ifdef PBUF_RUNTIME_SIZE
+  uint32_t * detachMap;
+#else
+  uint32_t detachMap[DETACH_MAP_WORDS(BUFFER_SIZE)];
+#endif  /* PBUF_RUNTIME_SIZE */
+
+#endif  /* ! EXTERNAL_DATA_BUFFER */
+
+  /**
+     Handles inserts into the full buffer, as selected by PBUF_setOverflow() */
+
+  uint8_t (* overflow)(struct PBUF_T * bf, index_t * index, priority_t priority);
+
+  /**
+     Generation of the element last stored by PBUF_insertIndex() */
+
+  uint32_t generation;
+
+#ifdef PBUF_STATISTICS
+
+  /**
+     Counters and high-water marks */
+
+  pbuf_stats_t stats;
+
+#endif  /* PBUF_STATISTICS */
+
+#ifdef PBUF_AGING
+
+  /**
+     Age of each priority's run */
+
+  aging_t aging;
+
+#endif  /* PBUF_AGING */
+
+#ifdef PBUF_SCHEDULER
+
+  /**
+     Retrieval policy and round */
+
+  schedule_t schedule;
+
+#endif  /* PBUF_SCHEDULER */
+
+#ifdef PBUF_CRITICAL_SPINLOCK
+
+  /**
+     Spinlock taken by PBUF_ENTER_CRITICAL() */
+
+  atomic_flag critical;
+
+#endif  /* PBUF_CRITICAL_SPINLOCK */
+
+#ifdef PBUF_WAIT
+
+  /**
+     Lock and condition variables for PBUF_retrieveWait() */
+
+  wait_t wait;
+
+#endif  /* PBUF_WAIT */
+
+#ifdef PBUF_EVENTFD
+
+  /**
+     eventfds written on the empty to non-empty and the full to not full transitions, or -1 */
+
+  int readableFd;
+  int writableFd;
+
+  /**
+     READY_NOT_EMPTY and READY_NOT_FULL as they stood on entry to the current critical region */
+
+  uint8_t readiness;
+
+#endif  /* PBUF_EVENTFD */
+
+#ifdef PAYLOAD_BUFFER
+
+  /**
+     Payload arena, in chunks */
+
+  uint8_t arena[PAYLOAD_CHUNKS][PAYLOAD_CHUNK_SIZE];
+
+  /**
+     Link from each chunk to the next chunk of the same payload, or of the free list */
+
+  chunk_t chunkNext[PAYLOAD_CHUNKS];
+
+  /**
+     First chunk of the free list */
+
+  chunk_t freeChunk;
+
+  /**
+     Number of chunks on the free list */
+
+  chunk_t freeChunks;
+
+  /**
+     Number of chunks held by payloads at each priority */
+
+  chunk_t priorityChunks[PRIORITY_SIZE];
+
+#endif  /* PAYLOAD_BUFFER */
+
+#ifdef PBUF_STAGED
+
+  /**
+     Elements inserted by the producers and not yet moved into the buffer by the consumer */
+
+  stage_t stage;
+
+#endif  /* PBUF_STAGED */
+
+} pbuf_t;
+
+#ifdef PBUF_SHARDS
+
+/**
+   The pbuf_shard_t structure is one shard of a pbuf_sharded_t - a buffer, the spinlock that guards
+   it, and its highest priority plus one, or zero while it is empty. The highest priority is written
+   under the lock but read without it, as a hint for threads choosing which shard to take from. Each
+   shard starts on a cache line of its own so that threads working on different shards do not
+   contend for the same line. */
+
+typedef struct PBUF_SHARD_T
+{
+  _Alignas(64) atomic_flag lock;
+  atomic_uint top;
+  pbuf_t bf;
+
+} pbuf_shard_t;
+
+/**
+   The pbuf_sharded_t structure holds PBUF_SHARDS shards and a summary word of one bit per non-empty
+   shard, so that a thread looking for work reads the highest priority of busy shards only. */
+
+typedef struct PBUF_SHARDED_T
+{
+  atomic_uint_fast64_t summary;
+  pbuf_shard_t shard[PBUF_SHARDS];
+
+} pbuf_sharded_t;
+
+#endif  /* PBUF_SHARDS */
+
+#ifdef PBUF_RUNTIME_SIZE
+
+size_t PBUF_requiredBytes(size_t capacity, size_t element_size);
+pbuf_t * PBUF_create(void * mem, size_t bytes, size_t capacity, size_t priorities, size_t element_size);
+
+#else
+
+int PBUF_init(pbuf_t * bf);
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
+int PBUF_reset(pbuf_t * bf);
+int PBUF_setOverflow(pbuf_t * bf, unsigned policy);
+int PBUF_empty(pbuf_t * bf);
+int PBUF_full(pbuf_t * bf);
+int PBUF_bufferSize(pbuf_t * bf);
+int PBUF_count(pbuf_t * bf);
+int PBUF_countPriority(pbuf_t * bf, priority_t priority);
 int PBUF_ElementSize(void);
-int PBUF_insert(element_t element, priority_t priority);
-int PBUF_retrieve(element_t * element);
-int PBUF_insertIndex(int * index, priority_t priority);
-int PBUF_retrieveIndex(int * index);
+int PBUF_insert(pbuf_t * bf, element_t element, priority_t priority);
+int PBUF_insertBatch(pbuf_t * bf, const element_t * elements, size_t n, priority_t priority,
+                     size_t * inserted, size_t * overwritten);
+int PBUF_retrieve(pbuf_t * bf, element_t * element);
+size_t PBUF_retrieveBatch(pbuf_t * bf, element_t * out, size_t max, priority_t * pri_out);
+int PBUF_peek(pbuf_t * bf, element_t * element, priority_t * priority);
+size_t PBUF_peekN(pbuf_t * bf, element_t * out, size_t max, priority_t * pri_out);
+int PBUF_reserve(pbuf_t * bf, priority_t priority, void ** slot);
+int PBUF_commit(pbuf_t * bf, void * slot);
+int PBUF_abort(pbuf_t * bf, void * slot);
+int PBUF_acquire(pbuf_t * bf, const void ** slot, priority_t * priority);
+int PBUF_release(pbuf_t * bf, const void * slot);
+pbuf_insert_t PBUF_insertIndex(pbuf_t * bf, priority_t priority);
+int PBUF_retrieveIndex(pbuf_t * bf, int * index);
+
+#ifdef PAYLOAD_BUFFER
+
+int PBUF_insertPayload(pbuf_t * bf, const void * payload, size_t length, priority_t priority);
+int PBUF_retrievePayload(pbuf_t * bf, void * payload, size_t size, size_t * length);
+int PBUF_peekPayload(pbuf_t * bf, void * payload, size_t size, size_t * length, priority_t * priority);
+
+#endif  /* PAYLOAD_BUFFER */
+
+#ifdef PBUF_WAIT
+
+int PBUF_retrieveWait(pbuf_t * bf, element_t * element, priority_t min_priority, uint64_t timeout_ns);
+
+#endif  /* PBUF_WAIT */
+
+#ifdef PBUF_AGING
+
+int PBUF_setAging(pbuf_t * bf, uint32_t threshold);
+
+#endif  /* PBUF_AGING */
+
+#ifdef PBUF_SCHEDULER
+
+int PBUF_setScheduler(pbuf_t * bf, unsigned policy, const uint32_t * weights);
+
+#endif  /* PBUF_SCHEDULER */
+
+#ifdef PBUF_STATISTICS
+
+int PBUF_statistics(pbuf_t * bf, pbuf_stats_t * snapshot);
+int PBUF_resetStatistics(pbuf_t * bf);
+
+#endif  /* PBUF_STATISTICS */
+
+#ifdef PBUF_EVENTFD
+
+int PBUF_readableFd(pbuf_t * bf);
+int PBUF_writableFd(pbuf_t * bf);
+int PBUF_closeFds(pbuf_t * bf);
+
+#endif  /* PBUF_EVENTFD */
+
+#ifdef PBUF_SHARDS
+
+int PBUF_shardedInit(pbuf_sharded_t * sb);
+int PBUF_shardedInsert(pbuf_sharded_t * sb, unsigned shard, element_t element, priority_t priority);
+int PBUF_shardedRetrieve(pbuf_sharded_t * sb, unsigned shard, element_t * element, priority_t * priority);
+
+#endif  /* PBUF_SHARDS */
 
 #ifdef UNIT_TESTS
 
@@ -95,7 +1188,7 @@ int PBUF_retrieveIndex(int * index);
 
 #ifdef DEBUG
 
-void PBUF_print(void);
+void PBUF_print(pbuf_t * bf);
 
 #endif /* DEBUG */
 
@@ -11,52 +11,94 @@
 
 //////////////////////////////// index ////////////////////////////////
 
-check_t checkIndex(index_t index);
-check_t nextIndex(index_t * nextIdx, index_t currentIdx);
-check_t writeNextIndex(index_t currentIdx, index_t nextIdx);
-check_t firstFreeElementIndex(index_t * index);
-index_t headIndex(priority_t priority);
-index_t nextHeadIndex(priority_t priority);
-check_t writeHead(index_t index, priority_t priority);
-index_t tailIndex(void);
-check_t nextTailIndex(index_t * index);
-check_t incTail(void);
-index_t writeTail(index_t index);
-index_t lowestPriorityTail(void);
-check_t remap(index_t a1, index_t a2, index_t b);
-check_t remapNotFull(index_t newIndex, priority_t priority);
-index_t insertPointFull(priority_t priority);
-index_t insertPointNotFull(priority_t priority);
-index_t bridgePointFull(void);
-index_t bridgePointNotFull(void);
-check_t writeElementIndex(index_t * index, priority_t priority);
-check_t overwriteElementIndex(index_t * index, priority_t priority);
-check_t insertIndex(index_t * index, priority_t priority);
-check_t insertEmptyIndex(index_t * index, priority_t priority);
-check_t insertNotFullIndex(index_t * index, priority_t priority);
-check_t insertFullIndex(index_t * index, priority_t priority);
+check_t checkIndex(pbuf_t * bf, index_t index);
+check_t nextIndex(pbuf_t * bf, index_t * nextIdx, index_t currentIdx);
+check_t writeNextIndex(pbuf_t * bf, index_t currentIdx, index_t nextIdx);
+check_t firstFreeElementIndex(pbuf_t * bf, index_t * index);
+index_t headIndex(pbuf_t * bf, priority_t priority);
+index_t nextHeadIndex(pbuf_t * bf, priority_t priority);
+check_t writeHead(pbuf_t * bf, index_t index, priority_t priority);
+index_t tailIndex(pbuf_t * bf);
+check_t nextTailIndex(pbuf_t * bf, index_t * index);
+check_t incTail(pbuf_t * bf);
+index_t writeTail(pbuf_t * bf, index_t index);
+index_t lowestPriorityTail(pbuf_t * bf);
+check_t remap(pbuf_t * bf, index_t a1, index_t a2, index_t b);
+check_t remapNotFull(pbuf_t * bf, index_t newIndex, priority_t priority);
+index_t insertPointFull(pbuf_t * bf, priority_t priority);
+index_t insertPointNotFull(pbuf_t * bf, priority_t priority);
+index_t bridgePointFull(pbuf_t * bf);
+index_t bridgePointNotFull(pbuf_t * bf);
+check_t writeElementIndex(pbuf_t * bf, index_t * index, priority_t priority);
+check_t overwriteElementIndex(pbuf_t * bf, index_t * index, priority_t priority);
+check_t insertIndex(pbuf_t * bf, index_t * index, priority_t priority);
+check_t insertEmptyIndex(pbuf_t * bf, index_t * index, priority_t priority);
+check_t insertNotFullIndex(pbuf_t * bf, index_t * index, priority_t priority);
+check_t insertFullIndex(pbuf_t * bf, index_t * index, priority_t priority);
+check_t removeOldestIndex(pbuf_t * bf, index_t * index, priority_t priority);
 
 //////////////////////////////// priority ////////////////////////////////
 
-check_t validatePriority(priority_t priority);
-check_t lowestPriority(priority_t * priority);
-check_t highestPriority(priority_t * priority);
-check_t nextHighestPriority(priority_t * nextPriority, priority_t priority);
-check_t activeStatus(priority_t priority);
-check_t setActive(priority_t priority);
-check_t setInactive(priority_t priority);
-check_t adjustPriority(void);
-uint8_t activePriorityCount(void);
+check_t validatePriority(pbuf_t * bf, priority_t priority);
+check_t lowestPriority(pbuf_t * bf, priority_t * priority);
+check_t highestPriority(pbuf_t * bf, priority_t * priority);
+check_t nextHighestPriority(pbuf_t * bf, priority_t * nextPriority, priority_t priority);
+check_t nextLowerPriority(pbuf_t * bf, priority_t * nextPriority, priority_t priority);
+check_t activeStatus(pbuf_t * bf, priority_t priority);
+check_t setActive(pbuf_t * bf, priority_t priority);
+check_t setInactive(pbuf_t * bf, priority_t priority);
+check_t adjustPriority(pbuf_t * bf, priority_t * priority);
+uint8_t activePriorityCount(pbuf_t * bf);
+priority_t lowestBit(activity_word_t word);
+priority_t highestBit(activity_word_t word);
+uint8_t bitCount(activity_word_t word);
 
 //////////////////////////////// element ////////////////////////////////
 
-check_t readData(element_t * element, index_t index);
-check_t writeData(element_t element, index_t index);
-check_t insert(element_t element, priority_t priority);
+check_t readData(pbuf_t * bf, element_t * element, index_t index);
+check_t writeData(pbuf_t * bf, element_t element, index_t index);
+check_t insert(pbuf_t * bf, element_t element, priority_t priority);
+check_t insertRun(pbuf_t * bf, const element_t * elements, count_t cells, priority_t priority);
+size_t readRuns(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max);
+size_t peekRuns(pbuf_t * bf, element_t * elements, priority_t * priorities, size_t max);
+void * slotData(pbuf_t * bf, index_t index);
+check_t slotIndex(pbuf_t * bf, const void * slot, index_t * index);
+check_t detachFree(pbuf_t * bf, index_t * index);
+check_t detachFirst(pbuf_t * bf, index_t * index, priority_t * priority);
+void attachFree(pbuf_t * bf, index_t index);
+uint8_t detachState(pbuf_t * bf, index_t index);
+void writeDetachState(pbuf_t * bf, index_t index, uint8_t state);
 
-check_t resetBufferPointers(void);
-check_t resetBuffer(void);
-check_t bufferFull(void);
-check_t bufferEmpty(void);
+check_t resetBufferPointers(pbuf_t * bf);
+check_t resetBuffer(pbuf_t * bf);
+check_t bufferFull(pbuf_t * bf);
+check_t bufferEmpty(pbuf_t * bf);
+
+//////////////////////////////// staging ////////////////////////////////
+
+#ifdef PBUF_STAGED
+
+void resetStage(pbuf_t * bf);
+check_t stageInsert(pbuf_t * bf, element_t element, priority_t priority);
+void drainStage(pbuf_t * bf);
+
+#endif  /* PBUF_STAGED */
+
+#ifdef PBUF_MPSC
+
+void drainLane(pbuf_t * bf, priority_t priority);
+
+#endif  /* PBUF_MPSC */
+
+//////////////////////////////// shards ////////////////////////////////
+
+#ifdef PBUF_SHARDS
+
+void lockShard(pbuf_shard_t * shard);
+void unlockShard(pbuf_shard_t * shard);
+void publishShard(pbuf_sharded_t * sb, uint32_t shard);
+uint32_t chooseShard(pbuf_sharded_t * sb, uint32_t shard);
+
+#endif  /* PBUF_SHARDS */
 
 #endif /* TEST_H */
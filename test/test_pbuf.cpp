@@ -0,0 +1,203 @@
+#include <cstdint>
+#include "pbuf.hpp"
+#include "unity.h"
+#include "unity_fixture.h"
+
+#define TEST_ASSERT_ZERO TEST_ASSERT_FALSE
+
+/**
+   Compare a long pseudo-random sequence of inserts and retrieves on the buffer passed in
+   against a simple model of the intended behaviour, as in the C engine tests. */
+
+template <typename Buffer>
+static void matchReferenceModel(Buffer & buffer, std::uint32_t seed)
+{
+  std::uint32_t modelValue[Buffer::capacity()];
+  std::uint16_t modelPriority[Buffer::capacity()];
+  std::size_t modelCount = 0;
+  std::size_t count;
+  std::size_t pick;
+  std::uint16_t step;
+  std::uint32_t value;
+  std::uint8_t priority;
+  bool result;
+
+  for(step = 0; step < 5000u; step++)
+    {
+      seed = (seed * 1103515245u) + 12345u;
+      priority = static_cast<std::uint8_t>((seed >> 16) % Buffer::priorities());
+      if((seed >> 8) % 3u)
+        {
+          result = buffer.insert(step, priority);
+          if(modelCount < Buffer::capacity())
+            {
+              TEST_ASSERT_TRUE(result);
+              modelValue[modelCount] = step;
+              modelPriority[modelCount++] = priority;
+            }
+          else
+            {
+              // oldest of the lowest priority
+              pick = 0;
+              for(count = 1; count < modelCount; count++)
+                {
+                  if(modelPriority[count] < modelPriority[pick])
+                    {
+                      pick = count;
+                    }
+                }
+              if(modelPriority[pick] <= priority)
+                {
+                  TEST_ASSERT_TRUE(result);
+                  for(count = pick; count < modelCount - 1u; count++)
+                    {
+                      modelValue[count] = modelValue[count + 1u];
+                      modelPriority[count] = modelPriority[count + 1u];
+                    }
+                  modelValue[modelCount - 1u] = step;
+                  modelPriority[modelCount - 1u] = priority;
+                }
+              else
+                {
+                  TEST_ASSERT_FALSE(result);
+                }
+            }
+        }
+      else
+        {
+          result = buffer.retrieve(value);
+          if(modelCount == 0)
+            {
+              TEST_ASSERT_FALSE(result);
+            }
+          else
+            {
+              // oldest of the highest priority
+              pick = 0;
+              for(count = 1; count < modelCount; count++)
+                {
+                  if(modelPriority[count] > modelPriority[pick])
+                    {
+                      pick = count;
+                    }
+                }
+              TEST_ASSERT_TRUE(result);
+              TEST_ASSERT_EQUAL(modelValue[pick], value);
+              modelCount--;
+              for(count = pick; count < modelCount; count++)
+                {
+                  modelValue[count] = modelValue[count + 1u];
+                  modelPriority[count] = modelPriority[count + 1u];
+                }
+            }
+        }
+
+      TEST_ASSERT_EQUAL(modelCount, buffer.count());
+      TEST_ASSERT_EQUAL(modelCount == Buffer::capacity(), buffer.full());
+      TEST_ASSERT_EQUAL(modelCount == 0, buffer.empty());
+    }
+}
+
+TEST_GROUP(pBufCpp);
+
+TEST_SETUP(pBufCpp)
+{
+}
+
+TEST_TEAR_DOWN(pBufCpp)
+{
+}
+
+TEST(pBufCpp, types_should_be_the_smallest_for_the_configuration)
+{
+  TEST_ASSERT_EQUAL(1, sizeof(pbuf::PBuf<std::uint8_t, 256, 3>::index_type));
+  TEST_ASSERT_EQUAL(2, sizeof(pbuf::PBuf<std::uint8_t, 257, 3>::index_type));
+  TEST_ASSERT_EQUAL(2, sizeof(pbuf::PBuf<std::uint8_t, 65536, 3>::index_type));
+  TEST_ASSERT_EQUAL(4, sizeof(pbuf::PBuf<std::uint8_t, 65537, 3>::index_type));
+  TEST_ASSERT_EQUAL(1, sizeof(pbuf::PBuf<std::uint8_t, 255, 3>::count_type));
+  TEST_ASSERT_EQUAL(2, sizeof(pbuf::PBuf<std::uint8_t, 256, 3>::count_type));
+  TEST_ASSERT_EQUAL(1, sizeof(pbuf::PBuf<std::uint8_t, 4, 8>::activity_type));
+  TEST_ASSERT_EQUAL(2, sizeof(pbuf::PBuf<std::uint8_t, 4, 9>::activity_type));
+  TEST_ASSERT_EQUAL(4, sizeof(pbuf::PBuf<std::uint8_t, 4, 32>::activity_type));
+  TEST_ASSERT_EQUAL(8, sizeof(pbuf::PBuf<std::uint8_t, 4, 64>::activity_type));
+  TEST_ASSERT_EQUAL(8, sizeof(pbuf::PBuf<std::uint8_t, 4, 256>::activity_type));
+}
+
+TEST(pBufCpp, insert_and_retrieve_should_follow_priority_order)
+{
+  pbuf::PBuf<std::uint8_t, 4, 3> buffer;
+  std::uint8_t value;
+
+  TEST_ASSERT_TRUE(buffer.empty());
+  TEST_ASSERT_TRUE(buffer.insert(1, 0));
+  TEST_ASSERT_TRUE(buffer.insert(2, 2));
+  TEST_ASSERT_TRUE(buffer.insert(3, 1));
+  TEST_ASSERT_TRUE(buffer.insert(4, 2));
+  TEST_ASSERT_TRUE(buffer.full());
+  TEST_ASSERT_EQUAL(2, buffer.count(2));
+
+  // overwrite the low priority element, then refuse a low priority one
+  TEST_ASSERT_TRUE(buffer.insert(5, 1));
+  TEST_ASSERT_FALSE(buffer.insert(6, 0));
+  TEST_ASSERT_FALSE(buffer.insert(7, 3));
+  TEST_ASSERT_EQUAL(0, buffer.count(0));
+  TEST_ASSERT_EQUAL(0, buffer.count(3));
+
+  TEST_ASSERT_TRUE(buffer.retrieve(value));
+  TEST_ASSERT_EQUAL(2, value);
+  TEST_ASSERT_TRUE(buffer.retrieve(value));
+  TEST_ASSERT_EQUAL(4, value);
+  TEST_ASSERT_TRUE(buffer.retrieve(value));
+  TEST_ASSERT_EQUAL(3, value);
+  TEST_ASSERT_TRUE(buffer.retrieve(value));
+  TEST_ASSERT_EQUAL(5, value);
+  TEST_ASSERT_FALSE(buffer.retrieve(value));
+}
+
+TEST(pBufCpp, structs_should_be_stored_directly)
+{
+  struct Message
+  {
+    std::uint32_t id;
+    char text[12];
+  };
+  pbuf::PBuf<Message, 3, 2> buffer;
+  Message message = { 7u, "hello" };
+
+  TEST_ASSERT_TRUE(buffer.insert(message, 0));
+  message = { 8u, "urgent" };
+  TEST_ASSERT_TRUE(buffer.insert(message, 1));
+  TEST_ASSERT_TRUE(buffer.retrieve(message));
+  TEST_ASSERT_EQUAL(8, message.id);
+  TEST_ASSERT_EQUAL_STRING("urgent", message.text);
+  TEST_ASSERT_TRUE(buffer.retrieve(message));
+  TEST_ASSERT_EQUAL(7, message.id);
+  TEST_ASSERT_EQUAL_STRING("hello", message.text);
+}
+
+TEST(pBufCpp, reset_should_empty_the_buffer)
+{
+  pbuf::PBuf<std::uint16_t, 5, 4> buffer;
+  std::uint16_t value;
+
+  buffer.insert(1, 3);
+  buffer.insert(2, 0);
+  buffer.reset();
+  TEST_ASSERT_TRUE(buffer.empty());
+  TEST_ASSERT_EQUAL(0, buffer.count());
+  TEST_ASSERT_EQUAL(0, buffer.count(3));
+  TEST_ASSERT_FALSE(buffer.retrieve(value));
+}
+
+TEST(pBufCpp, random_sequence_should_match_reference_model)
+{
+  static pbuf::PBuf<std::uint32_t, 4, 3> small;
+  static pbuf::PBuf<std::uint32_t, 37, 7> medium;
+  static pbuf::PBuf<std::uint32_t, 300, 64> wide;
+  static pbuf::PBuf<std::uint32_t, 50, 200> leaves;
+
+  matchReferenceModel(small, 12345u);
+  matchReferenceModel(medium, 54321u);
+  matchReferenceModel(wide, 2468u);
+  matchReferenceModel(leaves, 1357u);
+}
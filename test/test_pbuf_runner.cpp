@@ -0,0 +1,11 @@
+#include "unity.h"
+#include "unity_fixture.h"
+
+TEST_GROUP_RUNNER(pBufCpp)
+{
+  RUN_TEST_CASE(pBufCpp, types_should_be_the_smallest_for_the_configuration);
+  RUN_TEST_CASE(pBufCpp, insert_and_retrieve_should_follow_priority_order);
+  RUN_TEST_CASE(pBufCpp, structs_should_be_stored_directly);
+  RUN_TEST_CASE(pBufCpp, reset_should_empty_the_buffer);
+  RUN_TEST_CASE(pBufCpp, random_sequence_should_match_reference_model);
+}
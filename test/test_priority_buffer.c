@@ -1,3 +1,15 @@
+#if defined(PBUF_SPSC) || defined(PBUF_MPSC) || defined(PBUF_SHARDS) || defined(PBUF_CRITICAL_SPINLOCK) || \
+  defined(PBUF_WAIT) || defined(PBUF_EVENTFD)
+#  define _POSIX_C_SOURCE 200112L
+#  include <pthread.h>
+#  include <sched.h>
+#  include <time.h>
+#endif  /* PBUF_SPSC || PBUF_MPSC || PBUF_SHARDS || PBUF_CRITICAL_SPINLOCK || PBUF_WAIT || PBUF_EVENTFD */
+#ifdef PBUF_EVENTFD
+#  include <sys/epoll.h>
+#  include <unistd.h>
+#endif  /* PBUF_EVENTFD */
+#include <string.h>
 #include "priority_buffer.h"
 #include "defs.h"
 #include "unity.h"
@@ -8,13 +20,44 @@
 
 TEST_GROUP(pBuf);
 
+#ifdef PBUF_RUNTIME_SIZE
+
+#define MEMORY_WORDS ((sizeof(pbuf_t) + (BUFFER_SIZE * (sizeof(cell_t) + sizeof(element_t))) + \
+                       (DETACH_MAP_WORDS(BUFFER_SIZE) * sizeof(uint32_t)) + (3u * PBUF_ALIGNMENT)) / \
+                      sizeof(uint64_t))
+
+static uint64_t memory[2][MEMORY_WORDS];
+static pbuf_t * bf;
+
+/**
+   Create an instance at the compile-time maxima in the memory block passed in. */
+
+static pbuf_t * createBuffer(uint64_t * block)
+{
+  return PBUF_create(block, sizeof(memory[0]), BUFFER_SIZE, PRIORITY_SIZE, sizeof(element_t));
+}
+
+#else
+
+static pbuf_t buffer;
+static pbuf_t * bf = &buffer;
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
 TEST_SETUP(pBuf)
 {
-  PBUF_reset();
+#ifdef PBUF_RUNTIME_SIZE
+  bf = createBuffer(memory[0]);
+#else
+  PBUF_init(bf);
+#endif  /* PBUF_RUNTIME_SIZE */
 }
 
 TEST_TEAR_DOWN(pBuf)
 {
+#ifdef PBUF_EVENTFD
+  PBUF_closeFds(bf);
+#endif  /* PBUF_EVENTFD */
 }
 
 TEST(pBuf, bufferFull_returns_BUFFER_FULL_when_buffer_full)
@@ -23,36 +66,36 @@ TEST(pBuf, bufferFull_returns_BUFFER_FULL_when_buffer_full)
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      insert(123, LOW_PRI);
+      insert(bf, 123, LOW_PRI);
     }
 
-  TEST_ASSERT_EQUAL(BUFFER_FULL, bufferFull());
+  TEST_ASSERT_EQUAL(BUFFER_FULL, bufferFull(bf));
 }
 
 TEST(pBuf, bufferFull_returns_BUFFER_NOT_FULL_when_buffer_not_full)
 {
-  TEST_ASSERT_EQUAL(BUFFER_NOT_FULL, bufferFull());
+  TEST_ASSERT_EQUAL(BUFFER_NOT_FULL, bufferFull(bf));
 }
 
 TEST(pBuf, bufferEmpty_returns_BUFFER_EMPTY_following_a_reset)
 {
-  TEST_ASSERT_EQUAL(BUFFER_EMPTY, bufferEmpty());
+  TEST_ASSERT_EQUAL(BUFFER_EMPTY, bufferEmpty(bf));
 }
 
 TEST(pBuf, bufferEmpty_returns_BUFFER_NOT_EMPTY_on_activity)
 {
-  setActive(HIGH_PRI);
-  TEST_ASSERT_EQUAL(BUFFER_NOT_EMPTY, bufferEmpty());
+  setActive(bf, HIGH_PRI);
+  TEST_ASSERT_EQUAL(BUFFER_NOT_EMPTY, bufferEmpty(bf));
 }
 
 TEST(pBuf, PBUF_empty_should_return_non_zero_following_a_reset)
 {
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, PBUF_empty_should_return_TRUE_following_a_reset)
 {
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, writeElementIndex_should_update_the_index_correctly)
@@ -62,10 +105,10 @@ TEST(pBuf, writeElementIndex_should_update_the_index_correctly)
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_WRITE, writeElementIndex(&index, LOW_PRI));
+      TEST_ASSERT_EQUAL(VALID_WRITE, writeElementIndex(bf, &index, LOW_PRI));
       TEST_ASSERT_EQUAL(count, index);
     }
-  TEST_ASSERT_EQUAL(INVALID_WRITE, writeElementIndex(&index, LOW_PRI));
+  TEST_ASSERT_EQUAL(INVALID_WRITE, writeElementIndex(bf, &index, LOW_PRI));
 }
 
 TEST(pBuf, activeStatus_should_return_INACTIVE_for_all_priorities_after_reset)
@@ -74,7 +117,7 @@ TEST(pBuf, activeStatus_should_return_INACTIVE_for_all_priorities_after_reset)
 
   for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(INACTIVE, activeStatus(count));
+      TEST_ASSERT_EQUAL(INACTIVE, activeStatus(bf, count));
     }
 }
 
@@ -84,14 +127,14 @@ TEST(pBuf, activeStatus_should_return_ACTIVE_for_all_priorities_after_they_are_s
 
   for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_ACTIVE, setActive(count));
-      TEST_ASSERT_EQUAL(ACTIVE, activeStatus(count));
+      TEST_ASSERT_EQUAL(VALID_ACTIVE, setActive(bf, count));
+      TEST_ASSERT_EQUAL(ACTIVE, activeStatus(bf, count));
     }
 }
 
 TEST(pBuf, setAactive_should_return_INVALID_ACTIVE_when_passed_an_invalid_priority)
 {
-  TEST_ASSERT_EQUAL(INVALID_ACTIVE, setActive(PRIORITY_SIZE));
+  TEST_ASSERT_EQUAL(INVALID_ACTIVE, setActive(bf, PRIORITY_SIZE));
 }
 
 TEST(pBuf, setAactive_should_set_the_relevant_activity_flag_when_passed_a_valid_priority)
@@ -100,9 +143,9 @@ TEST(pBuf, setAactive_should_set_the_relevant_activity_flag_when_passed_a_valid_
 
   for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(INACTIVE, activeStatus(count));
-      TEST_ASSERT_EQUAL(VALID_ACTIVE, setActive(count));
-      TEST_ASSERT_EQUAL(ACTIVE, activeStatus(count));
+      TEST_ASSERT_EQUAL(INACTIVE, activeStatus(bf, count));
+      TEST_ASSERT_EQUAL(VALID_ACTIVE, setActive(bf, count));
+      TEST_ASSERT_EQUAL(ACTIVE, activeStatus(bf, count));
     }
 }
 
@@ -112,18 +155,18 @@ TEST(pBuf, setInactive_should_reset_the_relevant_activity_flag_when_passed_a_val
 
   for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_ACTIVE, setActive(count));
+      TEST_ASSERT_EQUAL(VALID_ACTIVE, setActive(bf, count));
     }
   for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_ACTIVE, setInactive(count));
-      TEST_ASSERT_EQUAL(INACTIVE, activeStatus(count));
+      TEST_ASSERT_EQUAL(VALID_ACTIVE, setInactive(bf, count));
+      TEST_ASSERT_EQUAL(INACTIVE, activeStatus(bf, count));
     }
 }
 
 TEST(pBuf, setInactive_should_return_INVALID_ACTIVE_when_passed_an_invalid_priority)
 {
-  TEST_ASSERT_EQUAL(INVALID_ACTIVE, setInactive(PRIORITY_SIZE));
+  TEST_ASSERT_EQUAL(INVALID_ACTIVE, setInactive(bf, PRIORITY_SIZE));
 }
 
 TEST(pBuf, validatePriority_should_return_VALID_PRIORITY_when_passed_valid_priority)
@@ -132,62 +175,62 @@ TEST(pBuf, validatePriority_should_return_VALID_PRIORITY_when_passed_valid_prior
 
   for(count = LOW_PRI; count < PRIORITY_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_PRIORITY, validatePriority(count));
+      TEST_ASSERT_EQUAL(VALID_PRIORITY, validatePriority(bf, count));
     }
 }
 
 TEST(pBuf, validatePriority_should_return_INVALID_PRIORITY_when_passed_an_invalid_priority)
 {
-  uint8_t result = validatePriority(PRIORITY_SIZE);
+  uint8_t result = validatePriority(bf, PRIORITY_SIZE);
   TEST_ASSERT_EQUAL(INVALID_PRIORITY, result);
 }
 
 TEST(pBuf, PBUF_bufferSize_should_return_correct_buffer_size)
 {
-  uint16_t size = PBUF_bufferSize();
+  uint16_t size = PBUF_bufferSize(bf);
   TEST_ASSERT_EQUAL(BUFFER_SIZE, size);
 }
 
 TEST(pBuf, writeHead_should_write_head)
 {
-  TEST_ASSERT_EQUAL(INVALID_WRITE, writeHead(0, PRIORITY_SIZE));
+  TEST_ASSERT_EQUAL(INVALID_WRITE, writeHead(bf, 0, PRIORITY_SIZE));
 }
 
 TEST(pBuf, firstfreeElementIndex_should_return_next_tail_with_an_empty_buffer)
 {
-  uint8_t index;
+  index_t index;
 
-  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(&index));
+  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(bf, &index));
   TEST_ASSERT_EQUAL(0, index);
 }
 
 TEST(pBuf, firstfreeElementIndex_should_return_the_correct_index_when_elements_in_buffer)
 {
-  uint8_t index;
+  index_t index;
 
-  insertIndex(&index, HIGH_PRI);
+  insertIndex(bf, &index, HIGH_PRI);
   TEST_ASSERT_EQUAL(0, index);
-  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(&index));
+  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(bf, &index));
   TEST_ASSERT_EQUAL(1, index);
 
-  PBUF_reset();
+  PBUF_reset(bf);
 
-  insertIndex(&index, HIGH_PRI);
-  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(&index));
+  insertIndex(bf, &index, HIGH_PRI);
+  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(bf, &index));
   TEST_ASSERT_EQUAL(1, index);
-  insertIndex(&index, HIGH_PRI);
-  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(&index));
+  insertIndex(bf, &index, HIGH_PRI);
+  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(bf, &index));
   TEST_ASSERT_EQUAL(2, index);
-  insertIndex(&index, HIGH_PRI);
-  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(&index));
+  insertIndex(bf, &index, HIGH_PRI);
+  TEST_ASSERT_EQUAL(VALID_INDEX, firstFreeElementIndex(bf, &index));
   TEST_ASSERT_EQUAL(3, index);
-  insertIndex(&index, HIGH_PRI);
-  TEST_ASSERT_EQUAL(INVALID_INDEX, firstFreeElementIndex(&index));
+  insertIndex(bf, &index, HIGH_PRI);
+  TEST_ASSERT_EQUAL(INVALID_INDEX, firstFreeElementIndex(bf, &index));
 }
 
 TEST(pBuf, writeElement_should_set_head)
 {
-  TEST_ASSERT_EQUAL(VALID_WRITE, insert(42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_WRITE, insert(bf, 42, LOW_PRI));
 }
 
 TEST(pBuf, insert_pL_should_return_VALID_INSERT)
@@ -195,21 +238,21 @@ TEST(pBuf, insert_pL_should_return_VALID_INSERT)
   uint16_t count;
   uint8_t value;
 
-  insert(42, LOW_PRI);
-  insert(43, LOW_PRI);
-  insert(44, LOW_PRI);
-  insert(45, LOW_PRI);
-  insert(46, LOW_PRI);
-  insert(47, LOW_PRI);
-  insert(48, LOW_PRI);
+  insert(bf, 42, LOW_PRI);
+  insert(bf, 43, LOW_PRI);
+  insert(bf, 44, LOW_PRI);
+  insert(bf, 45, LOW_PRI);
+  insert(bf, 46, LOW_PRI);
+  insert(bf, 47, LOW_PRI);
+  insert(bf, 48, LOW_PRI);
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_INSERT, insert(count, LOW_PRI));
+      TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, count, LOW_PRI));
     }
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
       TEST_ASSERT_EQUAL(count, value);
     }
 }
@@ -217,22 +260,22 @@ TEST(pBuf, insert_pL_should_return_VALID_INSERT)
 TEST(pBuf, PBUB_retrieve_should_retrieve_the_next_element)
 {
   uint8_t element;
-  insert(42, LOW_PRI);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&element));
+  insert(bf, 42, LOW_PRI);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
   TEST_ASSERT_EQUAL(42, element);
 }
 
 TEST(pBuf, PBUB_retrieve_should_return_INVALID_ELEMENT_if_the_buffer_is_empty)
 {
   uint8_t element;
-  TEST_ASSERT_EQUAL(INVALID_RETRIEVE, PBUF_retrieve(&element));
+  TEST_ASSERT_EQUAL(INVALID_RETRIEVE, PBUF_retrieve(bf, &element));
 }
 
 TEST(pBuf, insertEmptyIndex_should_insert_to_the_beginning_of_the_empty_buffer)
 {
   index_t index;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insertEmptyIndex(&index, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insertEmptyIndex(bf, &index, LOW_PRI));
   TEST_ASSERT_EQUAL(0, index);
 
 }
@@ -240,13 +283,13 @@ TEST(pBuf, insertNotFull_inserts_regardless_of_priority_to_the_end_of_the_buffer
 {
   index_t index;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insertEmptyIndex(&index, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insertEmptyIndex(bf, &index, LOW_PRI));
   TEST_ASSERT_EQUAL(0, index);
-  TEST_ASSERT_EQUAL(VALID_INSERT, insertNotFullIndex(&index, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insertNotFullIndex(bf, &index, HIGH_PRI));
   TEST_ASSERT_EQUAL(1, index);
-  TEST_ASSERT_EQUAL(VALID_INSERT, insertNotFullIndex(&index, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insertNotFullIndex(bf, &index, MID_PRI));
   TEST_ASSERT_EQUAL(2, index);
-  TEST_ASSERT_EQUAL(VALID_INSERT, insertNotFullIndex(&index, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insertNotFullIndex(bf, &index, LOW_PRI));
   TEST_ASSERT_EQUAL(3, index);
 }
 
@@ -256,11 +299,11 @@ TEST(pBuf, insert_pM_should_return_VALID_INSERT)
   uint8_t value;
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_INSERT, insert(count % BUFFER_SIZE, MID_PRI));
+      TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, count % BUFFER_SIZE, MID_PRI));
     }
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
       TEST_ASSERT_EQUAL(count, value);
     }
 }
@@ -271,12 +314,12 @@ TEST(pBuf, insert_pH_should_return_VALID_INSERT)
   uint8_t value;
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_INSERT, insert(count % BUFFER_SIZE, HIGH_PRI));
+      TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, count % BUFFER_SIZE, HIGH_PRI));
     }
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
       TEST_ASSERT_EQUAL(count, value);
     }
 }
@@ -288,16 +331,16 @@ TEST(pBuf, insert_pL_should_return_overwrite_on_wraparound_VALID_INSERT)
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_INSERT, insert(count % BUFFER_SIZE, LOW_PRI));
+      TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, count % BUFFER_SIZE, LOW_PRI));
     }
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
 
   for(count = 0; count < BUFFER_SIZE - 1; count++)
     {
-      TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
       TEST_ASSERT_EQUAL((count + 1) % BUFFER_SIZE, value);
     }
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
 }
 
 TEST(pBuf, insert_pM_should_return_overwrite_on_wraparound_VALID_INSERT)
@@ -307,16 +350,16 @@ TEST(pBuf, insert_pM_should_return_overwrite_on_wraparound_VALID_INSERT)
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_INSERT, insert(count % BUFFER_SIZE, MID_PRI));
+      TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, count % BUFFER_SIZE, MID_PRI));
     }
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
 
   for(count = 0; count < BUFFER_SIZE - 1; count++)
     {
-      TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
       TEST_ASSERT_EQUAL((count + 1) % BUFFER_SIZE, value);
     }
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
 }
 
@@ -327,14 +370,14 @@ TEST(pBuf, insert_pH_should_return_INSERT_FAIL_on_wraparound_VALID_INSERT)
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_INSERT, insert(count % BUFFER_SIZE, HIGH_PRI));
+      TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, count % BUFFER_SIZE, HIGH_PRI));
     }
 
-  TEST_ASSERT_EQUAL(INSERT_FAIL, insert(42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(INSERT_FAIL, insert(bf, 42, HIGH_PRI));
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
       TEST_ASSERT_EQUAL((count) % BUFFER_SIZE, value);
     }
 }
@@ -343,745 +386,745 @@ TEST(pBuf, insert_pH_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pM_sequence_should_be_reprioritised)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pH_sequence_should_be_reprioritised)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pL_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pL_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pL_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pM_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pM_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pH_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pH_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pH_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pH_pM_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pL_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pL_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pL_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pM_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pM_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pM_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pH_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pH_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pM_pH_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pH_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pH_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pH_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pM_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pM_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pM_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pL_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pL_pM_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pL_pL_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insert_pL_pM_pH_pL_pM_pH_sequence_should_be_in_order)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(45, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 45, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(44, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(43, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(42, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(45, value);
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(46, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(47, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 46, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 47, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(47, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(46, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, saturation_sequence_low_priority)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(45, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(46, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(47, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(48, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(49, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(50, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(51, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 45, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 46, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 47, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 48, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 49, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 50, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 51, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(48, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(49, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(50, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(51, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, saturation_sequence_mid_priority)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(45, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(46, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(47, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(48, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(49, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(50, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(51, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 45, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 46, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 47, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 48, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 49, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 50, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 51, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(48, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(49, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(50, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(51, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, saturation_sequence_high_priority)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(42, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(43, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(44, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(45, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(46, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(47, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(48, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(49, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(50, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(51, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 42, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 43, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 44, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 45, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 46, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 47, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 48, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 49, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 50, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 51, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(48, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(49, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(50, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(51, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, activePriorityCount_should_return_number_of_active_priorities)
 {
-  TEST_ASSERT_EQUAL(0, activePriorityCount());
-  setActive(HIGH_PRI);
-  TEST_ASSERT_EQUAL(1, activePriorityCount());
-  setActive(LOW_PRI);
-  TEST_ASSERT_EQUAL(2, activePriorityCount());
-  setActive(LOW_PRI);
-  TEST_ASSERT_EQUAL(2, activePriorityCount());
+  TEST_ASSERT_EQUAL(0, activePriorityCount(bf));
+  setActive(bf, HIGH_PRI);
+  TEST_ASSERT_EQUAL(1, activePriorityCount(bf));
+  setActive(bf, LOW_PRI);
+  TEST_ASSERT_EQUAL(2, activePriorityCount(bf));
+  setActive(bf, LOW_PRI);
+  TEST_ASSERT_EQUAL(2, activePriorityCount(bf));
 }
 
 TEST(pBuf, add_high_priority_to_buffer_full_of_low)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(25, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 25, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(25, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, add_mid_priority_to_buffer_full_of_low)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(25, MID_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 25, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(25, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, add_high_priority_to_buffer_full_of_mid)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(25, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 25, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(25, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, add_mid_priority_to_buffer_full_of_high_returns_INVALID_INSERT)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, HIGH_PRI));
-  TEST_ASSERT_EQUAL(INVALID_INSERT, insert(25, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, HIGH_PRI));
+  TEST_ASSERT_EQUAL(INVALID_INSERT, insert(bf, 25, MID_PRI));
 }
 
 TEST(pBuf, add_low_priority_to_buffer_full_of_mid_returns_INVALID_INSERT)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, MID_PRI));
-  TEST_ASSERT_EQUAL(INVALID_INSERT, insert(25, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, MID_PRI));
+  TEST_ASSERT_EQUAL(INVALID_INSERT, insert(bf, 25, LOW_PRI));
 }
 
 TEST(pBuf, pL_pL_pL_pL_pL_pH_pH_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, LOW_PRI));//oldest
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(25, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(26, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(27, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(28, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, LOW_PRI));//oldest
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 25, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 26, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 27, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 28, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(26, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(27, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(28, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(25, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, pL_pL_pL_pL_pL_pH_pH_pH_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, LOW_PRI));//oldest
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(25, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(26, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(27, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, LOW_PRI));//oldest
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 25, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 26, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 27, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(25, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(26, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(27, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, pL_pL_pL_pH_pH_pH_pH_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(25, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(26, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 25, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 26, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(25, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(26, value);
 }
 
@@ -1089,212 +1132,212 @@ TEST(pBuf, pL_pL_pL_pM_pH_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(21, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, pL_pL_pL_pM_pM_pH_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(21, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, pL_pM_pH_pL_pH_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(21, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, pL_pL_pM_pM_pL_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(21, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, pH_pM_pM_pL_pH_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(20, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(21, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, insertPointFull_should_return_next_highest_head_adding_pH_to_pH_pH_pH_pL)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(2, insertPointFull(HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(2, insertPointFull(bf, HIGH_PRI));
 }
 
 TEST(pBuf, insertPointFull_should_return_next_highest_head_adding_pM_to_pM_pM_pM_pL)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(2, insertPointFull(MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(2, insertPointFull(bf, MID_PRI));
 }
 
 TEST(pBuf, insertPointFull_should_return_next_highest_head_adding_pH_to_pM_pM_pM_pL)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(3, insertPointFull(HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(3, insertPointFull(bf, HIGH_PRI));
 }
 
 TEST(pBuf, insertPointFull_should_return_new_pri_head_adding_pL_to_pH_pH_pL_pL)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(3, insertPointFull(LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(3, insertPointFull(bf, LOW_PRI));
 }
 
 TEST(pBuf, headIndex_should_return_the_correct_head_value)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, HIGH_PRI));
-  TEST_ASSERT_EQUAL(0, headIndex(HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(1, headIndex(LOW_PRI));
-  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, headIndex(MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, HIGH_PRI));
+  TEST_ASSERT_EQUAL(0, headIndex(bf, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(1, headIndex(bf, LOW_PRI));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, headIndex(bf, MID_PRI));
 }
 
 TEST(pBuf, nextHeadIndex_should_return_the_correct_next_head_value)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, LOW_PRI));
-  TEST_ASSERT_EQUAL(1, nextHeadIndex(HIGH_PRI));
-  TEST_ASSERT_EQUAL(2, nextHeadIndex(LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, LOW_PRI));
+  TEST_ASSERT_EQUAL(1, nextHeadIndex(bf, HIGH_PRI));
+  TEST_ASSERT_EQUAL(2, nextHeadIndex(bf, LOW_PRI));
 }
 
 TEST(pBuf, pL_pM_pM_pH_pH_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, HIGH_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(23, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(24, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(21, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(22, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, pH_pH_pM_pL_pM_pM_pH_pH_pM_pL_should_resequence_correctly)
 {
   uint8_t value;
 
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, LOW_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(25, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(26, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(27, HIGH_PRI));
-  TEST_ASSERT_EQUAL(INVALID_INSERT, insert(28, MID_PRI));
-  TEST_ASSERT_EQUAL(INVALID_INSERT, insert(29, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, LOW_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 25, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 26, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 27, HIGH_PRI));
+  TEST_ASSERT_EQUAL(INVALID_INSERT, insert(bf, 28, MID_PRI));
+  TEST_ASSERT_EQUAL(INVALID_INSERT, insert(bf, 29, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(20, value);
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(30, LOW_PRI));
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 30, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(21, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(26, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(27, value);
-  TEST_ASSERT_ZERO(PBUF_retrieve(&value));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
   TEST_ASSERT_EQUAL(30, value);
-  TEST_ASSERT_TRUE(PBUF_empty());
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
 }
 
 TEST(pBuf, pH_pH_pH_pM_pM_pM_should_resequence_correctly)
 {
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(20, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(21, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(22, HIGH_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(23, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(24, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(25, MID_PRI));
-  TEST_ASSERT_EQUAL(VALID_INSERT, insert(26, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 20, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 21, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 22, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 23, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 24, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 25, MID_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insert(bf, 26, MID_PRI));
 }
 
 TEST(pBuf, insertIndex_pL_should_return_VALID_INSERT)
@@ -1304,13 +1347,1956 @@ TEST(pBuf, insertIndex_pL_should_return_VALID_INSERT)
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_INSERT, insertIndex(&index, LOW_PRI));
+      TEST_ASSERT_EQUAL(VALID_INSERT, insertIndex(bf, &index, LOW_PRI));
       TEST_ASSERT_EQUAL(count, index);
     }
 
   for(count = 0; count < BUFFER_SIZE; count++)
     {
-      TEST_ASSERT_EQUAL(VALID_INSERT, insertIndex(&index, LOW_PRI));
+      TEST_ASSERT_EQUAL(VALID_INSERT, insertIndex(bf, &index, LOW_PRI));
       TEST_ASSERT_EQUAL(count, index);
     }
 }
+
+TEST(pBuf, separate_instances_should_not_share_state)
+{
+#ifdef PBUF_RUNTIME_SIZE
+  pbuf_t * other = createBuffer(memory[1]);
+#else
+  pbuf_t otherBuffer;
+  pbuf_t * other = &otherBuffer;
+#endif  /* PBUF_RUNTIME_SIZE */
+  uint8_t value;
+
+#ifndef PBUF_RUNTIME_SIZE
+  TEST_ASSERT_ZERO(PBUF_init(other));
+#endif  /* ! PBUF_RUNTIME_SIZE */
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 42, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(other, 43, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(other, 44, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
+  TEST_ASSERT_EQUAL(42, value);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+  TEST_ASSERT_FALSE(PBUF_empty(other));
+  TEST_ASSERT_ZERO(PBUF_retrieve(other, &value));
+  TEST_ASSERT_EQUAL(43, value);
+  TEST_ASSERT_ZERO(PBUF_retrieve(other, &value));
+  TEST_ASSERT_EQUAL(44, value);
+  TEST_ASSERT_TRUE(PBUF_empty(other));
+}
+
+TEST(pBuf, lowestBit_and_highestBit_should_find_the_extreme_set_bits)
+{
+  TEST_ASSERT_EQUAL(0, lowestBit(1u));
+  TEST_ASSERT_EQUAL(0, highestBit(1u));
+  TEST_ASSERT_EQUAL(1, lowestBit(0x06u));
+  TEST_ASSERT_EQUAL(2, highestBit(0x06u));
+  TEST_ASSERT_EQUAL(7, lowestBit(0x80u));
+  TEST_ASSERT_EQUAL(7, highestBit(0x80u));
+  TEST_ASSERT_EQUAL(ACTIVITY_BITS - 1u, lowestBit((activity_word_t) 1u << (ACTIVITY_BITS - 1u)));
+  TEST_ASSERT_EQUAL(ACTIVITY_BITS - 1u, highestBit((activity_word_t) ~(activity_word_t) 0u));
+  TEST_ASSERT_EQUAL(0, lowestBit((activity_word_t) ~(activity_word_t) 0u));
+}
+
+TEST(pBuf, bitCount_should_count_the_set_bits)
+{
+  TEST_ASSERT_EQUAL(0, bitCount(0u));
+  TEST_ASSERT_EQUAL(1, bitCount(0x40u));
+  TEST_ASSERT_EQUAL(4, bitCount(0xA5u));
+  TEST_ASSERT_EQUAL(ACTIVITY_BITS, bitCount((activity_word_t) ~(activity_word_t) 0u));
+}
+
+TEST(pBuf, lowest_highest_and_nextHighest_priority_should_track_activity)
+{
+  priority_t priority;
+
+  TEST_ASSERT_EQUAL(INVALID_PRIORITY, lowestPriority(bf, &priority));
+  TEST_ASSERT_EQUAL(INVALID_PRIORITY, highestPriority(bf, &priority));
+  setActive(bf, HIGH_PRI);
+  setActive(bf, MID_PRI);
+  TEST_ASSERT_EQUAL(VALID_PRIORITY, lowestPriority(bf, &priority));
+  TEST_ASSERT_EQUAL(MID_PRI, priority);
+  TEST_ASSERT_EQUAL(VALID_PRIORITY, highestPriority(bf, &priority));
+  TEST_ASSERT_EQUAL(HIGH_PRI, priority);
+  TEST_ASSERT_EQUAL(VALID_PRIORITY, nextHighestPriority(bf, &priority, LOW_PRI));
+  TEST_ASSERT_EQUAL(MID_PRI, priority);
+  TEST_ASSERT_EQUAL(VALID_PRIORITY, nextHighestPriority(bf, &priority, MID_PRI));
+  TEST_ASSERT_EQUAL(HIGH_PRI, priority);
+  TEST_ASSERT_EQUAL(INVALID_PRIORITY, nextHighestPriority(bf, &priority, HIGH_PRI));
+  setInactive(bf, HIGH_PRI);
+  TEST_ASSERT_EQUAL(INVALID_PRIORITY, nextHighestPriority(bf, &priority, MID_PRI));
+  setInactive(bf, MID_PRI);
+  TEST_ASSERT_EQUAL(BUFFER_EMPTY, bufferEmpty(bf));
+}
+
+TEST(pBuf, insertPointNotFull_should_follow_the_newest_element_of_the_same_priority)
+{
+  index_t index;
+
+  TEST_ASSERT_EQUAL(VALID_INSERT, insertIndex(bf, &index, HIGH_PRI));
+  TEST_ASSERT_EQUAL(VALID_INSERT, insertIndex(bf, &index, MID_PRI));
+  TEST_ASSERT_EQUAL(1, index);
+  TEST_ASSERT_EQUAL(1, insertPointNotFull(bf, MID_PRI));
+  TEST_ASSERT_EQUAL(1, insertPointNotFull(bf, LOW_PRI));
+  TEST_ASSERT_EQUAL(0, insertPointNotFull(bf, HIGH_PRI));
+}
+
+// an SPSC build only stages inserts, so tests checking the result of an insert straight away are left out
+#ifndef PBUF_STAGED
+
+/**
+   Compare a long pseudo-random sequence of inserts and retrieves against a
+   simple model of the intended behaviour: retrieve the oldest of the highest
+   priority, and when full overwrite the oldest of the lowest priority unless
+   that is higher than the new element. */
+
+TEST(pBuf, random_sequence_should_match_reference_model)
+{
+  element_t modelValue[BUFFER_SIZE];
+  priority_t modelPriority[BUFFER_SIZE];
+  uint16_t modelCount = 0;
+  uint16_t count;
+  uint16_t pick;
+  uint16_t step;
+  uint32_t seed = 12345u;
+  element_t value;
+  priority_t priority;
+  int result;
+
+  for(step = 0; step < 5000u; step++)
+    {
+      seed = (seed * 1103515245u) + 12345u;
+      priority = (priority_t) ((seed >> 16) % PRIORITY_SIZE);
+      if((seed >> 8) % 3u)
+        {
+          result = PBUF_insert(bf, (element_t) step, priority);
+          if(modelCount < BUFFER_SIZE)
+            {
+              TEST_ASSERT_ZERO(result);
+              modelValue[modelCount] = (element_t) step;
+              modelPriority[modelCount++] = priority;
+            }
+          else
+            {
+              // oldest of the lowest priority
+              pick = 0;
+              for(count = 1; count < modelCount; count++)
+                {
+                  if(modelPriority[count] < modelPriority[pick])
+                    {
+                      pick = count;
+                    }
+                }
+              if(modelPriority[pick] <= priority)
+                {
+                  TEST_ASSERT_ZERO(result);
+                  for(count = pick; count < modelCount - 1u; count++)
+                    {
+                      modelValue[count] = modelValue[count + 1u];
+                      modelPriority[count] = modelPriority[count + 1u];
+                    }
+                  modelValue[modelCount - 1u] = (element_t) step;
+                  modelPriority[modelCount - 1u] = priority;
+                }
+              else
+                {
+                  TEST_ASSERT_TRUE(result);
+                }
+            }
+        }
+      else
+        {
+          result = PBUF_retrieve(bf, &value);
+          if(modelCount == 0)
+            {
+              TEST_ASSERT_TRUE(result);
+            }
+          else
+            {
+              // oldest of the highest priority
+              pick = 0;
+              for(count = 1; count < modelCount; count++)
+                {
+                  if(modelPriority[count] > modelPriority[pick])
+                    {
+                      pick = count;
+                    }
+                }
+              TEST_ASSERT_ZERO(result);
+              TEST_ASSERT_EQUAL(modelValue[pick], value);
+              modelCount--;
+              for(count = pick; count < modelCount; count++)
+                {
+                  modelValue[count] = modelValue[count + 1u];
+                  modelPriority[count] = modelPriority[count + 1u];
+                }
+            }
+        }
+
+      TEST_ASSERT_EQUAL(modelCount, PBUF_count(bf));
+      TEST_ASSERT_EQUAL(modelCount == BUFFER_SIZE, PBUF_full(bf));
+      TEST_ASSERT_EQUAL(modelCount == 0, PBUF_empty(bf));
+      pick = 0;
+      for(count = 0; count < modelCount; count++)
+        {
+          pick += (modelPriority[count] == priority);
+        }
+      TEST_ASSERT_EQUAL(pick, PBUF_countPriority(bf, priority));
+    }
+}
+
+#endif  /* ! PBUF_STAGED */
+
+TEST(pBuf, PBUF_count_should_track_inserts_overwrites_and_retrieves)
+{
+  element_t element;
+  uint16_t count;
+
+  TEST_ASSERT_EQUAL(0, PBUF_count(bf));
+
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, HIGH_PRI);
+  TEST_ASSERT_EQUAL(2, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, LOW_PRI));
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, HIGH_PRI));
+
+  for(count = 2; count < BUFFER_SIZE; count++)
+    {
+      PBUF_insert(bf, 3, LOW_PRI);
+    }
+  TEST_ASSERT_EQUAL(BUFFER_SIZE, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1, PBUF_countPriority(bf, LOW_PRI));
+
+  // overwrite the oldest low priority element
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 4, HIGH_PRI));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 2, PBUF_countPriority(bf, LOW_PRI));
+  TEST_ASSERT_EQUAL(2, PBUF_countPriority(bf, HIGH_PRI));
+
+  PBUF_retrieve(bf, &element);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, HIGH_PRI));
+
+  PBUF_reset(bf);
+  TEST_ASSERT_EQUAL(0, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, LOW_PRI));
+  TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, HIGH_PRI));
+}
+
+TEST(pBuf, PBUF_countPriority_should_return_zero_for_an_invalid_priority)
+{
+  PBUF_insert(bf, 1, LOW_PRI);
+  TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, PRIORITY_SIZE));
+}
+
+#ifndef PBUF_STAGED
+
+TEST(pBuf, removeOldestIndex_should_remove_the_oldest_element_of_any_priority)
+{
+  element_t element;
+  index_t index;
+
+  TEST_ASSERT_EQUAL(INVALID_ELEMENT, removeOldestIndex(bf, &index, LOW_PRI));
+
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, MID_PRI);
+  PBUF_insert(bf, 3, HIGH_PRI);
+  PBUF_insert(bf, 4, MID_PRI);
+
+  TEST_ASSERT_EQUAL(VALID_ELEMENT, removeOldestIndex(bf, &index, MID_PRI));
+  TEST_ASSERT_EQUAL(1, index);
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, MID_PRI));
+  TEST_ASSERT_FALSE(PBUF_full(bf));
+
+  // the removed cell is reused for the next insert
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 5, LOW_PRI));
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(3, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(4, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(5, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+#endif  /* ! PBUF_STAGED */
+
+TEST(pBuf, PBUF_insertBatch_should_insert_the_run_in_priority_order)
+{
+  element_t batch[2] = {20, 21};
+  element_t element;
+  size_t inserted;
+  size_t overwritten;
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 10, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertBatch(bf, batch, 2, HIGH_PRI, &inserted, &overwritten));
+  TEST_ASSERT_EQUAL(2, inserted);
+  TEST_ASSERT_EQUAL(0, overwritten);
+  TEST_ASSERT_EQUAL(3, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(2, PBUF_countPriority(bf, HIGH_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(20, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(21, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(10, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+TEST(pBuf, PBUF_insertBatch_should_overwrite_and_report_when_the_run_does_not_fit)
+{
+  element_t batch[BUFFER_SIZE + 1u];
+  element_t element;
+  size_t inserted;
+  size_t overwritten;
+  uint16_t count;
+
+  for(count = 0; count < BUFFER_SIZE + 1u; count++)
+    {
+      batch[count] = (element_t) (count + 1u);
+    }
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 50, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 40, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertBatch(bf, batch, BUFFER_SIZE - 2u, MID_PRI, &inserted, &overwritten));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 2u, inserted);
+  TEST_ASSERT_EQUAL(0, overwritten);
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+
+  // a full buffer holding nothing lower than the batch rejects it
+  TEST_ASSERT_TRUE(PBUF_insertBatch(bf, batch, 1, LOW_PRI, &inserted, &overwritten));
+  TEST_ASSERT_EQUAL(0, inserted);
+  TEST_ASSERT_EQUAL(0, overwritten);
+
+  // the oldest middle priority elements are overwritten first, including those of the batch
+  TEST_ASSERT_ZERO(PBUF_insertBatch(bf, batch, BUFFER_SIZE + 1u, MID_PRI, &inserted, &overwritten));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE + 1u, inserted);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE + 1u, overwritten);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, PBUF_countPriority(bf, MID_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(50, element);
+  for(count = 3; count < BUFFER_SIZE + 2u; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL(count, element);
+    }
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+#ifndef PBUF_STAGED
+
+TEST(pBuf, PBUF_insertBatch_should_match_single_inserts)
+{
+#ifdef PBUF_RUNTIME_SIZE
+  pbuf_t * other = createBuffer(memory[1]);
+#else
+  pbuf_t otherBuffer;
+  pbuf_t * other = &otherBuffer;
+#endif  /* PBUF_RUNTIME_SIZE */
+  element_t batch[BUFFER_SIZE + 2u];
+  element_t value;
+  element_t otherValue;
+  size_t inserted;
+  size_t length;
+  size_t count;
+  uint16_t step;
+  uint32_t seed = 54321u;
+  priority_t priority;
+
+#ifndef PBUF_RUNTIME_SIZE
+  TEST_ASSERT_ZERO(PBUF_init(other));
+#endif  /* ! PBUF_RUNTIME_SIZE */
+  for(step = 0; step < 2000u; step++)
+    {
+      seed = (seed * 1103515245u) + 12345u;
+      priority = (priority_t) ((seed >> 16) % PRIORITY_SIZE);
+      if((seed >> 8) % 2u)
+        {
+          length = (seed >> 4) % (BUFFER_SIZE + 3u);
+          for(count = 0; count < length; count++)
+            {
+              batch[count] = (element_t) (step + count);
+            }
+
+          PBUF_insertBatch(bf, batch, length, priority, &inserted, NULL);
+          for(count = 0; (count < length) && ! PBUF_insert(other, batch[count], priority); count++)
+            {
+            }
+          TEST_ASSERT_EQUAL(count, inserted);
+        }
+      else
+        {
+          TEST_ASSERT_EQUAL(PBUF_retrieve(other, &otherValue), PBUF_retrieve(bf, &value));
+          if( ! PBUF_empty(other))
+            {
+              TEST_ASSERT_EQUAL(otherValue, value);
+            }
+        }
+
+      TEST_ASSERT_EQUAL(PBUF_count(other), PBUF_count(bf));
+      TEST_ASSERT_EQUAL(PBUF_countPriority(other, priority), PBUF_countPriority(bf, priority));
+    }
+
+  while( ! PBUF_retrieve(other, &otherValue))
+    {
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &value));
+      TEST_ASSERT_EQUAL(otherValue, value);
+    }
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+/**
+   Fill the buffer with elements 1 upwards at the middle priority. */
+
+static void fillMiddle(void)
+{
+  uint32_t count;
+
+  for(count = 1; count <= BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, count, MID_PRI));
+    }
+}
+
+TEST(pBuf, PBUF_setOverflow_should_drop_or_reject_inserts_into_a_full_buffer)
+{
+  element_t batch[2] = {100, 101};
+  element_t element;
+  size_t inserted;
+
+  TEST_ASSERT_TRUE(PBUF_setOverflow(bf, PBUF_EVICT_OLDEST + 1u));
+
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_DROP_INCOMING));
+  fillMiddle();
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 100, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertBatch(bf, batch, 2, HIGH_PRI, &inserted, NULL));
+  TEST_ASSERT_EQUAL(0, inserted);
+  TEST_ASSERT_ZERO(PBUF_insertIndex(bf, HIGH_PRI).status);
+  TEST_ASSERT_EQUAL(-1, PBUF_insertIndex(bf, HIGH_PRI).index);
+  TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, HIGH_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_REJECT_INCOMING));
+  TEST_ASSERT_EQUAL(PBUF_REJECTED, PBUF_insert(bf, 100, HIGH_PRI));
+  TEST_ASSERT_EQUAL(PBUF_REJECTED, PBUF_insertBatch(bf, batch, 2, HIGH_PRI, &inserted, NULL));
+  TEST_ASSERT_EQUAL(PBUF_REJECTED, PBUF_insertIndex(bf, HIGH_PRI).status);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE, PBUF_countPriority(bf, MID_PRI));
+
+  // the policy only applies once the buffer is full
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 100, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(100, element);
+}
+
+TEST(pBuf, PBUF_setOverflow_should_evict_the_oldest_lowest_priority_element_for_any_insert)
+{
+  element_t element;
+  uint32_t count;
+
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_EVICT_OLDEST));
+  fillMiddle();
+
+  // a lower priority than every element held is still stored
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 201, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 200, LOW_PRI));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 2u, PBUF_countPriority(bf, MID_PRI));
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, LOW_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(201, element);
+  for(count = 3; count <= BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL(count, element);
+    }
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(200, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+TEST(pBuf, PBUF_insertIndex_should_report_the_evicted_cell_and_priority)
+{
+  pbuf_insert_t low;
+  pbuf_insert_t middle;
+  pbuf_insert_t result;
+  int index;
+  uint32_t count;
+
+  low = PBUF_insertIndex(bf, LOW_PRI);
+  TEST_ASSERT_ZERO(low.status);
+  TEST_ASSERT_TRUE(low.index >= 0);
+  TEST_ASSERT_EQUAL(-1, low.evictedIndex);
+  TEST_ASSERT_EQUAL(1, low.generation);
+
+  middle = PBUF_insertIndex(bf, MID_PRI);
+  for(count = 2; count < BUFFER_SIZE; count++)
+    {
+      result = PBUF_insertIndex(bf, MID_PRI);
+      TEST_ASSERT_EQUAL(-1, result.evictedIndex);
+      TEST_ASSERT_EQUAL(count + 1u, result.generation);
+    }
+
+  // the full buffer gives up its oldest lowest priority cell, then its oldest middle one
+  result = PBUF_insertIndex(bf, HIGH_PRI);
+  TEST_ASSERT_ZERO(result.status);
+  TEST_ASSERT_EQUAL(low.index, result.index);
+  TEST_ASSERT_EQUAL(low.index, result.evictedIndex);
+  TEST_ASSERT_EQUAL(LOW_PRI, result.evictedPriority);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE + 1u, result.generation);
+
+  result = PBUF_insertIndex(bf, HIGH_PRI);
+  TEST_ASSERT_EQUAL(middle.index, result.evictedIndex);
+  TEST_ASSERT_EQUAL(MID_PRI, result.evictedPriority);
+
+  TEST_ASSERT_ZERO(PBUF_retrieveIndex(bf, &index));
+  TEST_ASSERT_EQUAL(low.index, index);
+
+  // nothing held is as low as the new element, so it is not stored
+  TEST_ASSERT_ZERO(PBUF_insertIndex(bf, HIGH_PRI).status);
+  result = PBUF_insertIndex(bf, LOW_PRI);
+  TEST_ASSERT_TRUE(result.status);
+  TEST_ASSERT_EQUAL(-1, result.index);
+  TEST_ASSERT_EQUAL(-1, result.evictedIndex);
+}
+
+#endif  /* ! PBUF_STAGED */
+
+TEST(pBuf, PBUF_retrieveBatch_should_return_elements_in_priority_order_with_their_priorities)
+{
+  element_t out[BUFFER_SIZE + 1u];
+  priority_t priorities[BUFFER_SIZE + 1u];
+
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, HIGH_PRI);
+  PBUF_insert(bf, 3, MID_PRI);
+  PBUF_insert(bf, 4, HIGH_PRI);
+
+  TEST_ASSERT_EQUAL(4, PBUF_retrieveBatch(bf, out, BUFFER_SIZE + 1u, priorities));
+  TEST_ASSERT_EQUAL(2, out[0]);
+  TEST_ASSERT_EQUAL(HIGH_PRI, priorities[0]);
+  TEST_ASSERT_EQUAL(4, out[1]);
+  TEST_ASSERT_EQUAL(HIGH_PRI, priorities[1]);
+  TEST_ASSERT_EQUAL(3, out[2]);
+  TEST_ASSERT_EQUAL(MID_PRI, priorities[2]);
+  TEST_ASSERT_EQUAL(1, out[3]);
+  TEST_ASSERT_EQUAL(LOW_PRI, priorities[3]);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+  TEST_ASSERT_EQUAL(0, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(0, PBUF_retrieveBatch(bf, out, BUFFER_SIZE, priorities));
+}
+
+TEST(pBuf, PBUF_retrieveBatch_should_stop_at_max_part_way_through_a_run)
+{
+  element_t out[2];
+  element_t element;
+
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, HIGH_PRI);
+  PBUF_insert(bf, 3, HIGH_PRI);
+  PBUF_insert(bf, 4, MID_PRI);
+
+  TEST_ASSERT_EQUAL(1, PBUF_retrieveBatch(bf, out, 1, NULL));
+  TEST_ASSERT_EQUAL(2, out[0]);
+  TEST_ASSERT_EQUAL(ACTIVE, activeStatus(bf, HIGH_PRI));
+
+  TEST_ASSERT_EQUAL(2, PBUF_retrieveBatch(bf, out, 2, NULL));
+  TEST_ASSERT_EQUAL(3, out[0]);
+  TEST_ASSERT_EQUAL(4, out[1]);
+  TEST_ASSERT_EQUAL(INACTIVE, activeStatus(bf, HIGH_PRI));
+  TEST_ASSERT_EQUAL(INACTIVE, activeStatus(bf, MID_PRI));
+  TEST_ASSERT_EQUAL(1, PBUF_count(bf));
+
+  // the buffer carries on as normal from the new tail
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 5, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(5, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+TEST(pBuf, nextLowerPriority_should_find_the_highest_active_priority_below)
+{
+  priority_t priority;
+
+  TEST_ASSERT_EQUAL(INVALID_PRIORITY, nextLowerPriority(bf, &priority, HIGH_PRI));
+  setActive(bf, HIGH_PRI);
+  setActive(bf, LOW_PRI);
+  TEST_ASSERT_EQUAL(VALID_PRIORITY, nextLowerPriority(bf, &priority, HIGH_PRI));
+  TEST_ASSERT_EQUAL(LOW_PRI, priority);
+  TEST_ASSERT_EQUAL(VALID_PRIORITY, nextLowerPriority(bf, &priority, MID_PRI));
+  TEST_ASSERT_EQUAL(LOW_PRI, priority);
+  TEST_ASSERT_EQUAL(INVALID_PRIORITY, nextLowerPriority(bf, &priority, LOW_PRI));
+  setActive(bf, MID_PRI);
+  TEST_ASSERT_EQUAL(VALID_PRIORITY, nextLowerPriority(bf, &priority, HIGH_PRI));
+  TEST_ASSERT_EQUAL(MID_PRI, priority);
+}
+
+TEST(pBuf, PBUF_peek_should_return_the_next_element_and_priority_without_removing_it)
+{
+  element_t element;
+  priority_t priority;
+
+  TEST_ASSERT_TRUE(PBUF_peek(bf, &element, &priority));
+
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, MID_PRI);
+  TEST_ASSERT_ZERO(PBUF_peek(bf, &element, &priority));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_EQUAL(MID_PRI, priority);
+  TEST_ASSERT_ZERO(PBUF_peek(bf, &element, NULL));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_EQUAL(2, PBUF_count(bf));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_ZERO(PBUF_peek(bf, &element, &priority));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_EQUAL(LOW_PRI, priority);
+}
+
+TEST(pBuf, PBUF_peekN_should_return_elements_in_retrieve_order_without_removing_them)
+{
+  element_t out[BUFFER_SIZE + 1u];
+  priority_t priorities[BUFFER_SIZE + 1u];
+  element_t element;
+
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, HIGH_PRI);
+  PBUF_insert(bf, 3, MID_PRI);
+  PBUF_insert(bf, 4, HIGH_PRI);
+
+  TEST_ASSERT_EQUAL(2, PBUF_peekN(bf, out, 2, priorities));
+  TEST_ASSERT_EQUAL(2, out[0]);
+  TEST_ASSERT_EQUAL(4, out[1]);
+
+  TEST_ASSERT_EQUAL(4, PBUF_peekN(bf, out, BUFFER_SIZE + 1u, priorities));
+  TEST_ASSERT_EQUAL(2, out[0]);
+  TEST_ASSERT_EQUAL(HIGH_PRI, priorities[0]);
+  TEST_ASSERT_EQUAL(4, out[1]);
+  TEST_ASSERT_EQUAL(HIGH_PRI, priorities[1]);
+  TEST_ASSERT_EQUAL(3, out[2]);
+  TEST_ASSERT_EQUAL(MID_PRI, priorities[2]);
+  TEST_ASSERT_EQUAL(1, out[3]);
+  TEST_ASSERT_EQUAL(LOW_PRI, priorities[3]);
+
+  // nothing was removed
+  TEST_ASSERT_EQUAL(4, PBUF_count(bf));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(2, element);
+}
+
+TEST(pBuf, PBUF_commit_should_insert_the_reserved_element_in_priority_order)
+{
+  void * low;
+  void * high;
+  element_t element;
+
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, LOW_PRI, &low));
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, HIGH_PRI, &high));
+  PBUF_insert(bf, 1, MID_PRI);
+  *(element_t *) low = 2;
+  *(element_t *) high = 3;
+
+  // reserved cells are not visible until committed
+  TEST_ASSERT_EQUAL(1, PBUF_count(bf));
+  TEST_ASSERT_ZERO(PBUF_commit(bf, low));
+  TEST_ASSERT_ZERO(PBUF_commit(bf, high));
+  TEST_ASSERT_TRUE(PBUF_commit(bf, high));
+  TEST_ASSERT_EQUAL(3, PBUF_count(bf));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(3, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+TEST(pBuf, PBUF_commit_should_reject_a_slot_that_is_not_reserved)
+{
+  void * reserved;
+  void * aborted;
+  const void * acquired;
+  element_t element;
+
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, MID_PRI, &reserved));
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, MID_PRI, &aborted));
+  TEST_ASSERT_ZERO(PBUF_abort(bf, aborted));
+  *(element_t *) reserved = 9;
+  PBUF_insert(bf, 1, HIGH_PRI);
+  PBUF_insert(bf, 2, LOW_PRI);
+  TEST_ASSERT_ZERO(PBUF_acquire(bf, &acquired, NULL));
+  TEST_ASSERT_EQUAL(1, *(const element_t *) acquired);
+
+  // an aborted slot, an acquired slot and a cell still in the buffer were not reserved
+  TEST_ASSERT_TRUE(PBUF_commit(bf, aborted));
+  TEST_ASSERT_TRUE(PBUF_abort(bf, aborted));
+  TEST_ASSERT_TRUE(PBUF_commit(bf, (void *) acquired));
+  TEST_ASSERT_TRUE(PBUF_abort(bf, (void *) acquired));
+  TEST_ASSERT_TRUE(PBUF_commit(bf, slotData(bf, headIndex(bf, LOW_PRI))));
+  TEST_ASSERT_TRUE(PBUF_abort(bf, slotData(bf, headIndex(bf, LOW_PRI))));
+  TEST_ASSERT_EQUAL(1, PBUF_count(bf));
+
+  TEST_ASSERT_ZERO(PBUF_commit(bf, reserved));
+  TEST_ASSERT_TRUE(PBUF_commit(bf, reserved));
+  TEST_ASSERT_TRUE(PBUF_abort(bf, reserved));
+  TEST_ASSERT_ZERO(PBUF_release(bf, acquired));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(9, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+  TEST_ASSERT_EQUAL(0, bf->detached);
+}
+
+#ifndef PBUF_STAGED
+
+TEST(pBuf, PBUF_abort_should_return_the_reserved_cell_to_the_buffer)
+{
+  void * slots[BUFFER_SIZE];
+  element_t element;
+  uint16_t count;
+
+  // one cell always stays in the buffer
+  for(count = 0; count < BUFFER_SIZE - 1u; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_reserve(bf, MID_PRI, &slots[count]));
+    }
+  TEST_ASSERT_TRUE(PBUF_reserve(bf, MID_PRI, &slots[count]));
+  TEST_ASSERT_FALSE(PBUF_full(bf));
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 1, MID_PRI));
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+  TEST_ASSERT_TRUE(PBUF_insert(bf, 2, LOW_PRI));
+
+  for(count = 0; count < BUFFER_SIZE - 1u; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_abort(bf, slots[count]));
+    }
+  TEST_ASSERT_TRUE(PBUF_abort(bf, slots[0]));
+
+  for(count = 2; count <= BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, (element_t) count, MID_PRI));
+    }
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+  for(count = 1; count <= BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL((element_t) count, element);
+    }
+}
+
+#endif  /* ! PBUF_STAGED */
+
+TEST(pBuf, PBUF_reserve_should_overwrite_the_oldest_lowest_priority_element_when_full)
+{
+  void * slot;
+  element_t element;
+  uint16_t count;
+
+  for(count = 1; count <= BUFFER_SIZE; count++)
+    {
+      PBUF_insert(bf, (element_t) count, (count == 1u) ? LOW_PRI : MID_PRI);
+    }
+
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, LOW_PRI, &slot));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, LOW_PRI));
+  TEST_ASSERT_TRUE(PBUF_reserve(bf, LOW_PRI, &slot));
+
+  *(element_t *) slot = 7;
+  TEST_ASSERT_ZERO(PBUF_commit(bf, slot));
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+  for(count = 2; count <= BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL((element_t) count, element);
+    }
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(7, element);
+}
+
+TEST(pBuf, PBUF_acquire_should_remove_the_next_element_without_copying_it)
+{
+  const void * slot;
+  priority_t priority;
+  element_t element;
+
+  TEST_ASSERT_TRUE(PBUF_acquire(bf, &slot, &priority));
+
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, HIGH_PRI);
+  TEST_ASSERT_ZERO(PBUF_acquire(bf, &slot, &priority));
+  TEST_ASSERT_EQUAL(2, *(const element_t *) slot);
+  TEST_ASSERT_EQUAL(HIGH_PRI, priority);
+  TEST_ASSERT_EQUAL(1, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, HIGH_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_release(bf, slot));
+  TEST_ASSERT_TRUE(PBUF_release(bf, slot));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+TEST(pBuf, PBUF_acquire_should_keep_the_borrowed_cell_from_being_overwritten)
+{
+  const void * slot;
+  element_t element;
+  uint16_t count;
+
+  for(count = 1; count <= BUFFER_SIZE; count++)
+    {
+      PBUF_insert(bf, (element_t) count, LOW_PRI);
+    }
+
+  TEST_ASSERT_ZERO(PBUF_acquire(bf, &slot, NULL));
+  TEST_ASSERT_EQUAL(1, *(const element_t *) slot);
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+
+  // every other cell is overwritten, twice over
+  for(count = 0; count < 2u * BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, 0, HIGH_PRI));
+    }
+  TEST_ASSERT_EQUAL(1, *(const element_t *) slot);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, PBUF_countPriority(bf, HIGH_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_release(bf, slot));
+  TEST_ASSERT_FALSE(PBUF_full(bf));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 5, LOW_PRI));
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+  for(count = 1; count < BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL(0, element);
+    }
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(5, element);
+}
+
+TEST(pBuf, PBUF_release_should_reject_a_slot_that_is_not_acquired)
+{
+  void * reserved;
+  const void * acquired;
+  element_t element;
+
+  PBUF_insert(bf, 1, HIGH_PRI);
+  PBUF_insert(bf, 2, LOW_PRI);
+  TEST_ASSERT_ZERO(PBUF_acquire(bf, &acquired, NULL));
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, MID_PRI, &reserved));
+  *(element_t *) reserved = 9;
+
+  // a reserved slot and a cell still in the buffer were not acquired
+  TEST_ASSERT_TRUE(PBUF_release(bf, reserved));
+  TEST_ASSERT_TRUE(PBUF_release(bf, slotData(bf, headIndex(bf, LOW_PRI))));
+  TEST_ASSERT_TRUE(PBUF_release(bf, slotData(bf, tailIndex(bf))));
+  TEST_ASSERT_EQUAL(2, bf->detached);
+
+  TEST_ASSERT_ZERO(PBUF_release(bf, acquired));
+  TEST_ASSERT_TRUE(PBUF_release(bf, acquired));
+  TEST_ASSERT_ZERO(PBUF_commit(bf, reserved));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(9, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+  TEST_ASSERT_EQUAL(0, bf->detached);
+}
+
+TEST(pBuf, PBUF_reserve_should_follow_the_overflow_policy_when_full)
+{
+  void * low;
+  void * middle;
+  element_t element;
+  uint16_t count;
+
+  for(count = 1; count <= BUFFER_SIZE; count++)
+    {
+      PBUF_insert(bf, (element_t) count, (count == 1u) ? LOW_PRI : MID_PRI);
+    }
+
+  // a dropped reserve has no slot, so it fails as well
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_DROP_INCOMING));
+  TEST_ASSERT_EQUAL(1, PBUF_reserve(bf, HIGH_PRI, &low));
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_REJECT_INCOMING));
+  TEST_ASSERT_EQUAL(PBUF_REJECTED, PBUF_reserve(bf, HIGH_PRI, &low));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, LOW_PRI));
+  TEST_ASSERT_EQUAL(0, bf->detached);
+
+  // a lower priority than every element held still reserves
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_EVICT_OLDEST));
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, LOW_PRI, &low));
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, LOW_PRI, &middle));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 2u, PBUF_countPriority(bf, MID_PRI));
+
+  *(element_t *) low = 100;
+  *(element_t *) middle = 101;
+  TEST_ASSERT_ZERO(PBUF_commit(bf, low));
+  TEST_ASSERT_ZERO(PBUF_commit(bf, middle));
+  for(count = 3; count <= BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL((element_t) count, element);
+    }
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(100, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(101, element);
+}
+
+#ifdef PAYLOAD_BUFFER
+
+TEST(pBuf, PBUF_retrievePayload_should_return_the_payload_inserted)
+{
+  uint8_t in[(PAYLOAD_CHUNK_SIZE * 2) + 1];
+  uint8_t out[sizeof(in)];
+  size_t length;
+  uint16_t count;
+
+  for(count = 0; count < sizeof(in); count++)
+    {
+      in[count] = (uint8_t) (count * 7u);
+    }
+
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, 5, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in), HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, NULL, 0, MID_PRI));
+
+  // too small - the payload stays in the buffer
+  TEST_ASSERT_TRUE(PBUF_retrievePayload(bf, out, sizeof(in) - 1u, &length));
+  TEST_ASSERT_EQUAL(sizeof(in), length);
+  TEST_ASSERT_EQUAL(3, PBUF_count(bf));
+
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(sizeof(in), length);
+  TEST_ASSERT_EQUAL_MEMORY(in, out, sizeof(in));
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(0, length);
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(5, length);
+  TEST_ASSERT_EQUAL_MEMORY(in, out, 5);
+  TEST_ASSERT_TRUE(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(PAYLOAD_CHUNKS, bf->freeChunks);
+}
+
+TEST(pBuf, PBUF_insertPayload_should_evict_the_oldest_lowest_priority_payloads_until_it_fits)
+{
+  uint8_t in[PAYLOAD_CHUNKS * PAYLOAD_CHUNK_SIZE];
+  uint8_t out[sizeof(in)];
+  size_t length;
+
+  memset(in, 0x5A, sizeof(in));
+
+  // fill the arena with two payloads
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in) / 2u, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in) / 2u, LOW_PRI));
+  TEST_ASSERT_EQUAL(0, bf->freeChunks);
+
+  // a lower priority payload cannot evict a mid priority one, and nothing is removed
+  TEST_ASSERT_TRUE(PBUF_insertPayload(bf, in, sizeof(in), LOW_PRI));
+  TEST_ASSERT_EQUAL(2, PBUF_count(bf));
+
+  // a single chunk evicts the low priority payload only
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, 1, MID_PRI));
+  TEST_ASSERT_EQUAL(2, PBUF_countPriority(bf, MID_PRI));
+  TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, LOW_PRI));
+
+  // the whole arena evicts everything
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in), HIGH_PRI));
+  TEST_ASSERT_EQUAL(1, PBUF_count(bf));
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(sizeof(in), length);
+  TEST_ASSERT_EQUAL_MEMORY(in, out, sizeof(in));
+}
+
+TEST(pBuf, PBUF_insertPayload_should_follow_the_overflow_policy_when_full)
+{
+  uint8_t in[PAYLOAD_CHUNKS * PAYLOAD_CHUNK_SIZE];
+  uint8_t out[sizeof(in)];
+  size_t length;
+
+  memset(in, 0xA5, sizeof(in));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in) / 2u, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in) / 2u, LOW_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_DROP_INCOMING));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, 1, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_REJECT_INCOMING));
+  TEST_ASSERT_EQUAL(PBUF_REJECTED, PBUF_insertPayload(bf, in, 1, HIGH_PRI));
+  TEST_ASSERT_EQUAL(2, PBUF_count(bf));
+  TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, HIGH_PRI));
+  TEST_ASSERT_EQUAL(0, bf->freeChunks);
+
+  // a lower priority than every payload held still evicts them all
+  TEST_ASSERT_ZERO(PBUF_setOverflow(bf, PBUF_EVICT_OLDEST));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in), LOW_PRI));
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, LOW_PRI));
+  TEST_ASSERT_EQUAL(1, PBUF_count(bf));
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(sizeof(in), length);
+  TEST_ASSERT_EQUAL_MEMORY(in, out, sizeof(in));
+}
+
+TEST(pBuf, PBUF_insertPayload_should_reject_a_payload_larger_than_the_arena)
+{
+  uint8_t in[(PAYLOAD_CHUNKS * PAYLOAD_CHUNK_SIZE) + 1];
+
+  memset(in, 0, sizeof(in));
+  TEST_ASSERT_TRUE(PBUF_insertPayload(bf, in, sizeof(in), HIGH_PRI));
+  TEST_ASSERT_TRUE(PBUF_insertPayload(bf, in, 1, PRIORITY_SIZE));
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+TEST(pBuf, PBUF_peekPayload_should_size_and_copy_the_next_payload_without_removing_it)
+{
+  uint8_t in[PAYLOAD_CHUNK_SIZE + 1];
+  uint8_t out[sizeof(in)];
+  size_t length;
+  priority_t priority;
+  uint16_t count;
+
+  for(count = 0; count < sizeof(in); count++)
+    {
+      in[count] = (uint8_t) (count + 3u);
+    }
+
+  TEST_ASSERT_TRUE(PBUF_peekPayload(bf, out, sizeof(out), &length, &priority));
+
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, 2, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in), MID_PRI));
+
+  // too small - only the length and priority are passed back
+  TEST_ASSERT_TRUE(PBUF_peekPayload(bf, out, sizeof(in) - 1u, &length, &priority));
+  TEST_ASSERT_EQUAL(sizeof(in), length);
+  TEST_ASSERT_EQUAL(MID_PRI, priority);
+
+  TEST_ASSERT_ZERO(PBUF_peekPayload(bf, out, sizeof(out), &length, NULL));
+  TEST_ASSERT_EQUAL_MEMORY(in, out, sizeof(in));
+  TEST_ASSERT_EQUAL(2, PBUF_count(bf));
+
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(sizeof(in), length);
+  TEST_ASSERT_ZERO(PBUF_peekPayload(bf, out, sizeof(out), &length, &priority));
+  TEST_ASSERT_EQUAL(2, length);
+  TEST_ASSERT_EQUAL(LOW_PRI, priority);
+}
+
+TEST(pBuf, PBUF_insertPayload_should_not_count_detached_cells_as_free)
+{
+  void * slot;
+  uint16_t count;
+
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, MID_PRI, &slot));
+  for(count = 1; count < BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, (element_t) count, HIGH_PRI));
+    }
+
+  // the reserved cell is the only one not in use, and it is not free
+  TEST_ASSERT_TRUE(PBUF_insertPayload(bf, NULL, 0, LOW_PRI));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, PBUF_countPriority(bf, HIGH_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_abort(bf, slot));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, NULL, 0, LOW_PRI));
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+}
+
+TEST(pBuf, PBUF_insert_should_release_the_payload_of_an_overwritten_element)
+{
+  uint8_t in[PAYLOAD_CHUNK_SIZE];
+  uint16_t count;
+
+  memset(in, 0, sizeof(in));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, in, sizeof(in), LOW_PRI));
+  for(count = 1; count < BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, (element_t) count, LOW_PRI));
+    }
+  TEST_ASSERT_EQUAL(PAYLOAD_CHUNKS - 1u, bf->freeChunks);
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 9, LOW_PRI));
+  TEST_ASSERT_EQUAL(PAYLOAD_CHUNKS, bf->freeChunks);
+}
+
+#endif  /* PAYLOAD_BUFFER */
+
+#ifdef PBUF_RUNTIME_SIZE
+
+TEST(pBuf, PBUF_create_should_reject_invalid_memory_and_configurations)
+{
+  uint8_t * misaligned = (uint8_t *) memory[1] + 1;
+
+  TEST_ASSERT_NULL(PBUF_create(NULL, sizeof(memory[1]), BUFFER_SIZE, PRIORITY_SIZE, 1));
+  TEST_ASSERT_NULL(PBUF_create(misaligned, sizeof(memory[1]) - 1u, BUFFER_SIZE, PRIORITY_SIZE, 1));
+  TEST_ASSERT_NULL(PBUF_create(memory[1], PBUF_requiredBytes(BUFFER_SIZE, 1) - 1u, BUFFER_SIZE, PRIORITY_SIZE, 1));
+  TEST_ASSERT_NULL(PBUF_create(memory[1], sizeof(memory[1]), 2, PRIORITY_SIZE, 1));
+  TEST_ASSERT_NULL(PBUF_create(memory[1], sizeof(memory[1]), BUFFER_SIZE + 1u, PRIORITY_SIZE, 1));
+  TEST_ASSERT_NULL(PBUF_create(memory[1], sizeof(memory[1]), BUFFER_SIZE, 1, 1));
+  TEST_ASSERT_NULL(PBUF_create(memory[1], sizeof(memory[1]), BUFFER_SIZE, PRIORITY_SIZE + 1u, 1));
+  TEST_ASSERT_NULL(PBUF_create(memory[1], sizeof(memory[1]), BUFFER_SIZE, PRIORITY_SIZE, 3));
+  TEST_ASSERT_NULL(PBUF_create(memory[1], sizeof(memory[1]), BUFFER_SIZE, PRIORITY_SIZE, sizeof(element_t) * 2u));
+  TEST_ASSERT_EQUAL(0, PBUF_requiredBytes(BUFFER_SIZE + 1u, 1));
+  TEST_ASSERT_NOT_NULL(PBUF_create(memory[1], PBUF_requiredBytes(BUFFER_SIZE, 1), BUFFER_SIZE, PRIORITY_SIZE, 1));
+}
+
+TEST(pBuf, PBUF_create_should_size_the_buffer_at_run_time)
+{
+  pbuf_t * small = PBUF_create(memory[1], sizeof(memory[1]), 3, 2, 1);
+  element_t element;
+
+  TEST_ASSERT_NOT_NULL(small);
+  TEST_ASSERT_EQUAL(3, PBUF_bufferSize(small));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE, PBUF_bufferSize(bf));
+  TEST_ASSERT_EQUAL(INVALID_PRIORITY, validatePriority(small, 2));
+  TEST_ASSERT_TRUE(PBUF_insert(small, 1, 2));
+
+  TEST_ASSERT_ZERO(PBUF_insert(small, 1, 0));
+  TEST_ASSERT_ZERO(PBUF_insert(small, 2, 0));
+  TEST_ASSERT_ZERO(PBUF_insert(small, 3, 1));
+  TEST_ASSERT_TRUE(PBUF_full(small));
+
+  // overwrite the oldest low priority element
+  TEST_ASSERT_ZERO(PBUF_insert(small, 4, 1));
+  TEST_ASSERT_ZERO(PBUF_retrieve(small, &element));
+  TEST_ASSERT_EQUAL(3, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(small, &element));
+  TEST_ASSERT_EQUAL(4, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(small, &element));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_TRUE(PBUF_empty(small));
+}
+
+#endif  /* PBUF_RUNTIME_SIZE */
+
+#ifdef PBUF_SOA_LAYOUT
+
+TEST(pBuf, SOA_layout_should_hold_links_and_data_in_separate_arrays)
+{
+  index_t index;
+  index_t count;
+
+  for(count = 0; count < BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_EQUAL((count + 1u) % BUFFER_SIZE, bf->next[count]);
+    }
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 42, 1));
+  TEST_ASSERT_EQUAL(VALID_INDEX, nextTailIndex(bf, &index));
+  TEST_ASSERT_EQUAL(42, bf->data[index]);
+
+  TEST_ASSERT_EQUAL(VALID_INDEX, writeNextIndex(bf, 0, 2));
+  TEST_ASSERT_EQUAL(2, bf->next[0]);
+}
+
+#endif  /* PBUF_SOA_LAYOUT */
+
+#ifdef PBUF_STAGED
+
+#define STRESS_ELEMENTS 100000u
+
+#ifdef PBUF_MPSC
+#  define STRESS_PRODUCERS 4u
+#else
+#  define STRESS_PRODUCERS 1u
+#endif  /* PBUF_MPSC */
+
+static atomic_uint_fast32_t issued;
+static atomic_uint_fast32_t consumed;
+
+/**
+   Producer thread for the stress test. Each element holds its producer in the top two bits and a
+   sequence for its producer and priority below. No more than BUFFER_SIZE elements are allowed in
+   flight, so that none is overwritten. */
+
+static void * stressProducer(void * arg)
+{
+  element_t producer = (element_t) (uintptr_t) arg;
+  element_t sequence[PRIORITY_SIZE] = {0};
+  priority_t priority;
+  uint32_t ticket;
+  uint32_t count;
+
+  for(count = 0; count < (STRESS_ELEMENTS / STRESS_PRODUCERS); count++)
+    {
+      priority = (priority_t) ((count * 7u) % PRIORITY_SIZE);
+      ticket = (uint32_t) atomic_fetch_add(&issued, 1u);
+      // other producers' elements may be consumed first, leaving the ticket behind the count
+      while(((int32_t) (ticket - (uint32_t) atomic_load_explicit(&consumed, memory_order_acquire)) >=
+             (int32_t) BUFFER_SIZE) ||
+            PBUF_insert(bf, (element_t) ((producer << 6) | (sequence[priority] & 63u)), priority))
+        {
+          sched_yield();
+        }
+      sequence[priority]++;
+    }
+
+  return NULL;
+}
+
+TEST(pBuf, PBUF_insert_should_stage_elements_until_the_consumer_moves_them)
+{
+  element_t element;
+  uint16_t count;
+
+  for(count = 0; count < PBUF_STAGE_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, (element_t) count, LOW_PRI));
+    }
+  TEST_ASSERT_TRUE(PBUF_insert(bf, 0, LOW_PRI));
+  TEST_ASSERT_TRUE(PBUF_insert(bf, 0, PRIORITY_SIZE));
+  TEST_ASSERT_EQUAL(0, bf->count);
+
+  // the consumer moves every staged element, overwriting as it goes
+  TEST_ASSERT_EQUAL(BUFFER_SIZE, PBUF_count(bf));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 99, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(99, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL((element_t) (PBUF_STAGE_SIZE - BUFFER_SIZE + 1u), element);
+}
+
+#ifdef PBUF_MPSC
+
+TEST(pBuf, PBUF_insert_should_fill_each_priority_lane_separately)
+{
+  element_t element;
+  uint16_t count;
+
+  for(count = 0; count < PBUF_STAGE_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, (element_t) count, LOW_PRI));
+    }
+  TEST_ASSERT_TRUE(PBUF_insert(bf, 0, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 99, HIGH_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(99, element);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, PBUF_countPriority(bf, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 0, LOW_PRI));
+}
+
+#endif  /* PBUF_MPSC */
+
+TEST(pBuf, PBUF_insert_and_retrieve_should_run_concurrently_without_loss)
+{
+  element_t out[BUFFER_SIZE];
+  priority_t priorities[BUFFER_SIZE];
+  element_t expected[STRESS_PRODUCERS][PRIORITY_SIZE] = {{0}};
+  pthread_t producers[STRESS_PRODUCERS];
+  uint32_t received = 0;
+  size_t length;
+  size_t count;
+  element_t producer;
+
+  atomic_store(&issued, 0u);
+  atomic_store(&consumed, 0u);
+  for(count = 0; count < STRESS_PRODUCERS; count++)
+    {
+      TEST_ASSERT_ZERO(pthread_create(&producers[count], NULL, stressProducer, (void *) (uintptr_t) count));
+    }
+  while(received < STRESS_ELEMENTS)
+    {
+      length = PBUF_retrieveBatch(bf, out, BUFFER_SIZE, priorities);
+      for(count = 0; count < length; count++)
+        {
+          producer = (element_t) (out[count] >> 6);
+          TEST_ASSERT_TRUE(producer < STRESS_PRODUCERS);
+          TEST_ASSERT_EQUAL(expected[producer][priorities[count]] & 63u, out[count] & 63u);
+          expected[producer][priorities[count]]++;
+        }
+      received += (uint32_t) length;
+      atomic_store_explicit(&consumed, received, memory_order_release);
+      if(length == 0u)
+        {
+          sched_yield();
+        }
+    }
+  for(count = 0; count < STRESS_PRODUCERS; count++)
+    {
+      TEST_ASSERT_ZERO(pthread_join(producers[count], NULL));
+    }
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+#endif  /* PBUF_STAGED */
+
+#ifdef PBUF_SHARDS
+
+#define SHARD_THREADS 4u
+#define SHARD_ROUNDS 20000u
+
+static pbuf_sharded_t sharded;
+static atomic_uint_fast64_t shardedSum;
+
+/**
+   Thread for the sharded stress test. Each round inserts an element into the thread's own shard
+   and then retrieves one from any shard, trying again until it gets one. No thread is ever more
+   than one element ahead, so no shard can hold more than SHARD_THREADS elements. */
+
+static void * shardWorker(void * arg)
+{
+  unsigned shard = (unsigned) (uintptr_t) arg;
+  element_t element;
+  uint32_t count;
+
+  for(count = 0; count < SHARD_ROUNDS; count++)
+    {
+      PBUF_shardedInsert(&sharded, shard, (element_t) count, (priority_t) (count % PRIORITY_SIZE));
+      while(PBUF_shardedRetrieve(&sharded, shard, &element, NULL))
+        {
+          sched_yield();
+        }
+      atomic_fetch_add(&shardedSum, element);
+    }
+
+  return NULL;
+}
+
+TEST(pBuf, PBUF_shardedRetrieve_should_take_from_its_own_shard_first)
+{
+  element_t element;
+  priority_t priority;
+
+  TEST_ASSERT_ZERO(PBUF_shardedInit(&sharded));
+  TEST_ASSERT_ZERO(PBUF_shardedInsert(&sharded, 0, 1, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_shardedInsert(&sharded, 1, 2, MID_PRI));
+  TEST_ASSERT_TRUE(PBUF_shardedInsert(&sharded, PBUF_SHARDS, 3, MID_PRI));
+
+  TEST_ASSERT_ZERO(PBUF_shardedRetrieve(&sharded, 1, &element, &priority));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_EQUAL(MID_PRI, priority);
+  TEST_ASSERT_ZERO(PBUF_shardedRetrieve(&sharded, 0, &element, NULL));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_TRUE(PBUF_shardedRetrieve(&sharded, 0, &element, NULL));
+  TEST_ASSERT_EQUAL(0, atomic_load(&sharded.summary));
+}
+
+TEST(pBuf, PBUF_shardedRetrieve_should_steal_the_highest_priority_from_other_shards)
+{
+  element_t element;
+  priority_t priority;
+
+  TEST_ASSERT_ZERO(PBUF_shardedInit(&sharded));
+  TEST_ASSERT_ZERO(PBUF_shardedInsert(&sharded, 0, 1, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_shardedInsert(&sharded, 1, 2, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_shardedInsert(&sharded, PBUF_SHARDS - 1u, 3, MID_PRI));
+
+  // a higher priority elsewhere is taken before the thread's own work
+  TEST_ASSERT_ZERO(PBUF_shardedRetrieve(&sharded, 0, &element, &priority));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_EQUAL(HIGH_PRI, priority);
+  TEST_ASSERT_ZERO(PBUF_shardedRetrieve(&sharded, 0, &element, &priority));
+  TEST_ASSERT_EQUAL(3, element);
+  TEST_ASSERT_ZERO(PBUF_shardedRetrieve(&sharded, 1, &element, NULL));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_TRUE(PBUF_shardedRetrieve(&sharded, 1, &element, NULL));
+}
+
+TEST(pBuf, PBUF_sharded_should_run_concurrently_without_loss)
+{
+  pthread_t threads[SHARD_THREADS];
+  uint64_t expected = 0;
+  uint32_t count;
+
+  for(count = 0; count < SHARD_ROUNDS; count++)
+    {
+      expected += (uint64_t) SHARD_THREADS * (element_t) count;
+    }
+  TEST_ASSERT_ZERO(PBUF_shardedInit(&sharded));
+  atomic_store(&shardedSum, 0u);
+  for(count = 0; count < SHARD_THREADS; count++)
+    {
+      TEST_ASSERT_ZERO(pthread_create(&threads[count], NULL, shardWorker, (void *) (uintptr_t) (count % PBUF_SHARDS)));
+    }
+  for(count = 0; count < SHARD_THREADS; count++)
+    {
+      TEST_ASSERT_ZERO(pthread_join(threads[count], NULL));
+    }
+  TEST_ASSERT_EQUAL_UINT64(expected, atomic_load(&shardedSum));
+  TEST_ASSERT_EQUAL(0, atomic_load(&sharded.summary));
+}
+
+#endif  /* PBUF_SHARDS */
+
+#ifdef PBUF_CRITICAL_SPINLOCK
+
+#define CRITICAL_THREADS 4u
+#define CRITICAL_ROUNDS 20000u
+
+static atomic_uint_fast64_t criticalSum;
+
+/**
+   Thread for the critical section stress test. Each round inserts an element and then retrieves
+   one, trying again until it gets one, so no more than CRITICAL_THREADS elements are ever held
+   and none is overwritten. */
+
+static void * criticalWorker(void * arg)
+{
+  element_t element;
+  uint32_t count;
+
+  (void) arg;
+  for(count = 0; count < CRITICAL_ROUNDS; count++)
+    {
+      PBUF_insert(bf, (element_t) count, (priority_t) (count % PRIORITY_SIZE));
+      while(PBUF_retrieve(bf, &element))
+        {
+          sched_yield();
+        }
+      atomic_fetch_add(&criticalSum, element);
+    }
+
+  return NULL;
+}
+
+TEST(pBuf, PBUF_critical_sections_should_be_left_unlocked_after_every_call)
+{
+  element_t elements[2] = {1, 2};
+  element_t element;
+  void * slot;
+  const void * readSlot;
+  int index;
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 1, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertBatch(bf, elements, 2, HIGH_PRI, NULL, NULL));
+  TEST_ASSERT_ZERO(PBUF_full(bf));
+  TEST_ASSERT_ZERO(PBUF_peek(bf, &element, NULL));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(2u, PBUF_retrieveBatch(bf, elements, 2, NULL));
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, MID_PRI, &slot));
+  TEST_ASSERT_ZERO(PBUF_commit(bf, slot));
+  TEST_ASSERT_ZERO(PBUF_reserve(bf, MID_PRI, &slot));
+  TEST_ASSERT_ZERO(PBUF_abort(bf, slot));
+  TEST_ASSERT_ZERO(PBUF_acquire(bf, &readSlot, NULL));
+  TEST_ASSERT_ZERO(PBUF_release(bf, readSlot));
+  TEST_ASSERT_ZERO(PBUF_insertIndex(bf, LOW_PRI).status);
+  TEST_ASSERT_ZERO(PBUF_retrieveIndex(bf, &index));
+  TEST_ASSERT_ZERO(PBUF_reset(bf));
+
+  TEST_ASSERT_FALSE(atomic_flag_test_and_set(&bf->critical));
+  atomic_flag_clear(&bf->critical);
+}
+
+TEST(pBuf, PBUF_insert_and_retrieve_should_be_thread_safe_with_the_spinlock_hooks)
+{
+  pthread_t threads[CRITICAL_THREADS];
+  uint64_t expected = 0;
+  uint32_t count;
+
+  for(count = 0; count < CRITICAL_ROUNDS; count++)
+    {
+      expected += (uint64_t) CRITICAL_THREADS * (element_t) count;
+    }
+
+  atomic_store(&criticalSum, 0u);
+  for(count = 0; count < CRITICAL_THREADS; count++)
+    {
+      TEST_ASSERT_ZERO(pthread_create(&threads[count], NULL, criticalWorker, NULL));
+    }
+  for(count = 0; count < CRITICAL_THREADS; count++)
+    {
+      TEST_ASSERT_ZERO(pthread_join(threads[count], NULL));
+    }
+  TEST_ASSERT_EQUAL_UINT64(expected, atomic_load(&criticalSum));
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+#endif  /* PBUF_CRITICAL_SPINLOCK */
+
+#ifdef PBUF_WAIT
+
+#define WAIT_MS 1000000u
+
+/**
+   Thread for the blocking retrieve tests. It sleeps for 20ms, so that the test thread is
+   blocked by then, and inserts a low priority element and then a high priority one. */
+
+static void * delayedInserter(void * arg)
+{
+  struct timespec delay = {0, 20 * (long) WAIT_MS};
+
+  (void) arg;
+  nanosleep(&delay, NULL);
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, HIGH_PRI);
+
+  return NULL;
+}
+
+TEST(pBuf, PBUF_retrieveWait_should_return_at_once_or_time_out)
+{
+  element_t element;
+
+  TEST_ASSERT_TRUE(PBUF_retrieveWait(bf, &element, LOW_PRI, 0u));
+  TEST_ASSERT_TRUE(PBUF_retrieveWait(bf, &element, LOW_PRI, 5u * WAIT_MS));
+  TEST_ASSERT_TRUE(PBUF_retrieveWait(bf, &element, PRIORITY_SIZE, 0u));
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 7, LOW_PRI));
+  TEST_ASSERT_TRUE(PBUF_retrieveWait(bf, &element, MID_PRI, 5u * WAIT_MS));
+  TEST_ASSERT_ZERO(PBUF_retrieveWait(bf, &element, LOW_PRI, 0u));
+  TEST_ASSERT_EQUAL(7, element);
+  TEST_ASSERT_EQUAL(0, bf->wait.waiters);
+}
+
+TEST(pBuf, PBUF_retrieveWait_should_wake_when_an_element_is_inserted)
+{
+  pthread_t thread;
+  element_t element;
+
+  TEST_ASSERT_ZERO(pthread_create(&thread, NULL, delayedInserter, NULL));
+  TEST_ASSERT_ZERO(PBUF_retrieveWait(bf, &element, LOW_PRI, PBUF_WAIT_FOREVER));
+  TEST_ASSERT_ZERO(pthread_join(thread, NULL));
+  TEST_ASSERT_TRUE((element == 1) || (element == 2));
+}
+
+TEST(pBuf, PBUF_retrieveWait_should_sleep_through_inserts_below_its_minimum_priority)
+{
+  pthread_t thread;
+  element_t element;
+
+  TEST_ASSERT_ZERO(pthread_create(&thread, NULL, delayedInserter, NULL));
+  TEST_ASSERT_ZERO(PBUF_retrieveWait(bf, &element, HIGH_PRI, 5000u * WAIT_MS));
+  TEST_ASSERT_ZERO(pthread_join(thread, NULL));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, LOW_PRI));
+}
+
+#endif  /* PBUF_WAIT */
+
+#ifdef PBUF_EVENTFD
+
+/**
+   Read the eventfd passed in without blocking.
+   \return the count it held, or zero if it was not readable */
+
+static uint64_t readEvents(int fd)
+{
+  uint64_t events = 0u;
+
+  if(read(fd, &events, sizeof(events)) != (ssize_t) sizeof(events))
+    {
+      events = 0u;
+    }
+
+  return events;
+}
+
+TEST(pBuf, PBUF_readableFd_should_signal_once_per_empty_to_non_empty_transition)
+{
+  struct epoll_event event = {EPOLLIN | EPOLLET, {0}};
+  int epfd = epoll_create1(0);
+  element_t element;
+
+  TEST_ASSERT_TRUE(epfd >= 0);
+  TEST_ASSERT_ZERO(epoll_ctl(epfd, EPOLL_CTL_ADD, PBUF_readableFd(bf), &event));
+  TEST_ASSERT_EQUAL(0, epoll_wait(epfd, &event, 1, 0));
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 1, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 2, HIGH_PRI));
+  TEST_ASSERT_EQUAL(1, epoll_wait(epfd, &event, 1, 0));
+  TEST_ASSERT_EQUAL(1, readEvents(PBUF_readableFd(bf)));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 3, LOW_PRI));
+  TEST_ASSERT_EQUAL(0, epoll_wait(epfd, &event, 1, 0));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 4, LOW_PRI));
+  TEST_ASSERT_EQUAL(1, epoll_wait(epfd, &event, 1, 0));
+  TEST_ASSERT_EQUAL(1, readEvents(PBUF_readableFd(bf)));
+
+  TEST_ASSERT_ZERO(close(epfd));
+}
+
+TEST(pBuf, PBUF_writableFd_should_signal_full_to_not_full_transitions_only)
+{
+  int fd = PBUF_writableFd(bf);
+  element_t element;
+  uint32_t count;
+
+  TEST_ASSERT_TRUE(fd >= 0);
+  TEST_ASSERT_EQUAL(fd, PBUF_writableFd(bf));
+
+  for(count = 0; count < BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, count, LOW_PRI));
+    }
+  TEST_ASSERT_ZERO(PBUF_insert(bf, count, HIGH_PRI));
+  TEST_ASSERT_EQUAL(0, readEvents(fd));
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(1, readEvents(fd));
+  TEST_ASSERT_EQUAL(1, readEvents(PBUF_readableFd(bf)));
+
+  TEST_ASSERT_ZERO(PBUF_closeFds(bf));
+  TEST_ASSERT_EQUAL(-1, PBUF_readableFd(bf));
+}
+
+#endif  /* PBUF_EVENTFD */
+
+#ifdef PBUF_STATISTICS
+
+TEST(pBuf, PBUF_statistics_should_count_each_event_by_priority)
+{
+  pbuf_stats_t stats;
+  element_t out[BUFFER_SIZE];
+  uint32_t count;
+
+  for(count = 0; count < BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, count, (count == 0u) ? LOW_PRI : MID_PRI));
+    }
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 100, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 101, HIGH_PRI));
+  TEST_ASSERT_TRUE(PBUF_insert(bf, 102, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &out[0]));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, PBUF_retrieveBatch(bf, out, BUFFER_SIZE, NULL));
+
+  TEST_ASSERT_TRUE(PBUF_statistics(bf, NULL));
+  TEST_ASSERT_ZERO(PBUF_statistics(bf, &stats));
+  TEST_ASSERT_EQUAL(1, stats.inserts[LOW_PRI]);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, stats.inserts[MID_PRI]);
+  TEST_ASSERT_EQUAL(2, stats.inserts[HIGH_PRI]);
+  TEST_ASSERT_EQUAL(1, stats.overwrites[LOW_PRI]);
+  TEST_ASSERT_EQUAL(1, stats.overwrites[MID_PRI]);
+  TEST_ASSERT_EQUAL(1, stats.rejections[LOW_PRI]);
+  TEST_ASSERT_EQUAL(2, stats.retrieves[HIGH_PRI]);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 2u, stats.retrieves[MID_PRI]);
+  TEST_ASSERT_EQUAL(0, stats.retrieves[LOW_PRI]);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE, stats.highWater);
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, stats.priorityHighWater[MID_PRI]);
+  TEST_ASSERT_EQUAL(2, stats.priorityHighWater[HIGH_PRI]);
+}
+
+TEST(pBuf, PBUF_resetStatistics_should_restart_from_the_elements_held)
+{
+  pbuf_stats_t stats;
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 1, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 2, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 3, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_resetStatistics(bf));
+
+  TEST_ASSERT_ZERO(PBUF_statistics(bf, &stats));
+  TEST_ASSERT_EQUAL(0, stats.inserts[MID_PRI]);
+  TEST_ASSERT_EQUAL(0, stats.inserts[HIGH_PRI]);
+  TEST_ASSERT_EQUAL(3, stats.highWater);
+  TEST_ASSERT_EQUAL(2, stats.priorityHighWater[MID_PRI]);
+  TEST_ASSERT_EQUAL(1, stats.priorityHighWater[HIGH_PRI]);
+  TEST_ASSERT_EQUAL(0, stats.priorityHighWater[LOW_PRI]);
+}
+
+#endif  /* PBUF_STATISTICS */
+
+#ifdef PBUF_AGING
+
+TEST(pBuf, PBUF_setAging_should_promote_a_starved_run_until_it_is_served)
+{
+  element_t element;
+  uint32_t count;
+
+  TEST_ASSERT_ZERO(PBUF_setAging(bf, 2u));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 100, LOW_PRI));
+
+  // each retrieve takes a fresh high priority element until the low run has climbed to the top
+  for(count = 1; count <= 5u; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, count, HIGH_PRI));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL(count, element);
+      if(count == 3u)
+        {
+          TEST_ASSERT_EQUAL(0, PBUF_countPriority(bf, LOW_PRI));
+          TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, MID_PRI));
+        }
+    }
+
+  // now ahead of new high priority elements
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 6, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(100, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(6, element);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+}
+
+TEST(pBuf, PBUF_setAging_should_leave_runs_in_place_when_off)
+{
+  element_t element;
+  uint32_t count;
+
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 100, LOW_PRI));
+  for(count = 1; count <= 20u; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, count, HIGH_PRI));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL(count, element);
+    }
+  TEST_ASSERT_EQUAL(1, PBUF_countPriority(bf, LOW_PRI));
+}
+
+#ifdef PBUF_STATISTICS
+
+TEST(pBuf, PBUF_setAging_should_raise_the_high_water_mark_of_the_run_promoted_into)
+{
+  pbuf_stats_t stats;
+  element_t element;
+  uint32_t count;
+
+  TEST_ASSERT_ZERO(PBUF_setAging(bf, 2u));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 100, LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 1, HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+
+  // the middle run is younger, so the low run joins it rather than following it up
+  TEST_ASSERT_ZERO(PBUF_insert(bf, 101, MID_PRI));
+  for(count = 2; PBUF_countPriority(bf, LOW_PRI) > 0; count++)
+    {
+      TEST_ASSERT_TRUE(count <= 5u);
+      TEST_ASSERT_ZERO(PBUF_insert(bf, count, HIGH_PRI));
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+    }
+  TEST_ASSERT_EQUAL(2, PBUF_countPriority(bf, MID_PRI));
+  TEST_ASSERT_ZERO(PBUF_statistics(bf, &stats));
+  TEST_ASSERT_EQUAL(2, stats.priorityHighWater[MID_PRI]);
+}
+
+#endif  /* PBUF_STATISTICS */
+
+#endif  /* PBUF_AGING */
+
+#ifdef PBUF_SCHEDULER
+
+/**
+   Set the weight of every priority to one, and of the low and high priorities to those passed in. */
+
+static void setWeights(uint32_t * weights, uint32_t low, uint32_t high)
+{
+  uint32_t priority;
+
+  for(priority = 0; priority < PRIORITY_SIZE; priority++)
+    {
+      weights[priority] = 1u;
+    }
+  weights[LOW_PRI] = low;
+  weights[HIGH_PRI] = high;
+}
+
+TEST(pBuf, PBUF_setScheduler_should_share_retrievals_by_weight)
+{
+  static const priority_t order[] = {HIGH_PRI, HIGH_PRI, HIGH_PRI, LOW_PRI, LOW_PRI,
+                                     HIGH_PRI, HIGH_PRI, HIGH_PRI, LOW_PRI, LOW_PRI};
+  uint32_t weights[PRIORITY_SIZE];
+  element_t next[PRIORITY_SIZE] = {0};
+  element_t element;
+  priority_t priority;
+  uint32_t count;
+
+  setWeights(weights, 2u, 3u);
+  TEST_ASSERT_ZERO(PBUF_setScheduler(bf, PBUF_WEIGHTED_ROUND_ROBIN, weights));
+
+  // keep the buffer full, replacing each element retrieved with another of its priority
+  PBUF_insert(bf, next[HIGH_PRI]++, HIGH_PRI);
+  PBUF_insert(bf, next[LOW_PRI]++, LOW_PRI);
+  PBUF_insert(bf, next[HIGH_PRI]++, HIGH_PRI);
+  PBUF_insert(bf, next[LOW_PRI]++, LOW_PRI);
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+
+  for(count = 0; count < (sizeof(order) / sizeof(order[0])); count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_peek(bf, &element, &priority));
+      TEST_ASSERT_EQUAL(order[count], priority);
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL(next[priority] - PBUF_countPriority(bf, priority) - 1u, element);
+      TEST_ASSERT_ZERO(PBUF_insert(bf, next[priority]++, priority));
+    }
+
+  // the ring is still whole
+  TEST_ASSERT_EQUAL(BUFFER_SIZE, PBUF_retrieveBatch(bf, &element, 1u, NULL) + PBUF_count(bf));
+  TEST_ASSERT_EQUAL(BUFFER_SIZE - 1u, PBUF_count(bf));
+}
+
+TEST(pBuf, PBUF_setScheduler_should_serve_acquire_and_batch_retrieve_in_turn)
+{
+  uint32_t weights[PRIORITY_SIZE];
+  element_t out[BUFFER_SIZE];
+  priority_t priorities[BUFFER_SIZE];
+  const void * slot;
+  element_t element;
+  priority_t priority;
+  uint32_t count;
+
+  setWeights(weights, 1u, 1u);
+  TEST_ASSERT_ZERO(PBUF_setScheduler(bf, PBUF_WEIGHTED_ROUND_ROBIN, weights));
+  PBUF_insert(bf, 1, HIGH_PRI);
+  PBUF_insert(bf, 2, HIGH_PRI);
+  PBUF_insert(bf, 3, LOW_PRI);
+  PBUF_insert(bf, 4, LOW_PRI);
+
+  // the oldest high priority element, then the oldest low priority one from behind it
+  TEST_ASSERT_ZERO(PBUF_acquire(bf, &slot, &priority));
+  TEST_ASSERT_EQUAL(1, *(const element_t *) slot);
+  TEST_ASSERT_EQUAL(HIGH_PRI, priority);
+  TEST_ASSERT_ZERO(PBUF_release(bf, slot));
+  TEST_ASSERT_ZERO(PBUF_peek(bf, &element, &priority));
+  TEST_ASSERT_EQUAL(3, element);
+  TEST_ASSERT_EQUAL(LOW_PRI, priority);
+  TEST_ASSERT_ZERO(PBUF_acquire(bf, &slot, &priority));
+  TEST_ASSERT_EQUAL(3, *(const element_t *) slot);
+  TEST_ASSERT_EQUAL(LOW_PRI, priority);
+  TEST_ASSERT_ZERO(PBUF_release(bf, slot));
+
+  TEST_ASSERT_EQUAL(1, PBUF_peekN(bf, out, BUFFER_SIZE, NULL));
+  TEST_ASSERT_EQUAL(2, PBUF_retrieveBatch(bf, out, BUFFER_SIZE, priorities));
+  TEST_ASSERT_EQUAL(2, out[0]);
+  TEST_ASSERT_EQUAL(HIGH_PRI, priorities[0]);
+  TEST_ASSERT_EQUAL(4, out[1]);
+  TEST_ASSERT_EQUAL(LOW_PRI, priorities[1]);
+  TEST_ASSERT_TRUE(PBUF_empty(bf));
+
+  // every cell is back in the ring
+  for(count = 1; count <= BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_insert(bf, (element_t) count, LOW_PRI));
+    }
+  TEST_ASSERT_TRUE(PBUF_full(bf));
+  for(count = 1; count <= BUFFER_SIZE; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+      TEST_ASSERT_EQUAL(count, element);
+    }
+}
+
+TEST(pBuf, PBUF_setScheduler_should_reject_invalid_policies_and_weights)
+{
+  uint32_t weights[PRIORITY_SIZE];
+  element_t element;
+
+  setWeights(weights, 1u, 0u);
+  TEST_ASSERT_TRUE(PBUF_setScheduler(bf, PBUF_DEFICIT_ROUND_ROBIN + 1u, NULL));
+  TEST_ASSERT_TRUE(PBUF_setScheduler(bf, PBUF_WEIGHTED_ROUND_ROBIN, NULL));
+  TEST_ASSERT_TRUE(PBUF_setScheduler(bf, PBUF_WEIGHTED_ROUND_ROBIN, weights));
+  TEST_ASSERT_ZERO(PBUF_setScheduler(bf, PBUF_STRICT_PRIORITY, NULL));
+
+  // strict priority order is kept
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, HIGH_PRI);
+  PBUF_insert(bf, 3, HIGH_PRI);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(2, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(3, element);
+}
+
+TEST(pBuf, PBUF_setScheduler_should_pay_off_deep_debts_without_passing_the_turn_round)
+{
+  uint32_t weights[PRIORITY_SIZE];
+  element_t element;
+
+  setWeights(weights, 1u, 1u);
+  TEST_ASSERT_ZERO(PBUF_setScheduler(bf, PBUF_DEFICIT_ROUND_ROBIN, weights));
+  PBUF_insert(bf, 1, LOW_PRI);
+  PBUF_insert(bf, 2, MID_PRI);
+  PBUF_insert(bf, 3, HIGH_PRI);
+
+  // the debts of payloads far larger than their weights, which take billions of rounds to pay
+  bf->schedule.credit[LOW_PRI] = INT32_MIN;
+  bf->schedule.credit[MID_PRI] = -INT32_MAX;
+
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(3, element);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(2, element);
+  // the low priority sat out one round fewer than the middle one
+  TEST_ASSERT_EQUAL(-1, bf->schedule.credit[LOW_PRI]);
+  TEST_ASSERT_ZERO(PBUF_retrieve(bf, &element));
+  TEST_ASSERT_EQUAL(1, element);
+  TEST_ASSERT_EQUAL(0, bf->schedule.credit[LOW_PRI]);
+}
+
+#ifdef PAYLOAD_BUFFER
+
+TEST(pBuf, PBUF_setScheduler_should_charge_payload_bytes_under_deficit_round_robin)
+{
+  uint8_t large[PAYLOAD_CHUNK_SIZE] = {1};
+  uint8_t small[2] = {2};
+  uint8_t out[PAYLOAD_CHUNK_SIZE];
+  uint32_t weights[PRIORITY_SIZE];
+  size_t length;
+
+  setWeights(weights, PAYLOAD_CHUNK_SIZE, PAYLOAD_CHUNK_SIZE);
+  TEST_ASSERT_ZERO(PBUF_setScheduler(bf, PBUF_DEFICIT_ROUND_ROBIN, weights));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, large, sizeof(large), HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, small, sizeof(small), LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, small, sizeof(small), LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, large, sizeof(large), HIGH_PRI));
+
+  // one large payload spends the high priority's turn, two small ones fit in the low priority's
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(sizeof(large), length);
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(sizeof(small), length);
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(sizeof(small), length);
+  TEST_ASSERT_EQUAL_MEMORY(small, out, sizeof(small));
+  TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+  TEST_ASSERT_EQUAL(sizeof(large), length);
+  TEST_ASSERT_EQUAL_MEMORY(large, out, sizeof(large));
+  TEST_ASSERT_EQUAL(PAYLOAD_CHUNKS, bf->freeChunks);
+}
+
+TEST(pBuf, PBUF_setScheduler_should_share_bytes_by_weight_when_payloads_exceed_the_weights)
+{
+  uint8_t large[2u * PAYLOAD_CHUNK_SIZE] = {1};
+  uint8_t small[PAYLOAD_CHUNK_SIZE] = {2};
+  uint8_t out[sizeof(large)];
+  uint32_t weights[PRIORITY_SIZE];
+  uint32_t bytes[PRIORITY_SIZE] = {0};
+  size_t length;
+  uint32_t count;
+
+  // the low priority is owed twice the bytes of the high one, in payloads four times its weight
+  setWeights(weights, 4, 2);
+  TEST_ASSERT_ZERO(PBUF_setScheduler(bf, PBUF_DEFICIT_ROUND_ROBIN, weights));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, large, sizeof(large), HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, small, sizeof(small), LOW_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, large, sizeof(large), HIGH_PRI));
+  TEST_ASSERT_ZERO(PBUF_insertPayload(bf, small, sizeof(small), LOW_PRI));
+
+  // keep both priorities waiting, putting back each payload retrieved
+  for(count = 0; count < 120u; count++)
+    {
+      TEST_ASSERT_ZERO(PBUF_retrievePayload(bf, out, sizeof(out), &length));
+      if(length == sizeof(large))
+        {
+          bytes[HIGH_PRI] += (uint32_t) length;
+          TEST_ASSERT_ZERO(PBUF_insertPayload(bf, large, sizeof(large), HIGH_PRI));
+        }
+      else
+        {
+          bytes[LOW_PRI] += (uint32_t) length;
+          TEST_ASSERT_ZERO(PBUF_insertPayload(bf, small, sizeof(small), LOW_PRI));
+        }
+    }
+
+  // the shares are out by no more than a payload and a weight each
+  TEST_ASSERT_UINT32_WITHIN(2u * (sizeof(large) + 4u), 2u * bytes[HIGH_PRI], bytes[LOW_PRI]);
+}
+
+#endif  /* PAYLOAD_BUFFER */
+
+#endif  /* PBUF_SCHEDULER */
@@ -87,4 +87,102 @@ TEST_GROUP_RUNNER(pBuf)
   RUN_TEST_CASE(pBuf, pH_pH_pM_pL_pM_pM_pH_pH_pM_pL_should_resequence_correctly);
   RUN_TEST_CASE(pBuf, pH_pH_pH_pM_pM_pM_should_resequence_correctly);
   RUN_TEST_CASE(pBuf, insertIndex_pL_should_return_VALID_INSERT);
+  RUN_TEST_CASE(pBuf, separate_instances_should_not_share_state);
+  RUN_TEST_CASE(pBuf, lowestBit_and_highestBit_should_find_the_extreme_set_bits);
+  RUN_TEST_CASE(pBuf, bitCount_should_count_the_set_bits);
+  RUN_TEST_CASE(pBuf, lowest_highest_and_nextHighest_priority_should_track_activity);
+  RUN_TEST_CASE(pBuf, insertPointNotFull_should_follow_the_newest_element_of_the_same_priority);
+#if ! defined(PBUF_SPSC) && ! defined(PBUF_MPSC)
+  RUN_TEST_CASE(pBuf, random_sequence_should_match_reference_model);
+#endif  /* ! PBUF_SPSC && ! PBUF_MPSC */
+  RUN_TEST_CASE(pBuf, PBUF_count_should_track_inserts_overwrites_and_retrieves);
+  RUN_TEST_CASE(pBuf, PBUF_countPriority_should_return_zero_for_an_invalid_priority);
+#if ! defined(PBUF_SPSC) && ! defined(PBUF_MPSC)
+  RUN_TEST_CASE(pBuf, removeOldestIndex_should_remove_the_oldest_element_of_any_priority);
+#endif  /* ! PBUF_SPSC && ! PBUF_MPSC */
+  RUN_TEST_CASE(pBuf, PBUF_insertBatch_should_insert_the_run_in_priority_order);
+  RUN_TEST_CASE(pBuf, PBUF_insertBatch_should_overwrite_and_report_when_the_run_does_not_fit);
+#if ! defined(PBUF_SPSC) && ! defined(PBUF_MPSC)
+  RUN_TEST_CASE(pBuf, PBUF_insertBatch_should_match_single_inserts);
+  RUN_TEST_CASE(pBuf, PBUF_setOverflow_should_drop_or_reject_inserts_into_a_full_buffer);
+  RUN_TEST_CASE(pBuf, PBUF_setOverflow_should_evict_the_oldest_lowest_priority_element_for_any_insert);
+  RUN_TEST_CASE(pBuf, PBUF_insertIndex_should_report_the_evicted_cell_and_priority);
+#endif  /* ! PBUF_SPSC && ! PBUF_MPSC */
+  RUN_TEST_CASE(pBuf, PBUF_retrieveBatch_should_return_elements_in_priority_order_with_their_priorities);
+  RUN_TEST_CASE(pBuf, PBUF_retrieveBatch_should_stop_at_max_part_way_through_a_run);
+  RUN_TEST_CASE(pBuf, nextLowerPriority_should_find_the_highest_active_priority_below);
+  RUN_TEST_CASE(pBuf, PBUF_peek_should_return_the_next_element_and_priority_without_removing_it);
+  RUN_TEST_CASE(pBuf, PBUF_peekN_should_return_elements_in_retrieve_order_without_removing_them);
+  RUN_TEST_CASE(pBuf, PBUF_commit_should_insert_the_reserved_element_in_priority_order);
+  RUN_TEST_CASE(pBuf, PBUF_commit_should_reject_a_slot_that_is_not_reserved);
+#if ! defined(PBUF_SPSC) && ! defined(PBUF_MPSC)
+  RUN_TEST_CASE(pBuf, PBUF_abort_should_return_the_reserved_cell_to_the_buffer);
+#endif  /* ! PBUF_SPSC && ! PBUF_MPSC */
+  RUN_TEST_CASE(pBuf, PBUF_reserve_should_overwrite_the_oldest_lowest_priority_element_when_full);
+  RUN_TEST_CASE(pBuf, PBUF_reserve_should_follow_the_overflow_policy_when_full);
+  RUN_TEST_CASE(pBuf, PBUF_acquire_should_remove_the_next_element_without_copying_it);
+  RUN_TEST_CASE(pBuf, PBUF_acquire_should_keep_the_borrowed_cell_from_being_overwritten);
+  RUN_TEST_CASE(pBuf, PBUF_release_should_reject_a_slot_that_is_not_acquired);
+#ifdef PAYLOAD_BUFFER
+  RUN_TEST_CASE(pBuf, PBUF_retrievePayload_should_return_the_payload_inserted);
+  RUN_TEST_CASE(pBuf, PBUF_insertPayload_should_evict_the_oldest_lowest_priority_payloads_until_it_fits);
+  RUN_TEST_CASE(pBuf, PBUF_insertPayload_should_follow_the_overflow_policy_when_full);
+  RUN_TEST_CASE(pBuf, PBUF_insertPayload_should_reject_a_payload_larger_than_the_arena);
+  RUN_TEST_CASE(pBuf, PBUF_peekPayload_should_size_and_copy_the_next_payload_without_removing_it);
+  RUN_TEST_CASE(pBuf, PBUF_insertPayload_should_not_count_detached_cells_as_free);
+  RUN_TEST_CASE(pBuf, PBUF_insert_should_release_the_payload_of_an_overwritten_element);
+#endif  /* PAYLOAD_BUFFER */
+#ifdef PBUF_RUNTIME_SIZE
+  RUN_TEST_CASE(pBuf, PBUF_create_should_reject_invalid_memory_and_configurations);
+  RUN_TEST_CASE(pBuf, PBUF_create_should_size_the_buffer_at_run_time);
+#endif  /* PBUF_RUNTIME_SIZE */
+#ifdef PBUF_SOA_LAYOUT
+  RUN_TEST_CASE(pBuf, SOA_layout_should_hold_links_and_data_in_separate_arrays);
+#endif  /* PBUF_SOA_LAYOUT */
+#if defined(PBUF_SPSC) || defined(PBUF_MPSC)
+  RUN_TEST_CASE(pBuf, PBUF_insert_should_stage_elements_until_the_consumer_moves_them);
+#ifdef PBUF_MPSC
+  RUN_TEST_CASE(pBuf, PBUF_insert_should_fill_each_priority_lane_separately);
+#endif  /* PBUF_MPSC */
+  RUN_TEST_CASE(pBuf, PBUF_insert_and_retrieve_should_run_concurrently_without_loss);
+#endif  /* PBUF_SPSC || PBUF_MPSC */
+#ifdef PBUF_SHARDS
+  RUN_TEST_CASE(pBuf, PBUF_shardedRetrieve_should_take_from_its_own_shard_first);
+  RUN_TEST_CASE(pBuf, PBUF_shardedRetrieve_should_steal_the_highest_priority_from_other_shards);
+  RUN_TEST_CASE(pBuf, PBUF_sharded_should_run_concurrently_without_loss);
+#endif  /* PBUF_SHARDS */
+#ifdef PBUF_CRITICAL_SPINLOCK
+  RUN_TEST_CASE(pBuf, PBUF_critical_sections_should_be_left_unlocked_after_every_call);
+  RUN_TEST_CASE(pBuf, PBUF_insert_and_retrieve_should_be_thread_safe_with_the_spinlock_hooks);
+#endif  /* PBUF_CRITICAL_SPINLOCK */
+#ifdef PBUF_WAIT
+  RUN_TEST_CASE(pBuf, PBUF_retrieveWait_should_return_at_once_or_time_out);
+  RUN_TEST_CASE(pBuf, PBUF_retrieveWait_should_wake_when_an_element_is_inserted);
+  RUN_TEST_CASE(pBuf, PBUF_retrieveWait_should_sleep_through_inserts_below_its_minimum_priority);
+#endif  /* PBUF_WAIT */
+#ifdef PBUF_AGING
+  RUN_TEST_CASE(pBuf, PBUF_setAging_should_promote_a_starved_run_until_it_is_served);
+  RUN_TEST_CASE(pBuf, PBUF_setAging_should_leave_runs_in_place_when_off);
+#ifdef PBUF_STATISTICS
+  RUN_TEST_CASE(pBuf, PBUF_setAging_should_raise_the_high_water_mark_of_the_run_promoted_into);
+#endif  /* PBUF_STATISTICS */
+#endif  /* PBUF_AGING */
+#ifdef PBUF_SCHEDULER
+  RUN_TEST_CASE(pBuf, PBUF_setScheduler_should_share_retrievals_by_weight);
+  RUN_TEST_CASE(pBuf, PBUF_setScheduler_should_serve_acquire_and_batch_retrieve_in_turn);
+  RUN_TEST_CASE(pBuf, PBUF_setScheduler_should_reject_invalid_policies_and_weights);
+  RUN_TEST_CASE(pBuf, PBUF_setScheduler_should_pay_off_deep_debts_without_passing_the_turn_round);
+#ifdef PAYLOAD_BUFFER
+  RUN_TEST_CASE(pBuf, PBUF_setScheduler_should_charge_payload_bytes_under_deficit_round_robin);
+  RUN_TEST_CASE(pBuf, PBUF_setScheduler_should_share_bytes_by_weight_when_payloads_exceed_the_weights);
+#endif  /* PAYLOAD_BUFFER */
+#endif  /* PBUF_SCHEDULER */
+#ifdef PBUF_STATISTICS
+  RUN_TEST_CASE(pBuf, PBUF_statistics_should_count_each_event_by_priority);
+  RUN_TEST_CASE(pBuf, PBUF_resetStatistics_should_restart_from_the_elements_held);
+#endif  /* PBUF_STATISTICS */
+#ifdef PBUF_EVENTFD
+  RUN_TEST_CASE(pBuf, PBUF_readableFd_should_signal_once_per_empty_to_non_empty_transition);
+  RUN_TEST_CASE(pBuf, PBUF_writableFd_should_signal_full_to_not_full_transitions_only);
+#endif  /* PBUF_EVENTFD */
 }